@@ -93,8 +93,8 @@ CSRCS3 = $(CSRCS2)
 endif
 
 
-# do not compile the src/testframework as that can only be done with rake
-CSRCS = $(filter-out $(SRC)/testframework/%,$(CSRCS3))
+# do not compile the src/testframework as that can only be done with rake, nor the src/host port
+CSRCS = $(filter-out $(SRC)/testframework/% $(SRC)/host/%,$(CSRCS3))
 
 ifeq "$(DISABLEMSD)" "1"
 DEFINES += -DDISABLEMSD
@@ -138,8 +138,8 @@ EXL = $(patsubst %,$(SRC)/modules/%/%,$(EXCLUDED_MODULES))
 CPPSRCS3 = $(filter-out $(EXL),$(CPPSRCS21))
 DEFINES += $(call uc, $(subst /,_,$(patsubst %,-DNO_%,$(EXCLUDED_MODULES))))
 
-# do not compile the src/testframework as that can only be done with rake
-CPPSRCS = $(filter-out $(SRC)/testframework/%,$(CPPSRCS3))
+# do not compile the src/testframework as that can only be done with rake, nor the src/host port
+CPPSRCS = $(filter-out $(SRC)/testframework/% $(SRC)/host/%,$(CPPSRCS3))
 
 # List of the objects files to be compiled/assembled
 OBJECTS = $(patsubst %.c,$(OUTDIR)/%.o,$(CSRCS)) $(patsubst %.s,$(OUTDIR)/%.o,$(patsubst %.S,$(OUTDIR)/%.o,$(ASRCS))) $(patsubst %.cpp,$(OUTDIR)/%.o,$(CPPSRCS))
@@ -160,7 +160,8 @@ MBED_DIR = $(BUILD_DIR)/../mbed/drop
 MRI_DIR  = $(BUILD_DIR)/../mri
 
 # Include path which points to external library headers and to subdirectories of this project which contain headers.
-SUBDIRS = $(wildcard $(SRC)/* $(SRC)/*/* $(SRC)/*/*/* $(SRC)/*/*/*/* $(SRC)/*/*/*/*/* $(SRC)/*/*/*/*/*/*)
+# the host port has its own device headers, they must not be found by the firmware build
+SUBDIRS = $(filter-out $(SRC)/host/%,$(wildcard $(SRC)/* $(SRC)/*/* $(SRC)/*/*/* $(SRC)/*/*/*/* $(SRC)/*/*/*/*/* $(SRC)/*/*/*/*/*/*))
 PROJINCS = $(sort $(dir $(SUBDIRS)))
 INCDIRS += $(SRC) $(PROJINCS) $(MRI_DIR) $(MBED_DIR) $(MBED_DIR)/$(DEVICE)
 
@@ -22,12 +22,17 @@
 
 #include "platform_memory.h"
 
+// stack size used when STACK_SIZE is not set, there is no MPU guard region then
+#define DEFAULT_CCM_STACK_SIZE 8192
+
 unsigned int g_maximumHeapAddress;
+unsigned int g_stackLimitAddress;
 
 static void fillUnusedRAM(void);
+static void fillUnusedStack(void);
 static void configureStackSizeLimit(unsigned int stackSizeLimit);
 static unsigned int alignTo32Bytes(unsigned int value);
-static void configureMpuToCatchStackOverflowIntoHeap(unsigned int maximumHeapAddress);
+static void configureMpuToCatchStackOverflow(unsigned int stackLimitAddress);
 static void configureMpuRegionToAccessAllMemoryWithNoCaching(void);
 
 
@@ -35,6 +40,7 @@ static void configureMpuRegionToAccessAllMemoryWithNoCaching(void);
 extern unsigned int     __bss_start__;
 extern unsigned int     __bss_end__;
 extern unsigned int     __StackTop;
+extern unsigned int     __RAM_end;
 extern "C" unsigned int __end__;
 
 extern "C" void mbed_sdk_init(void);
@@ -50,9 +56,10 @@ extern "C" void _start(void)
     memset(&__bss_start__, 0, bssSize);
     fillUnusedRAM();
 
-    if (STACK_SIZE) {
-        configureStackSizeLimit(STACK_SIZE);
-    }
+    // the stack is in CCM so the heap can have the rest of RAM
+    g_maximumHeapAddress = (unsigned int)&__RAM_end;
+    configureStackSizeLimit(STACK_SIZE ? STACK_SIZE : DEFAULT_CCM_STACK_SIZE);
+    fillUnusedStack();
     if (WRITE_BUFFER_DISABLE) {
         disableMPU();
         configureMpuRegionToAccessAllMemoryWithNoCaching();
@@ -75,17 +82,23 @@ extern "C" void _start(void)
     extern uint8_t __AHB1_block_start;
     extern uint8_t __AHB1_dyn_start;
     extern uint8_t __AHB1_end;
+    extern uint8_t __CCM_block_start;
+    extern uint8_t __CCM_dyn_start;
 
-    // zero the data sections in AHB0 and AHB1
+    // zero the data sections in AHB0, AHB1 and CCM
     memset(&__AHB0_block_start, 0, &__AHB0_dyn_start - &__AHB0_block_start);
     memset(&__AHB1_block_start, 0, &__AHB1_dyn_start - &__AHB1_block_start);
+    memset(&__CCM_block_start, 0, &__CCM_dyn_start - &__CCM_block_start);
 
     MemoryPool _AHB0_stack(&__AHB0_dyn_start, &__AHB0_end - &__AHB0_dyn_start);
     MemoryPool _AHB1_stack(&__AHB1_dyn_start, &__AHB1_end - &__AHB1_dyn_start);
+    // the CCM pool ends at the stack guard region
+    MemoryPool _CCM_stack(&__CCM_dyn_start, (uint8_t *)g_stackLimitAddress - &__CCM_dyn_start);
 
 
     _AHB0 = &_AHB0_stack;
     _AHB1 = &_AHB1_stack;
+    _CCM = &_CCM_stack;
     // MemoryPool init done
 
     __libc_init_array();
@@ -103,8 +116,8 @@ static __attribute__((naked)) void fillUnusedRAM(void)
         " movw  r0, #0xbeef\n"
         " movt  r0, #0xdead\n"
         " mov   r1, r0\n"
-        // Don't fill past current stack pointer value.
-        " mov   r3, sp\n"
+        // Fill to the end of RAM, the stack is in CCM.
+        " ldr   r3, =__RAM_end\n"
         " bics  r3, r3, #7\n"
         "1$:\n"
         " strd  r0, r1, [r2], #8\n"
@@ -114,11 +127,22 @@ static __attribute__((naked)) void fillUnusedRAM(void)
     );
 }
 
+// fill the stack below the current stack pointer so mem can report how much of it has been used
+static void fillUnusedStack(void)
+{
+    unsigned int *p = (unsigned int *)(g_stackLimitAddress + 32);
+    unsigned int *sp = (unsigned int *)(__get_MSP() - 64);
+    while (p < sp)
+        *p++ = 0xdeadbeef;
+}
+
 static void configureStackSizeLimit(unsigned int stackSizeLimit)
 {
-    // Note: 32 bytes are reserved to fall between top of heap and top of stack for minimum MPU guard region.
-    g_maximumHeapAddress = alignTo32Bytes((unsigned int)&__StackTop - stackSizeLimit - 32);
-    configureMpuToCatchStackOverflowIntoHeap(g_maximumHeapAddress);
+    // Note: 32 bytes are reserved to fall between top of the CCM pool and bottom of stack for minimum MPU guard region.
+    g_stackLimitAddress = alignTo32Bytes((unsigned int)&__StackTop - stackSizeLimit - 32);
+    if (STACK_SIZE) {
+        configureMpuToCatchStackOverflow(g_stackLimitAddress);
+    }
 }
 
 static unsigned int alignTo32Bytes(unsigned int value)
@@ -126,12 +150,12 @@ static unsigned int alignTo32Bytes(unsigned int value)
     return (value + 31) & ~31;
 }
 
-static void configureMpuToCatchStackOverflowIntoHeap(unsigned int maximumHeapAddress)
+static void configureMpuToCatchStackOverflow(unsigned int stackLimitAddress)
 {
 #define MPU_REGION_SIZE_OF_32_BYTES ((5-1) << MPU_RASR_SIZE_SHIFT)  // 2^5 = 32 bytes.
 
     prepareToAccessMPURegion(getHighestMPUDataRegionIndex());
-    setMPURegionAddress(maximumHeapAddress);
+    setMPURegionAddress(stackLimitAddress);
     setMPURegionAttributeAndSize(MPU_REGION_SIZE_OF_32_BYTES | MPU_RASR_ENABLE);
     enableMPUWithDefaultMemoryMap();
 }
@@ -240,8 +264,8 @@ extern "C" caddr_t _sbrk(int incr)
 
 static int doesHeapCollideWithStack(unsigned int newHeap)
 {
-    return ((newHeap >= __get_MSP()) ||
-            (STACK_SIZE && newHeap >= g_maximumHeapAddress));
+    // the stack is in CCM, so the heap just has to stay in RAM
+    return newHeap >= g_maximumHeapAddress;
 }
 
 
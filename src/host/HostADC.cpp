@@ -0,0 +1,47 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// The adc of the host build, there are no thermistors to read so it never takes a sample
+
+#include "stmadc.h"
+
+using namespace mbed;
+
+ADC *ADC::instance;
+
+ADC::ADC(int sample_rate, int cclk_div)
+{
+    instance= this;
+    attached= 0;
+    scan_count_active= scan_count_next= scan_index= 0;
+    interrupt_mask= 0;
+    _adc_g_isr= nullptr;
+}
+
+uint8_t ADC::setup(PinName pin, int state)
+{
+    return _pin_to_channel(pin);
+}
+
+void ADC::burst(int state)
+{
+}
+
+void ADC::interrupt_state(PinName pin, int state)
+{
+}
+
+void ADC::append(void(*fptr)(int chan, uint32_t value))
+{
+    _adc_g_isr= fptr;
+}
+
+uint8_t ADC::_pin_to_channel(PinName pin)
+{
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// The firmware's /sd/ and /local/ are a directory on the host, the config file is read from there too.
+// The calls that take a path are wrapped by the linker, see LDFLAGS in the makefile.
+
+#include "HostHal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+static const char *sd_dir= ".";
+
+void host_set_sd_dir(const char *dir)
+{
+    sd_dir= dir;
+}
+
+const char *host_sd_path(const char *path, char *buf, int size)
+{
+    static const char *const roots[]= {"/sd", "/local"};
+    for(const char *root : roots) {
+        size_t n= strlen(root);
+        if(strncmp(path, root, n) == 0 && (path[n] == '/' || path[n] == '\0')) {
+            snprintf(buf, size, "%s%s", sd_dir, path + n);
+            return buf;
+        }
+    }
+    return path;
+}
+
+extern "C" {
+
+FILE *__real_fopen(const char *path, const char *mode);
+DIR *__real_opendir(const char *path);
+int __real_remove(const char *path);
+int __real_rename(const char *from, const char *to);
+int __real_mkdir(const char *path, mode_t mode);
+
+FILE *__wrap_fopen(const char *path, const char *mode)
+{
+    char buf[256];
+    return __real_fopen(host_sd_path(path, buf, sizeof(buf)), mode);
+}
+
+DIR *__wrap_opendir(const char *path)
+{
+    char buf[256];
+    return __real_opendir(host_sd_path(path, buf, sizeof(buf)));
+}
+
+int __wrap_remove(const char *path)
+{
+    char buf[256];
+    return __real_remove(host_sd_path(path, buf, sizeof(buf)));
+}
+
+int __wrap_rename(const char *from, const char *to)
+{
+    char buf1[256], buf2[256];
+    return __real_rename(host_sd_path(from, buf1, sizeof(buf1)), host_sd_path(to, buf2, sizeof(buf2)));
+}
+
+int __wrap_mkdir(const char *path, mode_t mode)
+{
+    char buf[256];
+    // the firmware passes 0 as FAT has no modes
+    return __real_mkdir(host_sd_path(path, buf, sizeof(buf)), 0755);
+}
+
+}
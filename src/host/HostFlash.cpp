@@ -0,0 +1,94 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// The last two flash sectors for the host build, FlashStore.cpp uses them as it does on the chip.
+// They are mapped at their chip address as the store keeps addresses in 32 bits, with a file behind them the
+// settings saved with M500 are still there the next time.
+
+#include "HostHal.h"
+
+#include "stm32f4xx.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FLASH_MAP_BASE  0x080C0000U
+#define FLASH_MAP_SIZE  0x40000U
+#define FLASH_SECTOR_SIZE 0x20000U
+
+FLASH_TypeDef host_flash;
+WWDG_TypeDef host_wwdg;
+
+bool host_flash_map(const char *file)
+{
+    int fd= -1;
+    bool blank= true;
+    int flags= MAP_FIXED_NOREPLACE;
+
+    if(file != nullptr) {
+        fd= open(file, O_RDWR | O_CREAT, 0644);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) != 0) {
+            fprintf(stderr, "can not open %s: %s\n", file, strerror(errno));
+            return false;
+        }
+        blank= st.st_size != FLASH_MAP_SIZE;
+        if(blank && ftruncate(fd, FLASH_MAP_SIZE) != 0) {
+            fprintf(stderr, "can not size %s: %s\n", file, strerror(errno));
+            close(fd);
+            return false;
+        }
+        flags |= MAP_SHARED;
+    } else {
+        flags |= MAP_PRIVATE | MAP_ANONYMOUS;
+    }
+
+    void *p= mmap((void *)(uintptr_t)FLASH_MAP_BASE, FLASH_MAP_SIZE, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if(fd >= 0) close(fd);
+    if(p != (void *)(uintptr_t)FLASH_MAP_BASE) {
+        fprintf(stderr, "can not map the flash store at 0x%08X: %s\n", FLASH_MAP_BASE, strerror(errno));
+        return false;
+    }
+
+    // erased flash reads as all ones
+    if(blank) memset(p, 0xFF, FLASH_MAP_SIZE);
+    return true;
+}
+
+void host_flash_erase(uint32_t sector)
+{
+    if(sector == 10 || sector == 11) {
+        memset((void *)(uintptr_t)(FLASH_MAP_BASE + (sector - 10) * FLASH_SECTOR_SIZE), 0xFF, FLASH_SECTOR_SIZE);
+    }
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+    if(TypeProgram != FLASH_TYPEPROGRAM_WORD || Address < FLASH_MAP_BASE || Address + 4 > FLASH_MAP_BASE + FLASH_MAP_SIZE || (Address & 3) != 0) {
+        return HAL_ERROR;
+    }
+
+    // programming can only clear bits
+    *(volatile uint32_t *)(uintptr_t)Address &= (uint32_t)Data;
+    return HAL_OK;
+}
@@ -0,0 +1,310 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The timers and the interrupt controller of the host build, see HostHal.h
+
+#include "HostHal.h"
+
+#include "stm32f407xx.h"
+#include "us_ticker_api.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+TIM_TypeDef host_tim[15];
+GPIO_TypeDef host_gpio[9];
+SCB_Type host_scb;
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+uint32_t SystemCoreClock= 168000000;
+
+extern "C" void TIM6_DAC_IRQHandler(void);
+extern "C" void TIM7_IRQHandler(void);
+extern "C" void TIM8_TRG_COM_TIM14_IRQHandler(void);
+extern "C" void PendSV_Handler(void);
+
+// the timers the firmware runs itself, the others are only there for their registers
+struct emulated_timer {
+    TIM_TypeDef *tim;
+    IRQn_Type irq;
+    void (*handler)(void);
+    uint64_t origin;    // virtual time cnt was counted from
+    uint32_t cnt;       // CNT as last written by us, if it differs the firmware wrote it
+    bool running;
+};
+
+static emulated_timer timers[]= {
+    {TIM7, TIM7_IRQn, TIM7_IRQHandler, 0, 0, false},
+    {TIM14, TIM8_TRG_COM_TIM14_IRQn, TIM8_TRG_COM_TIM14_IRQHandler, 0, 0, false},
+    {TIM6, TIM6_DAC_IRQn, TIM6_DAC_IRQHandler, 0, 0, false},
+};
+#define NTIMERS (sizeof(timers) / sizeof(timers[0]))
+
+// exceptions are negative IRQn, so everything is offset
+#define IRQ_INDEX(n) ((int)(n) + 16)
+#define NIRQ (HOST_IRQ_COUNT + 16)
+
+static uint8_t priority[NIRQ];
+static bool enabled[NIRQ];
+static bool pending[NIRQ];
+
+static uint64_t now;
+static bool primask;
+static bool in_isr;
+static bool polling;
+
+static float speed= 1;
+static uint64_t speed_origin_virtual;
+static uint64_t speed_origin_real;
+
+static uint64_t real_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void host_set_speed(float s)
+{
+    speed_origin_virtual= now;
+    speed_origin_real= real_ns();
+    speed= s;
+}
+
+uint64_t host_now()
+{
+    return now;
+}
+
+bool host_irq_blocked()
+{
+    return primask || in_isr;
+}
+
+static void call_isr(void (*handler)(void *), void *arg)
+{
+    in_isr= true;
+    handler(arg);
+    in_isr= false;
+}
+
+static void call_vector(void *arg)
+{
+    ((void (*)(void))arg)();
+}
+
+static void (*vector_of(int i))(void)
+{
+    if(i == IRQ_INDEX(PendSV_IRQn)) return PendSV_Handler;
+    for (size_t t = 0; t < NTIMERS; ++t) {
+        if(IRQ_INDEX(timers[t].irq) == i) return timers[t].handler;
+    }
+    return nullptr;
+}
+
+// run the pending interrupts, highest priority first, until there are none left
+static void dispatch_pending()
+{
+    for (;;) {
+        if(host_irq_blocked()) return;
+
+        if(host_scb.ICSR & SCB_ICSR_PENDSVSET_Msk) {
+            host_scb.ICSR &= ~SCB_ICSR_PENDSVSET_Msk;
+            pending[IRQ_INDEX(PendSV_IRQn)]= true;
+        }
+
+        int best= -1;
+        for (int i = 0; i < NIRQ; ++i) {
+            if(pending[i] && enabled[i] && (best < 0 || priority[i] < priority[best])) best= i;
+        }
+        if(best < 0) return;
+
+        pending[best]= false;
+        void (*v)(void)= vector_of(best);
+        if(v != nullptr) call_isr(call_vector, (void *)v);
+    }
+}
+
+void host_interrupt(void (*handler)(void *), void *arg)
+{
+    if(host_irq_blocked()) return;
+    call_isr(handler, arg);
+    dispatch_pending();
+}
+
+// pick up what the firmware did to the registers since we last looked
+static void sync_timer(emulated_timer& t)
+{
+    TIM_TypeDef *tim= t.tim;
+
+    if(tim->EGR & TIM_EGR_UG) {
+        tim->EGR= 0;
+        tim->CNT= 0;
+        t.cnt= 0;
+        t.origin= now;
+    }
+
+    if(!(tim->CR1 & TIM_CR1_CEN)) {
+        t.running= false;
+        return;
+    }
+
+    if(!t.running || tim->CNT != t.cnt) {
+        t.running= true;
+        t.cnt= tim->CNT;
+        t.origin= now;
+    }
+}
+
+// virtual time of the next update event, when the counter goes from ARR to 0
+static uint64_t next_update(const emulated_timer& t)
+{
+    uint64_t psc= t.tim->PSC + 1;
+    uint32_t arr= t.tim->ARR & 0xFFFF;
+    uint64_t counts= (t.cnt <= arr) ? arr - t.cnt + 1 : (0x10000 - t.cnt) + arr + 1;
+    return t.origin + counts * psc;
+}
+
+static void count_to(emulated_timer& t, uint64_t time)
+{
+    uint64_t psc= t.tim->PSC + 1;
+    uint64_t counts= (time - t.origin) / psc;
+    t.origin += counts * psc;
+    t.cnt= (t.cnt + counts) & 0xFFFF;
+    t.tim->CNT= t.cnt;
+}
+
+static void run_until(uint64_t target)
+{
+    for (;;) {
+        uint64_t first= target;
+        int due= -1;
+        for (size_t i = 0; i < NTIMERS; ++i) {
+            sync_timer(timers[i]);
+            if(!timers[i].running) continue;
+            uint64_t u= next_update(timers[i]);
+            if(u <= first) {
+                first= u;
+                due= i;
+            }
+        }
+
+        for (size_t i = 0; i < NTIMERS; ++i) {
+            if(timers[i].running) count_to(timers[i], first);
+        }
+        if(first > now) now= first;
+        host_dwt.CYCCNT= now * (SystemCoreClock / HOST_TIMER_CLOCK);
+        if(due < 0) return;
+
+        emulated_timer& t= timers[due];
+        t.cnt= 0;
+        t.tim->CNT= 0;
+        t.origin= now;
+        t.tim->SR |= TIM_SR_UIF;
+        if(t.tim->CR1 & TIM_CR1_OPM) {
+            t.tim->CR1 &= ~TIM_CR1_CEN;
+            t.running= false;
+        }
+        if(t.tim->DIER & TIM_DIER_UIE) pending[IRQ_INDEX(t.irq)]= true;
+
+        dispatch_pending();
+    }
+}
+
+void host_poll()
+{
+    // a poll from inside a poll, eg us_ticker_read() in a handler, only gets the time
+    if(polling || host_irq_blocked()) return;
+    polling= true;
+
+    uint64_t target= speed_origin_virtual + (uint64_t)((real_ns() - speed_origin_real) * (double)speed * HOST_TIMER_CLOCK / 1e9);
+    if(target > now) run_until(target);
+    dispatch_pending();
+    host_serial_poll();
+
+    polling= false;
+}
+
+extern "C" {
+
+uint32_t us_ticker_read()
+{
+    host_poll();
+    return now / (HOST_TIMER_CLOCK / 1000000);
+}
+
+void host_nvic_set_vector(IRQn_Type IRQn)
+{
+    // the handlers are known by name
+}
+
+void NVIC_SetPriorityGrouping(uint32_t PriorityGroup)
+{
+}
+
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t p)
+{
+    priority[IRQ_INDEX(IRQn)]= p;
+}
+
+uint32_t NVIC_GetPriority(IRQn_Type IRQn)
+{
+    return priority[IRQ_INDEX(IRQn)];
+}
+
+void NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+    enabled[IRQ_INDEX(IRQn)]= true;
+}
+
+void NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+    enabled[IRQ_INDEX(IRQn)]= false;
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type IRQn)
+{
+    pending[IRQ_INDEX(IRQn)]= true;
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn)
+{
+    pending[IRQ_INDEX(IRQn)]= false;
+}
+
+void NVIC_SystemReset(void)
+{
+    host_serial_report();
+    fprintf(stderr, "reset requested, exiting\n");
+    exit(0);
+}
+
+void __disable_irq(void)
+{
+    primask= true;
+}
+
+void __enable_irq(void)
+{
+    primask= false;
+    // anything pended while masked is taken now, as it would be on the chip
+    if(!in_isr) dispatch_pending();
+}
+
+uint32_t __get_PRIMASK(void)
+{
+    return primask;
+}
+
+void __set_PRIMASK(uint32_t m)
+{
+    if(m) __disable_irq();
+    else __enable_irq();
+}
+
+}
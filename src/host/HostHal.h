@@ -0,0 +1,48 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Virtual time for the host build.
+// Time is counted in timer clock cycles (SystemCoreClock/2, 84MHz) and follows the wall clock times a speed factor.
+// The emulated timers expire and their interrupts run at the exact virtual time they are due, but only when the
+// firmware gives the host a chance: from the main loop, from us_ticker_read() and when interrupts are enabled again.
+// Interrupts take no virtual time and are not preempted.
+
+#define HOST_TIMER_CLOCK 84000000ULL
+
+// set the virtual seconds per real second
+void host_set_speed(float speed);
+
+// virtual time now
+uint64_t host_now();
+
+// run all the interrupts due up to the virtual time of the wall clock
+void host_poll();
+
+// true when the interrupts would not be taken, masked or in an interrupt already
+bool host_irq_blocked();
+
+// call handler in interrupt context, for the emulated devices other than the timers
+void host_interrupt(void (*handler)(void *), void *arg);
+
+// the serial ports are polled after the timers, HostSerial.cpp
+void host_serial_poll();
+void host_serial_report();
+// a baud rate for every UART instead of the configured one, 0 is unlimited
+void host_serial_set_baud(int baud);
+// symlink to the pty of the main UART
+void host_serial_set_link(const char *link);
+
+// where the firmware's /sd/ is on the host, HostFiles.cpp
+void host_set_sd_dir(const char *dir);
+const char *host_sd_path(const char *path, char *buf, int size);
+
+// maps the flash store sectors to a file, HostFlash.cpp
+bool host_flash_map(const char *file);
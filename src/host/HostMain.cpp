@@ -0,0 +1,193 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// main() of the host build, it brings the firmware up as main.cpp does with the modules the host build has.
+//
+// smoothie [-s speed] [-b baud] [-d sd_dir] [-f flash_file] [-l link]
+//
+//  -s  virtual seconds per real second, default 1
+//  -b  baud rate of all the UARTs whatever the config says, 0 is as fast as the host can go
+//  -d  the directory that is /sd/, the config is read from there, default .
+//  -f  the file that keeps the settings saved with M500, they are lost on exit without it
+//  -l  make a symlink to the pty of the main UART, so a host program can be pointed at a fixed name
+//
+// The serial statistics and the planner queue occupancy are printed on exit and on SIGUSR1.
+
+#include "HostHal.h"
+
+#include "libs/Kernel.h"
+#include "modules/tools/endstops/Endstops.h"
+#include "modules/robot/Conveyor.h"
+#include "modules/robot/AuxMotion.h"
+#include "modules/robot/PositionStrobe.h"
+#include "modules/utils/player/Player.h"
+#include "modules/utils/macros/Macros.h"
+#include "modules/utils/jobbuffer/JobBuffer.h"
+#include "Config.h"
+#include "StepTicker.h"
+#include "SlowTicker.h"
+#include "Robot.h"
+#include "StreamOutputPool.h"
+#include "libs/gpio.h"
+#include "platform_memory.h"
+#include "MemoryPool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+
+GPIO leds[] = {
+    GPIO(PE_12),
+    GPIO(PE_13),
+};
+
+// the pools are as big as the ones on the chip, MemoryPool can not be bigger
+static uint32_t ahb0_pool[0xFFFC / 4];
+static uint32_t ahb1_pool[0xFFFC / 4];
+static uint32_t ccm_pool[0xFFFC / 4];
+
+static volatile sig_atomic_t quit;
+static volatile sig_atomic_t report;
+
+// how full the planner queue is, sampled from the slow ticker while anything is queued
+class QueueSampler {
+    public:
+        uint32_t sample(uint32_t)
+        {
+            unsigned int n= THEKERNEL->conveyor->get_queue_count();
+            if(n == 0) return 0;
+            samples++;
+            sum += n;
+            if(n > max) max= n;
+            if(n + 1 >= THEKERNEL->conveyor->get_queue_size()) full++;
+            return 0;
+        }
+
+        void print()
+        {
+            if(samples == 0) return;
+            fprintf(stderr, "planner queue of %u while busy: avg %.1f max %u full %.1f%%\n",
+                    (unsigned)THEKERNEL->conveyor->get_queue_size(), (double)sum / samples, max, 100.0 * full / samples);
+        }
+
+    private:
+        uint64_t samples{0};
+        uint64_t sum{0};
+        uint64_t full{0};
+        unsigned int max{0};
+};
+
+static QueueSampler queue_sampler;
+
+static void print_report()
+{
+    host_serial_report();
+    queue_sampler.print();
+}
+
+static void on_signal(int sig)
+{
+    if(sig == SIGUSR1) report= 1;
+    else quit= 1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-s speed] [-b baud] [-d sd_dir] [-f flash_file] [-l link]\n", name);
+    exit(1);
+}
+
+static void init()
+{
+    for (uint8_t i = 0; i < sizeof(leds)/sizeof(leds[0]); i++){
+        leds[i].output();
+        leds[i]= 0;
+    }
+
+    Kernel* kernel = new Kernel();
+
+    kernel->add_module( new(AHB0) Player() );
+    kernel->add_module( new(AHB0) AuxMotion() );
+    kernel->add_module( new(AHB0) PositionStrobe() );
+    #ifndef NO_TOOLS_ENDSTOPS
+    kernel->add_module( new(AHB0) Endstops() );
+    #endif
+    #ifndef NO_UTILS_MACROS
+    kernel->add_module( new(AHB0) Macros() );
+    #endif
+    #ifndef NO_UTILS_JOBBUFFER
+    kernel->add_module( new(AHB0) JobBuffer() );
+    #endif
+
+    kernel->config->config_cache_clear();
+
+    if(kernel->is_using_leds()) {
+        leds[0]= 1;
+    }
+
+    THEROBOT->restore_settings();
+
+    THEKERNEL->conveyor->start(THEROBOT->get_number_registered_motors());
+    THEKERNEL->step_ticker->start();
+    THEKERNEL->slow_ticker->start();
+
+    THEKERNEL->slow_ticker->attach(1000, &queue_sampler, &QueueSampler::sample);
+}
+
+int main(int argc, char *argv[])
+{
+    float speed= 1;
+    const char *flash_file= nullptr;
+    int opt;
+    while((opt= getopt(argc, argv, "s:b:d:f:l:")) != -1) {
+        switch(opt) {
+            case 's': speed= atof(optarg); break;
+            case 'b': host_serial_set_baud(atoi(optarg)); break;
+            case 'd': host_set_sd_dir(optarg); break;
+            case 'f': flash_file= optarg; break;
+            case 'l': host_serial_set_link(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind != argc || speed <= 0) usage(argv[0]);
+
+    MemoryPool ahb0(ahb0_pool, sizeof(ahb0_pool));
+    MemoryPool ahb1(ahb1_pool, sizeof(ahb1_pool));
+    MemoryPool ccm(ccm_pool, sizeof(ccm_pool));
+    _AHB0= &ahb0;
+    _AHB1= &ahb1;
+    _CCM= &ccm;
+
+    if(!host_flash_map(flash_file)) return 1;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGUSR1, on_signal);
+
+    host_set_speed(speed);
+    init();
+
+    uint16_t cnt= 0;
+    while(!quit){
+        if(report) {
+            report= 0;
+            print_report();
+        }
+        host_poll();
+        if(THEKERNEL->is_using_leds()) {
+            leds[0]= (cnt++ & 0x1000) ? 1 : 0;
+        }
+        THEKERNEL->call_event(ON_MAIN_LOOP);
+        THEKERNEL->call_event(ON_IDLE);
+    }
+
+    print_report();
+    return 0;
+}
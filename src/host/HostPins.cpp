@@ -0,0 +1,114 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// The pin side of the mbed hal for the host build.
+// Pins are the GPIO registers in memory so reading an input gives what was last put in IDR, endstops never trigger.
+// There is no hardware pwm, no adc and no pin interrupts.
+
+#include "stm32f407xx.h"
+#include "pinmap.h"
+#include "port_api.h"
+#include "pwmout_api.h"
+#include "gpio_api.h"
+#include "gpio_irq_api.h"
+#include "PeripheralPins.h"
+#include "mbed_error.h"
+#include "mbed_assert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+const PinMap PinMap_ADC[]= {
+    {NC, (int)NC, 0}
+};
+
+const PinMap PinMap_PWM[]= {
+    {NC, (int)NC, 0}
+};
+
+extern "C" {
+
+uint32_t Set_GPIO_Clock(uint32_t port_idx)
+{
+    // the firmware only uses this to turn the clock on, the address does not fit the return value here
+    return 0;
+}
+
+PinName port_pin(PortName port, int pin_n)
+{
+    return (PinName)(pin_n + (port << 4));
+}
+
+void pin_function(PinName pin, int function)
+{
+}
+
+void pin_mode(PinName pin, PinMode mode)
+{
+}
+
+void pwmout_init(pwmout_t* obj, PinName pin)
+{
+    obj->pin= pin;
+    obj->period= 0;
+    obj->pulse= 0;
+}
+
+void pwmout_free(pwmout_t* obj) {}
+void pwmout_write(pwmout_t* obj, float percent) { obj->pulse= percent * obj->period; }
+float pwmout_read(pwmout_t* obj) { return obj->period == 0 ? 0 : (float)obj->pulse / obj->period; }
+void pwmout_period(pwmout_t* obj, float seconds) { obj->period= seconds * 1000000; }
+void pwmout_period_ms(pwmout_t* obj, int ms) { obj->period= ms * 1000; }
+void pwmout_period_us(pwmout_t* obj, int us) { obj->period= us; }
+void pwmout_pulsewidth(pwmout_t* obj, float seconds) { obj->pulse= seconds * 1000000; }
+void pwmout_pulsewidth_ms(pwmout_t* obj, int ms) { obj->pulse= ms * 1000; }
+void pwmout_pulsewidth_us(pwmout_t* obj, int us) { obj->pulse= us; }
+
+static GPIO_TypeDef* const gpios[]= {GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH, GPIOI};
+
+void gpio_init(gpio_t *obj, PinName pin, PinDirection direction)
+{
+    obj->pin= pin;
+    if(pin == (PinName)NC) return;
+    obj->mask= 1 << STM_PIN(pin);
+    obj->reg_in= &gpios[STM_PORT(pin)]->IDR;
+    obj->reg_set_clr= &gpios[STM_PORT(pin)]->BSRR;
+}
+
+void gpio_mode(gpio_t *obj, PinMode mode) {}
+void gpio_dir(gpio_t *obj, PinDirection direction) {}
+
+int gpio_irq_init(gpio_irq_t *obj, PinName pin, gpio_irq_handler handler, uint32_t id)
+{
+    obj->pin= pin;
+    return 0;
+}
+
+void gpio_irq_free(gpio_irq_t *obj) {}
+void gpio_irq_set(gpio_irq_t *obj, gpio_irq_event event, uint32_t enable) {}
+
+void error(const char* format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+    vfprintf(stderr, format, arg);
+    va_end(arg);
+    exit(1);
+}
+
+void mbed_assert_internal(const char *expr, const char *file, int line)
+{
+    error("mbed assertation failed: %s, file: %s, line %d \n", expr, file, line);
+}
+
+// MRI_Hooks.cpp is not built, there is no debugger to protect the machine from
+void set_high_on_debug(int port, int pin) {}
+void set_low_on_debug(int port, int pin) {}
+
+}
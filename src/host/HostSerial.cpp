@@ -0,0 +1,311 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// The mbed serial hal for the host build, every UART is a pseudo terminal.
+// Characters go both ways at the rate the baud rate allows in virtual time, a host program that writes faster than
+// that, or faster than the firmware takes them, is held back by the pty buffer. Each port counts what goes through it
+// and times every line from its last character received to the ok sent for it.
+
+#include "HostHal.h"
+
+#include "serial_api.h"
+#include "PeripheralNames.h"
+#include "mbed_error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+#define WIRE_SIZE 256
+#define MAX_PORTS 6
+
+struct host_port {
+    int master;
+    int slave;
+    char name[64];
+    uint32_t baud;
+
+    uart_irq_handler handler;
+    uint32_t id;
+    bool rx_irq;
+
+    // read ahead from the pty, the first arrived of them are in the receive register
+    uint8_t wire[WIRE_SIZE];
+    int head, count, arrived;
+    uint64_t next_rx;
+    uint64_t tx_free;
+
+    // statistics
+    uint64_t rx_bytes, tx_bytes, rx_lines, tx_lines, oks;
+    bool rx_cr;
+    char rx_first;
+    char tx_start[2];
+    int tx_len;
+    std::deque<uint64_t> waiting;
+    std::vector<uint32_t> latency;
+    uint64_t first_line, last_ok;
+};
+
+static host_port *ports[MAX_PORTS];
+static int forced_baud= -1;
+static const char *link_name;
+
+void host_serial_set_baud(int baud)
+{
+    forced_baud= baud;
+}
+
+void host_serial_set_link(const char *link)
+{
+    link_name= link;
+}
+
+static int uart_index(PinName tx, PinName rx)
+{
+    UARTName u= UART_2;
+    if(tx == PA_9 || tx == PA_10 || rx == PA_9 || rx == PA_10) u= UART_1;
+    switch(u) {
+        case UART_1: return 0;
+        default: return 1;
+    }
+}
+
+static host_port *open_port(int index)
+{
+    host_port *p= new host_port();
+    if(openpty(&p->master, &p->slave, p->name, nullptr, nullptr) != 0) {
+        error("openpty failed: %s\n", strerror(errno));
+    }
+
+    // the slave is kept open so the master never sees EIO when the host program closes it
+    struct termios t;
+    tcgetattr(p->slave, &t);
+    cfmakeraw(&t);
+    tcsetattr(p->slave, TCSANOW, &t);
+    fcntl(p->master, F_SETFL, fcntl(p->master, F_GETFL) | O_NONBLOCK);
+
+    fprintf(stderr, "UART%d is %s\n", index + 1, p->name);
+
+    if(index == 0 && link_name != nullptr) {
+        unlink(link_name);
+        if(symlink(p->name, link_name) != 0) {
+            fprintf(stderr, "can not link %s to %s: %s\n", link_name, p->name, strerror(errno));
+        }
+    }
+    return p;
+}
+
+// virtual time one character takes, 10 bits with the start and stop bits
+static uint64_t char_time(host_port *p)
+{
+    return p->baud == 0 ? 0 : HOST_TIMER_CLOCK * 10 / p->baud;
+}
+
+extern "C" {
+
+void serial_init(serial_t *obj, PinName tx, PinName rx, PinName rts, PinName cts)
+{
+    // the same UART is opened again once the config is read, it keeps its pty
+    int index= uart_index(tx, rx);
+    if(ports[index] == nullptr) ports[index]= open_port(index);
+
+    obj->index= index;
+    obj->pin_tx= tx;
+    obj->pin_rx= rx;
+    serial_baud(obj, 9600);
+}
+
+void serial_free(serial_t *obj)
+{
+}
+
+void serial_baud(serial_t *obj, int baudrate)
+{
+    obj->baudrate= baudrate;
+    ports[obj->index]->baud= forced_baud >= 0 ? forced_baud : baudrate;
+}
+
+void serial_format(serial_t *obj, int data_bits, SerialParity parity, int stop_bits)
+{
+}
+
+void serial_irq_handler(serial_t *obj, uart_irq_handler handler, uint32_t id)
+{
+    ports[obj->index]->handler= handler;
+    ports[obj->index]->id= id;
+}
+
+void serial_irq_set(serial_t *obj, SerialIrq irq, uint32_t enable)
+{
+    // nothing waits for the transmitter so there is never a TxIrq
+    if(irq == RxIrq) ports[obj->index]->rx_irq= enable;
+}
+
+int serial_readable(serial_t *obj)
+{
+    return ports[obj->index]->arrived > 0;
+}
+
+int serial_writable(serial_t *obj)
+{
+    return host_now() >= ports[obj->index]->tx_free;
+}
+
+int serial_getc(serial_t *obj)
+{
+    host_port *p= ports[obj->index];
+    if(p->arrived == 0) return -1;
+
+    uint8_t c= p->wire[p->head];
+    p->head= (p->head + 1) % WIRE_SIZE;
+    p->count--;
+    p->arrived--;
+
+    p->rx_bytes++;
+    bool eol= c == '\n' || c == '\r';
+    if(eol && !(c == '\n' && p->rx_cr)) {
+        // only gcode is answered with an ok, shell commands are not
+        if(strchr("GMTNgmtn", p->rx_first) != nullptr && p->rx_first != '\0') {
+            if(p->rx_lines++ == 0) p->first_line= host_now();
+            p->waiting.push_back(host_now());
+        }
+        p->rx_first= 0;
+    } else if(p->rx_first == 0 && c != ' ' && c < 0x80 && strchr("?!~\x18", c) == nullptr) {
+        // the real time characters are taken out of the stream by the firmware
+        p->rx_first= c;
+    }
+    p->rx_cr= c == '\r';
+
+    return c;
+}
+
+static void count_tx(host_port *p, uint8_t c)
+{
+    p->tx_bytes++;
+    if(c == '\n') {
+        p->tx_lines++;
+        if(p->tx_len == 2 && p->tx_start[0] == 'o' && p->tx_start[1] == 'k') {
+            p->oks++;
+            p->last_ok= host_now();
+            if(!p->waiting.empty()) {
+                p->latency.push_back((host_now() - p->waiting.front()) / (HOST_TIMER_CLOCK / 1000000));
+                p->waiting.pop_front();
+            }
+        }
+        p->tx_len= 0;
+    } else if(p->tx_len < 2) {
+        p->tx_start[p->tx_len++]= c;
+    }
+}
+
+void serial_putc(serial_t *obj, int c)
+{
+    host_port *p= ports[obj->index];
+
+    // the firmware waits for the transmitter, which it can only do when the time can move on
+    while(!host_irq_blocked() && host_now() < p->tx_free) host_poll();
+    p->tx_free= std::max(p->tx_free, host_now()) + char_time(p);
+
+    uint8_t b= c;
+    for (int tries = 0; ; ++tries) {
+        ssize_t n= write(p->master, &b, 1);
+        if(n == 1) break;
+        if(n < 0 && errno != EAGAIN) break;
+        // nobody is reading, give them a while and then the character is lost as on the wire
+        struct pollfd pfd= {p->master, POLLOUT, 0};
+        if(tries == 10 || poll(&pfd, 1, 10) < 0) break;
+    }
+    count_tx(p, b);
+}
+
+void serial_clear(serial_t *obj)
+{
+}
+
+void serial_pinout_tx(PinName tx)
+{
+}
+
+}
+
+void host_serial_poll()
+{
+    uint64_t now= host_now();
+    for (host_port *p : ports) {
+        if(p == nullptr) continue;
+
+        // while the firmware has the receive interrupt off nothing is read, so the pty fills up and the sender waits
+        if(p->rx_irq && p->count < WIRE_SIZE) {
+            int tail= (p->head + p->count) % WIRE_SIZE;
+            int space= std::min(WIRE_SIZE - p->count, WIRE_SIZE - tail);
+            ssize_t n= read(p->master, &p->wire[tail], space);
+            if(n > 0) p->count += n;
+        }
+
+        uint64_t t= char_time(p);
+        if(t == 0) {
+            p->arrived= p->count;
+        } else {
+            // a line that was idle starts again now
+            if(p->arrived == p->count && p->next_rx < now) p->next_rx= now;
+            while(p->arrived < p->count && p->next_rx + t <= now) {
+                p->next_rx += t;
+                p->arrived++;
+            }
+        }
+
+        if(p->arrived > 0 && p->rx_irq && p->handler != nullptr) {
+            host_interrupt([](void *arg) {
+                host_port *p= static_cast<host_port *>(arg);
+                p->handler(p->id, RxIrq);
+            }, p);
+        }
+    }
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& v, int pc)
+{
+    return v[std::min(v.size() - 1, v.size() * pc / 100)];
+}
+
+void host_serial_report()
+{
+    for (int i = 0; i < MAX_PORTS; ++i) {
+        host_port *p= ports[i];
+        if(p == nullptr || p->rx_bytes + p->tx_bytes == 0) continue;
+
+        fprintf(stderr, "UART%d %s baud %u\n", i + 1, p->name, p->baud);
+        fprintf(stderr, "  received %llu bytes %llu gcode lines, sent %llu bytes %llu lines %llu ok\n",
+                (unsigned long long)p->rx_bytes, (unsigned long long)p->rx_lines,
+                (unsigned long long)p->tx_bytes, (unsigned long long)p->tx_lines, (unsigned long long)p->oks);
+
+        if(!p->latency.empty()) {
+            std::vector<uint32_t> v(p->latency);
+            std::sort(v.begin(), v.end());
+            uint64_t sum= 0;
+            for(uint32_t l : v) sum += l;
+            fprintf(stderr, "  ok latency us: min %u avg %llu p50 %u p90 %u p99 %u max %u\n",
+                    v.front(), (unsigned long long)(sum / v.size()), percentile(v, 50), percentile(v, 90), percentile(v, 99), v.back());
+        }
+
+        if(p->oks > 1 && p->last_ok > p->first_line) {
+            double s= (double)(p->last_ok - p->first_line) / HOST_TIMER_CLOCK;
+            fprintf(stderr, "  %.1f lines/s over %.3f s\n", p->oks / s, s);
+        }
+    }
+}
@@ -0,0 +1,299 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host build stand in for the CMSIS device header.
+// Only the peripherals the firmware touches directly are here, they are plain structs in memory that HostHal.cpp
+// looks at to emulate the timers and the interrupt controller in virtual time.
+
+#ifndef HOST_STM32F407XX_H
+#define HOST_STM32F407XX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __I     volatile const
+#define __O     volatile
+#define __IO    volatile
+
+typedef enum {
+    NonMaskableInt_IRQn         = -14,
+    MemoryManagement_IRQn       = -12,
+    BusFault_IRQn               = -11,
+    UsageFault_IRQn             = -10,
+    SVCall_IRQn                 = -5,
+    DebugMonitor_IRQn           = -4,
+    PendSV_IRQn                 = -2,
+    SysTick_IRQn                = -1,
+    WWDG_IRQn                   = 0,
+    EXTI0_IRQn                  = 6,
+    EXTI1_IRQn                  = 7,
+    EXTI2_IRQn                  = 8,
+    EXTI3_IRQn                  = 9,
+    EXTI4_IRQn                  = 10,
+    ADC_IRQn                    = 18,
+    EXTI9_5_IRQn                = 23,
+    USART1_IRQn                 = 37,
+    USART2_IRQn                 = 38,
+    USART3_IRQn                 = 39,
+    EXTI15_10_IRQn              = 40,
+    TIM8_TRG_COM_TIM14_IRQn     = 45,
+    UART4_IRQn                  = 52,
+    UART5_IRQn                  = 53,
+    TIM6_DAC_IRQn               = 54,
+    TIM7_IRQn                   = 55,
+    USART6_IRQn                 = 71,
+    OTG_HS_IRQn                 = 77,
+    HOST_IRQ_COUNT              = 82
+} IRQn_Type;
+
+typedef struct {
+    __IO uint32_t CR1;
+    __IO uint32_t CR2;
+    __IO uint32_t SMCR;
+    __IO uint32_t DIER;
+    __IO uint32_t SR;
+    __IO uint32_t EGR;
+    __IO uint32_t CCMR1;
+    __IO uint32_t CCMR2;
+    __IO uint32_t CCER;
+    __IO uint32_t CNT;
+    __IO uint32_t PSC;
+    __IO uint32_t ARR;
+    __IO uint32_t RCR;
+    __IO uint32_t CCR1;
+    __IO uint32_t CCR2;
+    __IO uint32_t CCR3;
+    __IO uint32_t CCR4;
+    __IO uint32_t BDTR;
+    __IO uint32_t DCR;
+    __IO uint32_t DMAR;
+    __IO uint32_t OR;
+} TIM_TypeDef;
+
+typedef struct {
+    __IO uint32_t MODER;
+    __IO uint32_t OTYPER;
+    __IO uint32_t OSPEEDR;
+    __IO uint32_t PUPDR;
+    __IO uint32_t IDR;
+    __IO uint32_t ODR;
+    __IO uint32_t BSRR;
+    __IO uint32_t LCKR;
+    __IO uint32_t AFR[2];
+} GPIO_TypeDef;
+
+typedef struct {
+    __IO uint32_t CPUID;
+    __IO uint32_t ICSR;
+    __IO uint32_t VTOR;
+    __IO uint32_t AIRCR;
+} SCB_Type;
+
+// the cycle counter follows the virtual time, HostHal.cpp updates it as the time advances
+typedef struct {
+    __IO uint32_t CTRL;
+    __IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern TIM_TypeDef host_tim[15];
+extern GPIO_TypeDef host_gpio[9];
+extern SCB_Type host_scb;
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+extern uint32_t SystemCoreClock;
+
+#define TIM1    (&host_tim[1])
+#define TIM2    (&host_tim[2])
+#define TIM3    (&host_tim[3])
+#define TIM4    (&host_tim[4])
+#define TIM5    (&host_tim[5])
+#define TIM6    (&host_tim[6])
+#define TIM7    (&host_tim[7])
+#define TIM8    (&host_tim[8])
+#define TIM9    (&host_tim[9])
+#define TIM10   (&host_tim[10])
+#define TIM11   (&host_tim[11])
+#define TIM12   (&host_tim[12])
+#define TIM13   (&host_tim[13])
+#define TIM14   (&host_tim[14])
+
+#define GPIOA   (&host_gpio[0])
+#define GPIOB   (&host_gpio[1])
+#define GPIOC   (&host_gpio[2])
+#define GPIOD   (&host_gpio[3])
+#define GPIOE   (&host_gpio[4])
+#define GPIOF   (&host_gpio[5])
+#define GPIOG   (&host_gpio[6])
+#define GPIOH   (&host_gpio[7])
+#define GPIOI   (&host_gpio[8])
+
+#define SCB     (&host_scb)
+#define DWT     (&host_dwt)
+#define CoreDebug (&host_core_debug)
+
+// the peripheral names in PeripheralNames.h are their base addresses
+#define TIM2_BASE       0x40000000U
+#define TIM3_BASE       0x40000400U
+#define TIM4_BASE       0x40000800U
+#define TIM5_BASE       0x40000C00U
+#define TIM12_BASE      0x40001800U
+#define TIM13_BASE      0x40001C00U
+#define TIM14_BASE      0x40002000U
+#define SPI2_BASE       0x40003800U
+#define SPI3_BASE       0x40003C00U
+#define USART2_BASE     0x40004400U
+#define USART3_BASE     0x40004800U
+#define UART4_BASE      0x40004C00U
+#define UART5_BASE      0x40005000U
+#define I2C1_BASE       0x40005400U
+#define I2C2_BASE       0x40005800U
+#define I2C3_BASE       0x40005C00U
+#define TIM1_BASE       0x40010000U
+#define TIM8_BASE       0x40010400U
+#define USART1_BASE     0x40011000U
+#define USART6_BASE     0x40011400U
+#define ADC1_BASE       0x40012000U
+#define SPI1_BASE       0x40013000U
+#define TIM9_BASE       0x40014000U
+#define TIM10_BASE      0x40014400U
+#define TIM11_BASE      0x40014800U
+
+#define TIM_CR1_CEN                 0x0001U
+#define TIM_CR1_UDIS                0x0002U
+#define TIM_CR1_URS                 0x0004U
+#define TIM_CR1_OPM                 0x0008U
+#define TIM_DIER_UIE                0x0001U
+#define TIM_SR_UIF                  0x0001U
+#define TIM_EGR_UG                  0x0001U
+
+#define SCB_ICSR_PENDSVSET_Pos      28U
+#define SCB_ICSR_PENDSVSET_Msk      (1UL << SCB_ICSR_PENDSVSET_Pos)
+#define SCB_ICSR_PENDSVCLR_Msk      (1UL << 27U)
+
+#define DWT_CTRL_CYCCNTENA_Msk      0x0001U
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24U)
+
+// clocks are always on
+#define __TIM6_CLK_ENABLE()         do {} while(0)
+#define __TIM7_CLK_ENABLE()         do {} while(0)
+#define __TIM14_CLK_ENABLE()        do {} while(0)
+
+// the firmware casts its handlers to uint32_t which does not fit a host pointer, HostHal.cpp knows the handlers
+// by name so the vector is dropped
+#define NVIC_SetVector(IRQn, vector)    host_nvic_set_vector(IRQn)
+
+void host_nvic_set_vector(IRQn_Type IRQn);
+void NVIC_SetPriorityGrouping(uint32_t PriorityGroup);
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority);
+uint32_t NVIC_GetPriority(IRQn_Type IRQn);
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+void NVIC_SetPendingIRQ(IRQn_Type IRQn);
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+void NVIC_SystemReset(void);
+
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t priMask);
+#define __DSB()     __sync_synchronize()
+#define __ISB()     __sync_synchronize()
+#define __DMB()     __sync_synchronize()
+#define __WFI()     do {} while(0)
+#define __NOP()     do {} while(0)
+
+#define WWDG_CR_T                   0x007FU
+#define WWDG_CR_WDGA                0x0080U
+
+typedef struct {
+    __IO uint32_t CR;
+    __IO uint32_t CFR;
+    __IO uint32_t SR;
+} WWDG_TypeDef;
+
+extern WWDG_TypeDef host_wwdg;
+#define WWDG    (&host_wwdg)
+
+#ifdef __cplusplus
+}
+
+// The flash interface, FlashStore.cpp is the only user. The sectors it keeps its records in are a file mapped at the
+// address they have on the chip, see HostFlash.cpp, an erase starts when STRT is set in CR as it does on the chip.
+#define FLASH_SR_BSY                0x00010000U
+#define FLASH_CR_PG                 0x00000001U
+#define FLASH_CR_SER                0x00000002U
+#define FLASH_CR_SNB_Pos            3U
+#define FLASH_CR_SNB                0x000000F8U
+#define FLASH_CR_PSIZE              0x00000300U
+#define FLASH_PSIZE_WORD            0x00000200U
+#define FLASH_CR_STRT               0x00010000U
+
+#define FLASH_FLAG_EOP              0x00000001U
+#define FLASH_FLAG_OPERR            0x00000002U
+#define FLASH_FLAG_WRPERR           0x00000010U
+#define FLASH_FLAG_PGAERR           0x00000020U
+#define FLASH_FLAG_PGPERR           0x00000040U
+#define FLASH_FLAG_PGSERR           0x00000080U
+
+#define FLASH_TYPEPROGRAM_WORD      2U
+
+void host_flash_erase(uint32_t sector);
+
+struct host_flash_cr {
+    uint32_t v;
+    operator uint32_t() const { return v; }
+    host_flash_cr& operator=(uint32_t n)
+    {
+        if((n & FLASH_CR_STRT) && (n & FLASH_CR_SER)) host_flash_erase((n & FLASH_CR_SNB) >> FLASH_CR_SNB_Pos);
+        v= n & ~FLASH_CR_STRT;
+        return *this;
+    }
+    host_flash_cr& operator|=(uint32_t n) { return *this= v | n; }
+    host_flash_cr& operator&=(uint32_t n) { return *this= v & n; }
+};
+
+typedef struct {
+    uint32_t ACR;
+    uint32_t KEYR;
+    uint32_t OPTKEYR;
+    uint32_t SR;
+    host_flash_cr CR;
+} FLASH_TypeDef;
+
+extern FLASH_TypeDef host_flash;
+#define FLASH   (&host_flash)
+
+typedef enum {
+    HAL_OK      = 0x00U,
+    HAL_ERROR   = 0x01U,
+    HAL_BUSY    = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+
+// there are no caches in front of the file
+#define __HAL_FLASH_CLEAR_FLAG(f)               do {} while(0)
+#define __HAL_FLASH_DATA_CACHE_DISABLE()        do {} while(0)
+#define __HAL_FLASH_DATA_CACHE_RESET()          do {} while(0)
+#define __HAL_FLASH_DATA_CACHE_ENABLE()         do {} while(0)
+#define __HAL_FLASH_INSTRUCTION_CACHE_DISABLE() do {} while(0)
+#define __HAL_FLASH_INSTRUCTION_CACHE_RESET()   do {} while(0)
+#define __HAL_FLASH_INSTRUCTION_CACHE_ENABLE()  do {} while(0)
+
+#endif
+
+#endif
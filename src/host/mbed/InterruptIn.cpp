@@ -0,0 +1,50 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// mbed's InterruptIn without the object pointer in the uint32_t id, pin interrupts never fire on the host
+
+#include "InterruptIn.h"
+
+namespace mbed {
+
+InterruptIn::InterruptIn(PinName pin)
+{
+    gpio_irq_init(&gpio_irq, pin, (&InterruptIn::_irq_handler), 0);
+    gpio_init(&gpio, pin, PIN_INPUT);
+}
+
+InterruptIn::~InterruptIn()
+{
+    gpio_irq_free(&gpio_irq);
+}
+
+int InterruptIn::read()
+{
+    return gpio_read(&gpio);
+}
+
+void InterruptIn::mode(PinMode pull)
+{
+    gpio_mode(&gpio, pull);
+}
+
+void InterruptIn::rise(void (*fptr)(void))
+{
+    if (fptr) _rise.attach(fptr);
+}
+
+void InterruptIn::fall(void (*fptr)(void))
+{
+    if (fptr) _fall.attach(fptr);
+}
+
+void InterruptIn::_irq_handler(uint32_t id, gpio_irq_event event)
+{
+}
+
+} // namespace mbed
@@ -0,0 +1,87 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// mbed's Serial with the object passed to the serial hal as an index, a host pointer does not fit its uint32_t id
+
+#include "Serial.h"
+#include "mbed_error.h"
+
+namespace mbed {
+
+static Serial *instances[8];
+
+static uint32_t instance_id(Serial *s)
+{
+    for (uint32_t i = 0; i < sizeof(instances) / sizeof(instances[0]); ++i) {
+        if(instances[i] == nullptr || instances[i] == s) {
+            instances[i]= s;
+            return i;
+        }
+    }
+    error("too many serial ports\n");
+    return 0;
+}
+
+Serial::Serial(PinName tx, PinName rx, PinName rts, PinName cts, const char *name) : Stream(name)
+{
+    serial_init(&_serial, tx, rx, rts, cts);
+    serial_irq_handler(&_serial, Serial::_irq_handler, instance_id(this));
+}
+
+void Serial::baud(int baudrate)
+{
+    serial_baud(&_serial, baudrate);
+}
+
+void Serial::format(int bits, Parity parity, int stop_bits)
+{
+    serial_format(&_serial, bits, (SerialParity)parity, stop_bits);
+}
+
+int Serial::readable()
+{
+    return serial_readable(&_serial);
+}
+
+int Serial::getrx()
+{
+    return serial_getc(&_serial);
+}
+
+int Serial::writeable()
+{
+    return serial_writable(&_serial);
+}
+
+void Serial::attach(void (*fptr)(void), IrqType type)
+{
+    if (fptr) {
+        _irq[type].attach(fptr);
+        serial_irq_set(&_serial, (SerialIrq)type, 1);
+    } else {
+        serial_irq_set(&_serial, (SerialIrq)type, 0);
+    }
+}
+
+void Serial::_irq_handler(uint32_t id, SerialIrq irq_type)
+{
+    instances[id]->_irq[irq_type].call();
+}
+
+int Serial::_getc()
+{
+    return serial_getc(&_serial);
+}
+
+int Serial::_putc(int c)
+{
+    serial_putc(&_serial, c);
+    return c;
+}
+
+} // namespace mbed
@@ -0,0 +1,137 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// mbed's Stream opens itself through the retargeted stdio of the newlib build, on the host the FILE is made with
+// fopencookie instead and ends up in the same read() and write()
+
+#include "Stream.h"
+
+#include <cstdarg>
+
+namespace mbed {
+
+static ssize_t cookie_read(void *cookie, char *buf, size_t size)
+{
+    return static_cast<FileHandle *>(cookie)->read(buf, size);
+}
+
+static ssize_t cookie_write(void *cookie, const char *buf, size_t size)
+{
+    return static_cast<FileHandle *>(cookie)->write(buf, size);
+}
+
+FileHandle::~FileHandle()
+{
+}
+
+Stream::Stream(const char *name) : FileLike(name)
+{
+    cookie_io_functions_t io= {cookie_read, cookie_write, nullptr, nullptr};
+    _file = fopencookie(static_cast<FileHandle *>(this), "w+", io);
+    setbuf(_file, NULL);
+}
+
+Stream::~Stream()
+{
+    fclose(_file);
+}
+
+int Stream::putc(int c)
+{
+    fflush(_file);
+    return std::fputc(c, _file);
+}
+
+int Stream::puts(const char *s)
+{
+    fflush(_file);
+    return std::fputs(s, _file);
+}
+
+int Stream::getc()
+{
+    fflush(_file);
+    return std::fgetc(_file);
+}
+
+char* Stream::gets(char *s, int size)
+{
+    fflush(_file);
+    return std::fgets(s, size, _file);
+}
+
+int Stream::close()
+{
+    return 0;
+}
+
+ssize_t Stream::write(const void* buffer, size_t length)
+{
+    const char* ptr = (const char*)buffer;
+    const char* end = ptr + length;
+    while (ptr != end) {
+        if (_putc(*ptr++) == EOF) {
+            break;
+        }
+    }
+    return ptr - (const char*)buffer;
+}
+
+ssize_t Stream::read(void* buffer, size_t length)
+{
+    char* ptr = (char*)buffer;
+    char* end = ptr + length;
+    while (ptr != end) {
+        int c = _getc();
+        if (c == EOF) break;
+        *ptr++ = c;
+    }
+    return ptr - (const char*)buffer;
+}
+
+off_t Stream::lseek(off_t offset, int whence)
+{
+    return 0;
+}
+
+int Stream::isatty()
+{
+    return 0;
+}
+
+int Stream::fsync()
+{
+    return 0;
+}
+
+off_t Stream::flen()
+{
+    return 0;
+}
+
+int Stream::printf(const char* format, ...)
+{
+    std::va_list arg;
+    va_start(arg, format);
+    fflush(_file);
+    int r = vfprintf(_file, format, arg);
+    va_end(arg);
+    return r;
+}
+
+int Stream::scanf(const char* format, ...)
+{
+    std::va_list arg;
+    va_start(arg, format);
+    fflush(_file);
+    int r = vfscanf(_file, format, arg);
+    va_end(arg);
+    return r;
+}
+
+} // namespace mbed
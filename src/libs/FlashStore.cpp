@@ -0,0 +1,327 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FlashStore.h"
+#include "Kernel.h"
+
+#include "stm32f4xx.h"
+
+#include <string.h>
+
+// sectors 10 and 11 of the STM32F407, the linker script keeps the firmware out of them
+#define FLASHSTORE_SECTOR_SIZE 0x20000
+#define FLASHSTORE_MAGIC       0x46535431 // "FST1"
+
+static const uint32_t sector_base[2]= {0x080C0000, 0x080E0000};
+static const uint32_t sector_number[2]= {10, 11};
+
+// sector layout is magic, sequence, then records
+// a record is a header word with the key in the low 16 bits, the number of data words in bits 16-22,
+// the numbered flag in bit 23 and a check byte in bits 24-31, followed by the data words.
+// The first data word of a numbered record is its number, see FlashStore::get(key, n, ...).
+#define RECORD_NWORDS(h)   (((h) >> 16) & 0x7F)
+#define RECORD_NUMBERED    (1 << 23)
+#define RECORD_KEY(h)      ((h) & 0xFFFF)
+
+// the store is addressed by its flash addresses, the host build maps a file there
+static inline const uint32_t *flash_words(uint32_t addr)
+{
+    return (const uint32_t *)(uintptr_t)addr;
+}
+
+static uint8_t record_check(uint32_t h, const uint32_t *data, size_t nwords)
+{
+    uint32_t c= 0x5A ^ (h & 0xFF) ^ ((h >> 8) & 0xFF) ^ ((h >> 16) & 0xFF);
+    for (size_t i = 0; i < nwords; ++i) {
+        uint32_t w= data[i];
+        c= ((c << 1) | (c >> 7)) & 0xFF; // rotate so swapped words do not cancel out
+        c ^= (w ^ (w >> 8) ^ (w >> 16) ^ (w >> 24)) & 0xFF;
+    }
+    return c;
+}
+
+#define FLASH_ERROR_FLAGS (FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+// Runs from RAM as the flash can not be read while a sector is being erased.
+// The erase takes around a second which is much longer than the window watchdog timeout, so it is kicked from here.
+// Interrupts have to be off, any handler would stall on its first flash fetch and the watchdog would not be kicked.
+// Returns the error flags the erase left.
+// long_call as RAM is out of reach of a branch from flash, the host build runs it where it is
+#ifndef HOST_BUILD
+#define FLASHSTORE_RAMFUNC __attribute__((section(".data.ramfunc"), noinline, long_call))
+#else
+#define FLASHSTORE_RAMFUNC __attribute__((noinline))
+#endif
+FLASHSTORE_RAMFUNC static uint32_t erase_sector_from_ram(uint32_t sector)
+{
+    while(FLASH->SR & FLASH_SR_BSY) ;
+    FLASH->CR &= ~(FLASH_CR_PSIZE | FLASH_CR_SNB);
+    FLASH->CR |= FLASH_PSIZE_WORD | FLASH_CR_SER | (sector << FLASH_CR_SNB_Pos);
+    FLASH->CR |= FLASH_CR_STRT;
+    while(FLASH->SR & FLASH_SR_BSY) {
+        if(WWDG->CR & WWDG_CR_WDGA) WWDG->CR= WWDG_CR_T;
+    }
+    FLASH->CR &= ~(FLASH_CR_SER | FLASH_CR_SNB);
+    return FLASH->SR & FLASH_ERROR_FLAGS;
+}
+
+static void flush_caches()
+{
+    // the ART accelerator may still hold the old contents
+    __HAL_FLASH_DATA_CACHE_DISABLE();
+    __HAL_FLASH_DATA_CACHE_RESET();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
+}
+
+FlashStore::FlashStore()
+{
+    write_addr= 0;
+    sequence= 0;
+    active= 0;
+    mounted= false;
+    clear_pending= false;
+    spare_erased= false;
+    mount();
+
+    // the kernel creates it before any serial console so this erase does not lose received characters
+    uint8_t spare= mounted ? active ^ 1 : 0;
+    spare_erased= is_blank(spare) || erase_sector(spare);
+}
+
+// find the active sector and index the newest record of each key
+void FlashStore::mount()
+{
+    int best= -1;
+    for (int s = 0; s < 2; ++s) {
+        const uint32_t *p= flash_words(sector_base[s]);
+        if(p[0] != FLASHSTORE_MAGIC) continue;
+        if(best < 0 || (int32_t)(p[1] - sequence) > 0) {
+            best= s;
+            sequence= p[1];
+        }
+    }
+
+    // nothing is formatted, the first write will do it
+    if(best < 0) return;
+
+    active= best;
+    mounted= true;
+
+    uint32_t addr= sector_base[active] + 8;
+    uint32_t end= sector_base[active] + FLASHSTORE_SECTOR_SIZE;
+    while(addr + 4 <= end) {
+        const uint32_t *rec= flash_words(addr);
+        uint32_t h= rec[0];
+        if(h == 0xFFFFFFFF) break; // end of the written area
+
+        size_t n= RECORD_NWORDS(h);
+        if(addr + (n + 1) * 4 > end) break;
+
+        // a record torn by a reset is skipped
+        if((h >> 24) == record_check(h, rec + 1, n)) {
+            if(!(h & RECORD_NUMBERED)) {
+                index[RECORD_KEY(h)]= addr;
+            } else if(n > 0 && rec[1] < 0xFFFF) {
+                index[RECORD_KEY(h) | ((rec[1] + 1) << 16)]= addr;
+            }
+        }
+        addr += (n + 1) * 4;
+    }
+    write_addr= addr;
+}
+
+bool FlashStore::get_value(uint32_t key, void *data, size_t size) const
+{
+    // numbered values have their number in front
+    size_t skip= (key >> 16) ? 1 : 0;
+    size_t nwords= (size + 3) / 4 + skip;
+
+    // return values not written yet so a get after a put is consistent
+    auto p= pending.find(key);
+    if(p != pending.end()) {
+        if(p->second.size() != nwords) return false;
+        memcpy(data, p->second.data() + skip, size);
+        return true;
+    }
+
+    if(clear_pending) return false;
+
+    auto i= index.find(key);
+    if(i == index.end()) return false;
+
+    const uint32_t *rec= flash_words(i->second);
+    if(RECORD_NWORDS(rec[0]) != nwords) return false; // layout changed since it was saved
+    memcpy(data, rec + 1 + skip, size);
+    return true;
+}
+
+bool FlashStore::put_value(uint32_t key, const void *data, size_t size)
+{
+    if(size == 0 || size > FLASHSTORE_MAX_SIZE) return false;
+
+    size_t skip= (key >> 16) ? 1 : 0;
+    std::vector<uint32_t> v((size + 3) / 4 + skip, 0);
+    if(skip) v[0]= (key >> 16) - 1;
+    memcpy(v.data() + skip, data, size);
+
+    // do not wear the flash if it already holds this value
+    auto i= index.find(key);
+    if(!clear_pending && i != index.end()) {
+        const uint32_t *rec= flash_words(i->second);
+        if(RECORD_NWORDS(rec[0]) == v.size() && memcmp(rec + 1, v.data(), v.size() * 4) == 0) {
+            pending.erase(key);
+            return true;
+        }
+    }
+
+    pending[key]= std::move(v);
+    return true;
+}
+
+// forget all the stored values, done on the next idle
+void FlashStore::clear()
+{
+    pending.clear();
+    clear_pending= true;
+}
+
+bool FlashStore::is_blank(uint8_t s) const
+{
+    const uint32_t *p= flash_words(sector_base[s]);
+    for (size_t i = 0; i < FLASHSTORE_SECTOR_SIZE / 4; ++i) {
+        if(p[i] != 0xFFFFFFFF) return false;
+    }
+    return true;
+}
+
+size_t FlashStore::get_used() const
+{
+    return mounted ? write_addr - sector_base[active] : 0;
+}
+
+size_t FlashStore::get_size() const
+{
+    return FLASHSTORE_SECTOR_SIZE;
+}
+
+// Program the values put() and any clear() since the last flush.
+// Programming stalls any code running from flash, the caller makes sure nothing is moving.
+// Returns false if any of it could not be written, what was not written is dropped.
+bool FlashStore::flush()
+{
+    bool ok= true;
+    if(clear_pending) {
+        clear_pending= false;
+        index.clear();
+        ok= compact();
+    }
+
+    while(ok && !pending.empty()) {
+        auto i= pending.begin();
+        // the sector is full or not formatted yet, move the live records to the other sector
+        if(!mounted || !has_room(i->second.size())) {
+            ok= compact() && has_room(i->second.size());
+            if(!ok) break;
+        }
+        ok= write_record(i->first, i->second.data(), i->second.size());
+        pending.erase(i);
+    }
+
+    pending.clear();
+    return ok;
+}
+
+bool FlashStore::has_room(size_t nwords) const
+{
+    return write_addr + (nwords + 1) * 4 <= sector_base[active] + FLASHSTORE_SECTOR_SIZE;
+}
+
+// the caller checks there is room for it
+bool FlashStore::write_record(uint32_t key, const uint32_t *data, size_t nwords)
+{
+    uint32_t addr= write_addr;
+    uint32_t h= (key & 0xFFFF) | (nwords << 16) | ((key >> 16) ? RECORD_NUMBERED : 0);
+    h |= record_check(h, data, nwords) << 24;
+
+    // header goes first so a torn record still tells us how long it is
+    HAL_FLASH_Unlock();
+    bool ok= HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, h) == HAL_OK;
+    for (size_t i = 0; ok && i < nwords; ++i) {
+        ok= HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + 4 + i * 4, data[i]) == HAL_OK;
+    }
+    HAL_FLASH_Lock();
+    flush_caches();
+
+    // the space is used even if it failed, the check byte makes mount skip it
+    write_addr += (nwords + 1) * 4;
+
+    if(ok) index[key]= addr;
+    return ok;
+}
+
+bool FlashStore::erase_sector(uint8_t s)
+{
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_ERROR_FLAGS);
+    uint32_t primask= __get_PRIMASK();
+    __disable_irq();
+    uint32_t errors= erase_sector_from_ram(sector_number[s]);
+    __set_PRIMASK(primask);
+    HAL_FLASH_Lock();
+    flush_caches();
+    __HAL_FLASH_INSTRUCTION_CACHE_RESET();
+    return errors == 0;
+}
+
+// Copy the live records into the other sector and make it the active one.
+// The magic is written last so a reset part way through leaves the old sector active.
+// The other sector is normally still erased from boot, erasing it here only happens on the second compaction since
+// boot, with interrupts off for the whole erase while M500 waits for it.
+bool FlashStore::compact()
+{
+    uint8_t target= mounted ? active ^ 1 : 0;
+    uint32_t base= sector_base[target];
+
+    if(!spare_erased && !erase_sector(target)) return false;
+    // the sector given up is erased at the next boot
+    spare_erased= false;
+
+    HAL_FLASH_Unlock();
+    bool ok= HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, base + 4, sequence + 1) == HAL_OK;
+    HAL_FLASH_Lock();
+    if(!ok) {
+        mounted= false;
+        index.clear();
+        return false;
+    }
+
+    std::map<uint32_t, uint32_t> old_index;
+    old_index.swap(index);
+    active= target;
+    write_addr= base + 8;
+    mounted= true;
+
+    for(auto &i : old_index) {
+        if(pending.count(i.first)) continue; // about to be replaced anyway
+        const uint32_t *rec= flash_words(i.second);
+        if(!write_record(i.first, rec + 1, RECORD_NWORDS(rec[0]))) ok= false;
+    }
+
+    HAL_FLASH_Unlock();
+    ok= ok && HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, base, FLASHSTORE_MAGIC) == HAL_OK;
+    HAL_FLASH_Lock();
+    flush_caches();
+
+    if(!ok) {
+        mounted= false;
+        index.clear();
+        return false;
+    }
+
+    sequence++;
+    return true;
+}
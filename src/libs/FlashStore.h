@@ -0,0 +1,69 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Module.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <vector>
+
+// Key/value store for settings saved with M500, kept in the last two sectors of the internal flash.
+// Records are appended to the active sector and the newest record for a key wins, when the sector is full
+// the live records are copied to the other sector which then becomes the active one, this spreads the wear.
+// Keys are CHECKSUM()s, values are binary blobs of up to FLASHSTORE_MAX_SIZE bytes.
+// A value too big for one record is split over the numbered records of one key, see get(key, n, ...), rather than
+// over key+n which would be another CHECKSUM() as likely as not.
+// put() only queues the value, flush() programs them, M500 calls it once motion has stopped.
+// The spare sector is erased at boot, before the serial consoles take input, so compacting at run time only programs it.
+#define FLASHSTORE_MAX_SIZE 256
+
+class FlashStore : public Module {
+    public:
+        FlashStore();
+
+        bool get(uint16_t key, void *data, size_t size) const { return get_value(key, data, size); }
+        bool put(uint16_t key, const void *data, size_t size) { return put_value(key, data, size); }
+        // record n of a key split over several records
+        bool get(uint16_t key, uint16_t n, void *data, size_t size) const { return get_value(numbered_key(key, n), data, size); }
+        bool put(uint16_t key, uint16_t n, const void *data, size_t size) { return put_value(numbered_key(key, n), data, size); }
+        void clear();
+        bool flush();
+
+        bool is_pending() const { return !pending.empty() || clear_pending; }
+        size_t get_count() const { return index.size(); }
+        size_t get_used() const;
+        size_t get_size() const;
+
+    private:
+        // the number goes in the top half, offset by one so record 0 does not alias the plain key
+        static uint32_t numbered_key(uint16_t key, uint16_t n) { return key | ((uint32_t)(n + 1) << 16); }
+        bool get_value(uint32_t key, void *data, size_t size) const;
+        bool put_value(uint32_t key, const void *data, size_t size);
+        void mount();
+        bool compact();
+        bool has_room(size_t nwords) const;
+        bool write_record(uint32_t key, const uint32_t *data, size_t nwords);
+        bool erase_sector(uint8_t s);
+        bool is_blank(uint8_t s) const;
+
+        // key -> flash address of the newest record for that key
+        std::map<uint32_t, uint32_t> index;
+        // values waiting to be written, numbered ones start with their number word
+        std::map<uint32_t, std::vector<uint32_t>> pending;
+
+        uint32_t write_addr;
+        uint32_t sequence;
+        uint8_t active;
+        struct {
+            bool mounted:1;
+            bool clear_pending:1;
+            bool spare_erased:1;    // the sector compact() writes to next is erased
+        };
+};
@@ -0,0 +1,139 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FlightRecorder.h"
+#include "Kernel.h"
+#include "Conveyor.h"
+#include "Block.h"
+#include "Gcode.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "StreamOutput.h"
+#include "MemoryPool.h"
+#include "platform_memory.h"
+#include "stm32f4xx.h"
+
+#define flight_recorder_checksum            CHECKSUM("flight_recorder")
+#define enable_checksum                     CHECKSUM("enable")
+#define size_checksum                       CHECKSUM("size")
+
+static const char *event_names[]= {"start", "end", "halt", "endstop", "rx", "freeze"};
+
+FlightRecorder::FlightRecorder()
+{
+    records= nullptr;
+    size= 0;
+    head= 0;
+    count= 0;
+    block_seq= 0;
+    frozen= false;
+}
+
+void FlightRecorder::on_module_loaded()
+{
+    // the kernel keeps a pointer to it so it stays loaded, with no records nothing is recorded
+    if(!THEKERNEL->config->value(flight_recorder_checksum, enable_checksum)->by_default(false)->as_bool()) return;
+
+    size= THEKERNEL->config->value(flight_recorder_checksum, size_checksum)->by_default(128)->as_number();
+    if(size == 0) return;
+    records= (record_t *)AHB0.alloc(sizeof(record_t) * size);
+    if(records == nullptr) {
+        size= 0;
+        return;
+    }
+
+    // the cycle counter runs from the core clock
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT= 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    register_for_event(ON_GCODE_RECEIVED);
+    register_for_event(ON_HALT);
+}
+
+void FlightRecorder::on_halt(void *argument)
+{
+    if(argument == nullptr) {
+        record(HALT, 0);
+        // keep what led up to it
+        frozen= true;
+    }
+}
+
+void FlightRecorder::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+
+    if(gcode->has_m && gcode->m == 831) {
+        // M831 freezes it, M831 S0 starts recording again
+        freeze(!gcode->has_letter('S') || gcode->get_value('S') != 0);
+    }
+}
+
+void FlightRecorder::freeze(bool flag)
+{
+    if(flag) record(FREEZE, 0);
+    frozen= flag;
+}
+
+void FlightRecorder::block_started(const Block *block)
+{
+    if(records == nullptr) return;
+    record(BLOCK_START, ++block_seq, block->total_move_ticks, block->entry_speed, block->exit_speed);
+}
+
+void FlightRecorder::block_finished(const Block *block, uint32_t ticks)
+{
+    if(records == nullptr) return;
+    record(BLOCK_END, block_seq, ticks, block->entry_speed, block->exit_speed);
+}
+
+void FlightRecorder::write(EVENT event, uint16_t id, uint32_t ticks, float entry_speed, float exit_speed)
+{
+    // a higher priority interrupt may record as well
+    uint32_t primask= __get_PRIMASK();
+    __disable_irq();
+    record_t& r= records[head];
+    r.cycles= DWT->CYCCNT;
+    r.ticks= ticks;
+    r.entry_speed= entry_speed;
+    r.exit_speed= exit_speed;
+    r.id= id;
+    r.event= event;
+    r.depth= THECONVEYOR->get_queue_count();
+    if(++head == size) head= 0;
+    if(count < size) ++count;
+    __set_PRIMASK(primask);
+}
+
+// the last n records oldest first, the time is from the record before, the cycle counter wraps every 25 seconds
+void FlightRecorder::dump(StreamOutput *stream, size_t n) const
+{
+    if(records == nullptr) {
+        stream->printf("flight recorder is not enabled\n");
+        return;
+    }
+
+    // a copy so recording can go on while it prints
+    uint16_t c= count;
+    uint16_t h= head;
+    if(n == 0 || n > c) n= c;
+
+    stream->printf("%u of %u records%s\n", (unsigned)n, c, frozen ? ", frozen" : "");
+    stream->printf("     cycles         +us event      id  q   entry    exit    ticks\n");
+
+    float cycles_per_us= SystemCoreClock / 1000000.0F;
+    uint32_t last= 0;
+    for (size_t i = 0; i < n; ++i) {
+        const record_t& r= records[(h + size - n + i) % size];
+        float dt= i == 0 ? 0 : (uint32_t)(r.cycles - last) / cycles_per_us;
+        last= r.cycles;
+        const char *name= r.event < sizeof(event_names) / sizeof(event_names[0]) ? event_names[r.event] : "?";
+        stream->printf("%11lu %11.1f %-7s %5u %2u %7.2f %7.2f %8lu\n", (unsigned long)r.cycles, dt, name, r.id, r.depth, r.entry_speed, r.exit_speed, (unsigned long)r.ticks);
+    }
+}
@@ -0,0 +1,71 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Module.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Block;
+class StreamOutput;
+
+// Ring buffer of the last motion events, so what the planner and the step ticker did before a stall or a halt can be
+// looked at after the fact. Blocks starting and finishing, halts, endstops and received lines are recorded with the
+// DWT cycle counter, from whatever interrupt they happen in, a record is a few stores with interrupts masked.
+// It freezes on a halt or with M831 so the events that follow do not push out the ones of interest, M831 S0
+// starts it again, the recorder shell command dumps it.
+class FlightRecorder : public Module {
+    public:
+        enum EVENT : uint8_t {
+            BLOCK_START,    // ticks is the planned ticks of the block
+            BLOCK_END,      // ticks is the ticks it ran for
+            HALT,
+            ENDSTOP,        // id is the axis, ticks the step position of its motor
+            RECEIVE,        // a line was received, id is the characters buffered
+            FREEZE
+        };
+
+        FlightRecorder();
+
+        void on_module_loaded();
+        void on_gcode_received(void *argument);
+        void on_halt(void *argument);
+
+        // may be called from any interrupt
+        void record(EVENT event, uint16_t id, uint32_t ticks= 0, float entry_speed= 0, float exit_speed= 0)
+        {
+            if(records != nullptr && !frozen) write(event, id, ticks, entry_speed, exit_speed);
+        }
+        // called from the step ticker ISR
+        void block_started(const Block *block);
+        void block_finished(const Block *block, uint32_t ticks);
+
+        void freeze(bool flag);
+        void dump(StreamOutput *stream, size_t n) const;
+
+    private:
+        void write(EVENT event, uint16_t id, uint32_t ticks, float entry_speed, float exit_speed);
+
+        struct record_t {
+            uint32_t cycles;        // DWT cycle counter
+            uint32_t ticks;
+            float entry_speed;      // mm/sec, of the block
+            float exit_speed;
+            uint16_t id;            // the block sequence number for block events
+            uint8_t event;
+            uint8_t depth;          // blocks in the queue
+        };
+
+        record_t *records;
+        uint16_t size;
+        uint16_t head;              // the next record written
+        uint16_t count;
+        uint16_t block_seq;
+        volatile bool frozen;
+};
@@ -0,0 +1,354 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Format.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static const uint32_t pow10[10]= {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+// writes the digits of v backwards ending at end, returns where they start
+static char *utoa_rev(char *end, unsigned long long v, unsigned base, bool upper)
+{
+    const char *digits= upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    // 64 bit division is a library call, so only use it while the value needs it
+    while(v > 0xFFFFFFFFULL) {
+        *--end= digits[v % base];
+        v /= base;
+    }
+    uint32_t w= v;
+    do {
+        *--end= digits[w % base];
+        w /= base;
+    } while(w != 0);
+    return end;
+}
+
+size_t format_fixed(char *buf, double value, uint8_t decimals)
+{
+    if(decimals > 9) decimals= 9;
+
+    if(isnan(value)) {
+        strcpy(buf, "nan");
+        return 3;
+    }
+
+    char *p= buf;
+    if(signbit(value)) {
+        *p++= '-';
+        value= -value;
+    }
+
+    // for a float value the product is exact, so this rounds exactly like printf, ties to even
+    double scaled= value * pow10[decimals];
+    if(isinf(value) || scaled >= 1.8e19) {
+        // too big for the integer path
+        int n= snprintf(p, FORMAT_FIXED_MAX - (p - buf), "%.*f", decimals, value);
+        if(n < 0) n= 0;
+        return (p - buf) + std::min<size_t>(n, FORMAT_FIXED_MAX - 1 - (p - buf));
+    }
+
+    unsigned long long v= scaled;
+    double rest= scaled - v;
+    if(rest == 0.5) {
+        // a double value can land on a tie by rounding, the error of the product says which way it really goes
+        double e= fma(value, pow10[decimals], -scaled);
+        if(e > 0 || (e == 0 && (v & 1))) ++v;
+    } else if(rest > 0.5) {
+        ++v;
+    }
+    uint32_t fraction;
+    unsigned long long integer;
+    if(v <= 0xFFFFFFFFULL) {
+        uint32_t v32= v;
+        integer= v32 / pow10[decimals];
+        fraction= v32 - integer * pow10[decimals];
+    } else {
+        integer= v / pow10[decimals];
+        fraction= v - integer * pow10[decimals];
+    }
+
+    char tmp[24];
+    char *end= tmp + sizeof(tmp);
+    char *s= utoa_rev(end, integer, 10, false);
+    memcpy(p, s, end - s);
+    p += end - s;
+
+    if(decimals > 0) {
+        *p++= '.';
+        for (int i = decimals - 1; i >= 0; --i) {
+            p[i]= '0' + fraction % 10;
+            fraction /= 10;
+        }
+        p += decimals;
+    }
+
+    *p= '\0';
+    return p - buf;
+}
+
+void append_fixed(std::string &str, double value, uint8_t decimals)
+{
+    char buf[FORMAT_FIXED_MAX];
+    size_t n= format_fixed(buf, value, decimals);
+    str.append(buf, n);
+}
+
+namespace {
+    // collects the output in the chunk and hands it on whenever it fills
+    struct Writer {
+        char *chunk;
+        size_t size;
+        size_t n;
+        int total;
+        format_flush_t flush;
+        void *ctx;
+
+        void put(char c)
+        {
+            if(n + 1 >= size) drain();
+            chunk[n++]= c;
+            ++total;
+        }
+
+        void write(const char *s, size_t len)
+        {
+            while(len-- > 0) put(*s++);
+        }
+
+        void pad(char c, int count)
+        {
+            while(count-- > 0) put(c);
+        }
+
+        void drain()
+        {
+            if(n == 0) return;
+            chunk[n]= '\0';
+            flush(ctx, chunk);
+            n= 0;
+        }
+    };
+
+    // outputs prefix (sign, 0x), leading zeros and body padded to width
+    void emit(Writer &w, const char *prefix, size_t plen, const char *body, size_t blen, int zeros, int width, bool left, bool zero_pad)
+    {
+        int pad= width - (int)(plen + zeros + blen);
+        if(!left && !zero_pad) w.pad(' ', pad);
+        w.write(prefix, plen);
+        if(!left && zero_pad) w.pad('0', pad);
+        w.pad('0', zeros);
+        w.write(body, blen);
+        if(left) w.pad(' ', pad);
+    }
+
+    void emit_integer(Writer &w, char sign, unsigned long long u, unsigned base, bool upper, bool alt, int prec, int width, bool left, bool zero)
+    {
+        char tmp[24];
+        char *end= tmp + sizeof(tmp);
+        // a zero value with zero precision prints nothing
+        char *s= (u == 0 && prec == 0) ? end : utoa_rev(end, u, base, upper);
+        size_t blen= end - s;
+        int zeros= prec > (int)blen ? prec - blen : 0;
+
+        char prefix[3];
+        size_t plen= 0;
+        if(sign) prefix[plen++]= sign;
+        if(alt && base == 16 && u != 0) {
+            prefix[plen++]= '0';
+            prefix[plen++]= upper ? 'X' : 'x';
+        }
+        if(alt && base == 8 && zeros == 0 && (blen == 0 || *s != '0')) zeros= 1;
+
+        // the 0 flag is ignored when a precision is given
+        emit(w, prefix, plen, s, blen, zeros, width, left, zero && prec < 0);
+    }
+}
+
+int vformat(char *chunk, size_t size, format_flush_t flush, void *ctx, const char *format, va_list args)
+{
+    if(size < 2) return 0;
+
+    Writer w{chunk, size, 0, 0, flush, ctx};
+
+    for (const char *f = format; *f != '\0'; ++f) {
+        if(*f != '%') {
+            w.put(*f);
+            continue;
+        }
+
+        const char *spec= f++;
+
+        bool left= false, plus= false, space= false, alt= false, zero= false;
+        for (;; ++f) {
+            if(*f == '-') left= true;
+            else if(*f == '+') plus= true;
+            else if(*f == ' ') space= true;
+            else if(*f == '#') alt= true;
+            else if(*f == '0') zero= true;
+            else break;
+        }
+
+        int width= 0;
+        if(*f == '*') {
+            width= va_arg(args, int);
+            if(width < 0) {
+                left= true;
+                width= -width;
+            }
+            ++f;
+        } else {
+            while(*f >= '0' && *f <= '9') width= width * 10 + (*f++ - '0');
+        }
+
+        int prec= -1;
+        if(*f == '.') {
+            ++f;
+            if(*f == '*') {
+                prec= va_arg(args, int);
+                if(prec < 0) prec= -1;
+                ++f;
+            } else {
+                prec= 0;
+                while(*f >= '0' && *f <= '9') prec= prec * 10 + (*f++ - '0');
+            }
+        }
+
+        // -2 char, -1 short, 0 int, 1 long, 2 long long, 3 size_t, 4 long double
+        int len= 0;
+        for (;; ++f) {
+            if(*f == 'h') len= (len == -1) ? -2 : -1;
+            else if(*f == 'l') len= (len == 1) ? 2 : 1;
+            else if(*f == 'z' || *f == 't') len= 3;
+            else if(*f == 'j') len= 2;
+            else if(*f == 'L') len= 4;
+            else break;
+        }
+
+        char conv= *f;
+        if(conv == '\0') break;
+
+        switch(conv) {
+            case 'd':
+            case 'i': {
+                long long v;
+                if(len == 2) v= va_arg(args, long long);
+                else if(len == 1) v= va_arg(args, long);
+                else if(len == 3) v= va_arg(args, ptrdiff_t);
+                else {
+                    v= va_arg(args, int);
+                    if(len == -1) v= (short)v;
+                    else if(len == -2) v= (signed char)v;
+                }
+                char sign= v < 0 ? '-' : plus ? '+' : space ? ' ' : 0;
+                unsigned long long u= v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+                emit_integer(w, sign, u, 10, false, false, prec, width, left, zero);
+                break;
+            }
+
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o': {
+                unsigned long long u;
+                if(len == 2) u= va_arg(args, unsigned long long);
+                else if(len == 1) u= va_arg(args, unsigned long);
+                else if(len == 3) u= va_arg(args, size_t);
+                else {
+                    u= va_arg(args, unsigned int);
+                    if(len == -1) u= (unsigned short)u;
+                    else if(len == -2) u= (unsigned char)u;
+                }
+                unsigned base= conv == 'o' ? 8 : conv == 'u' ? 10 : 16;
+                emit_integer(w, 0, u, base, conv == 'X', alt, prec, width, left, zero);
+                break;
+            }
+
+            case 'p': {
+                uintptr_t u= (uintptr_t)va_arg(args, void*);
+                char tmp[24];
+                char *end= tmp + sizeof(tmp);
+                char *s= utoa_rev(end, u, 16, false);
+                emit(w, "0x", 2, s, end - s, 0, width, left, false);
+                break;
+            }
+
+            case 'c': {
+                char c= va_arg(args, int);
+                emit(w, "", 0, &c, 1, 0, width, left, false);
+                break;
+            }
+
+            case 's': {
+                const char *s= va_arg(args, const char*);
+                if(s == nullptr) s= "(null)";
+                size_t slen= prec >= 0 ? strnlen(s, prec) : strlen(s);
+                emit(w, "", 0, s, slen, 0, width, left, false);
+                break;
+            }
+
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A': {
+                double v= len == 4 ? (double)va_arg(args, long double) : va_arg(args, double);
+
+                if((conv == 'f' || conv == 'F') && !alt && prec <= 9 && isfinite(v) && fabs(v) < 1e9) {
+                    char body[FORMAT_FIXED_MAX];
+                    size_t blen= format_fixed(body, fabs(v), prec < 0 ? 6 : prec);
+                    char sign= signbit(v) ? '-' : plus ? '+' : space ? ' ' : 0;
+                    emit(w, &sign, sign ? 1 : 0, body, blen, 0, width, left, zero);
+                    break;
+                }
+
+                // let newlib do this one conversion, * widths have already been resolved
+                char fs[24];
+                char *p= fs;
+                *p++= '%';
+                if(left) *p++= '-';
+                if(plus) *p++= '+';
+                if(space) *p++= ' ';
+                if(alt) *p++= '#';
+                if(zero) *p++= '0';
+                p += snprintf(p, fs + sizeof(fs) - p, "%d", width);
+                if(prec >= 0) p += snprintf(p, fs + sizeof(fs) - p, ".%d", prec);
+                *p++= conv;
+                *p= '\0';
+
+                char out[64];
+                int n= snprintf(out, sizeof(out), fs, v);
+                if(n < 0) n= 0;
+                if(n >= (int)sizeof(out)) n= sizeof(out) - 1;
+                w.write(out, n);
+                break;
+            }
+
+            case 'n':
+                *va_arg(args, int*)= w.total;
+                break;
+
+            case '%':
+                w.put('%');
+                break;
+
+            default:
+                // not something we know, output it as it is
+                w.write(spec, f - spec + 1);
+                break;
+        }
+    }
+
+    w.drain();
+    return w.total;
+}
@@ -0,0 +1,29 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string>
+
+// Allocation free formatting for the console output and position reports.
+
+// longest output of format_fixed() including the terminating \0
+#define FORMAT_FIXED_MAX 24
+
+// formats value with a fixed number of decimals (up to 9) like %1.4f does, but with integer maths instead of newlib's
+// float formatting, buf must have room for FORMAT_FIXED_MAX chars, returns the length
+size_t format_fixed(char *buf, double value, uint8_t decimals);
+void append_fixed(std::string &str, double value, uint8_t decimals);
+
+// printf style formatting into chunk, whenever it fills it is \0 terminated and passed to flush() so the output can be
+// any length without allocating. %f uses format_fixed(), only %e %g and %a go through newlib, one conversion at a time.
+// returns the number of characters output
+using format_flush_t= void (*)(void *ctx, const char *s);
+int vformat(char *chunk, size_t size, format_flush_t flush, void *ctx, const char *format, va_list args);
@@ -5,4 +5,12 @@ extern "C"{
 
 // Hook is just a glorified FPointer
 
-Hook::Hook(){}
+Hook::Hook()
+{
+    interval= 0;
+    deadline= 0;
+    periodic= false;
+    in_main_loop= false;
+    queued= false;
+    pending= false;
+}
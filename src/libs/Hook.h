@@ -3,12 +3,18 @@
 #include "libs/FPointer.h"
 
 // Hook is just a glorified FPointer
+// the timing fields are owned by SlowTicker, times are in SlowTicker ticks (us)
 
 class Hook : public FPointer {
     public:
         Hook();
-        int     interval;
-        int     countdown;
+        uint32_t interval;          // period for a periodic hook
+        uint32_t deadline;          // when it is next due
+        bool periodic;
+        bool in_main_loop;          // called from on_idle instead of the timer interrupt
+        // not bitfields as the timer interrupt and the main loop both write them
+        volatile bool queued;       // in the timer heap
+        volatile bool pending;      // due and waiting for the main loop
 };
 
 #endif
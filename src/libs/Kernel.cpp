@@ -21,7 +21,11 @@
 #include "ConfigValue.h"
 
 #include "libs/StepTicker.h"
+#include "libs/FlashStore.h"
+#include "libs/FlightRecorder.h"
+#include "libs/LatencyStats.h"
 #include "libs/PublicData.h"
+#include "libs/Format.h"
 #include "modules/communication/SerialConsole.h"
 #include "modules/communication/GcodeDispatch.h"
 #include "modules/robot/Planner.h"
@@ -40,6 +44,8 @@
 
 #include "platform_memory.h"
 
+#include "mbed.h" // for us_ticker_read()
+
 #include <malloc.h>
 #include <array>
 #include <string>
@@ -55,6 +61,7 @@
 #define grbl_mode_checksum                          CHECKSUM("grbl_mode")
 #define feed_hold_enable_checksum                   CHECKSUM("enable_feed_hold")
 #define ok_per_line_checksum                        CHECKSUM("ok_per_line")
+#define decelerate_on_halt_checksum                 CHECKSUM("decelerate_on_halt")
 Kernel* Kernel::instance;
 
 // The kernel is the central point in Smoothie : it stores modules, and handles event calls
@@ -63,9 +70,20 @@ Kernel::Kernel()
     halted = false;
     feed_hold = false;
     enable_feed_hold = false;
+    halt_position_kept = false;
+    decelerate_on_halt = false;
+    halt_pending = false;
+    halt_start_us = 0;
 
     instance = this; // setup the Singleton instance of the kernel
 
+    // the serial and step interrupts record to it from the start, it records nothing until it is loaded
+    this->flight_recorder = new FlightRecorder();
+    this->latency_stats = new LatencyStats();
+
+    // settings saved with M500, before the serial consoles as it may erase its spare sector with interrupts off
+    this->flash_store = new FlashStore();
+
     // serial first at fixed baud rate (DEFAULT_SERIAL_BAUD_RATE) so config can report errors to serial
     // Set to UART0, this will be changed to use the same UART as MRI if it's enabled
     //this->serial = new SerialConsole(PD_5, PD_6, NC, NC, DEFAULT_SERIAL_BAUD_RATE);
@@ -132,6 +150,9 @@ Kernel::Kernel()
 
     this->enable_feed_hold = this->config->value( feed_hold_enable_checksum )->by_default(this->grbl_mode)->as_bool();
 
+    // ^X ramps the motion down before halting instead of stopping dead
+    this->decelerate_on_halt = this->config->value( decelerate_on_halt_checksum )->by_default(false)->as_bool();
+
     // we expect ok per line now not per G code, setting this to false will return to the old (incorrect) way of ok per G code
     this->ok_per_line = this->config->value( ok_per_line_checksum )->by_default(true)->as_bool();
 
@@ -142,7 +163,8 @@ Kernel::Kernel()
     // HAL stuff
     add_module( this->slow_ticker = new SlowTicker());
 
-    this->step_ticker = new StepTicker();
+    // the step ticker state is used in the step interrupts so put it in CCM
+    this->step_ticker = new(CCM) StepTicker();
     this->adc = new Adc();
 
     // TODO : These should go into platform-specific files
@@ -180,22 +202,41 @@ Kernel::Kernel()
     this->step_ticker->set_frequency( this->base_stepping_frequency );
     this->step_ticker->set_unstep_time( microseconds_per_step_pulse );
 
+    // settings saved with M500, needs to be mounted before the modules that restore from it
+    this->add_module( this->flash_store );
+
     // Core modules
     this->add_module( this->conveyor       = new Conveyor()      );
     this->add_module( this->gcode_dispatch = new GcodeDispatch() );
     this->add_module( this->robot          = new Robot()         );
     this->add_module( this->simpleshell    = new SimpleShell()   );
 
+    // looks at the conveyor when it records
+    this->add_module( this->flight_recorder );
+    this->add_module( this->latency_stats );
+
     this->planner = new Planner();
     this->configurator = new Configurator();
 }
 
+// appends label followed by x,y,z
+static void append_xyz(std::string& str, const char *label, float x, float y, float z, uint8_t decimals)
+{
+    str.append(label);
+    append_fixed(str, x, decimals);
+    str.append(1, ',');
+    append_fixed(str, y, decimals);
+    str.append(1, ',');
+    append_fixed(str, z, decimals);
+}
+
 // return a GRBL-like query string for serial ?
 std::string Kernel::get_query_string()
 {
     std::string str;
+    static PublicData::Handle<bool> homing_status(endstops_checksum, get_homing_status_checksum);
     bool homing;
-    bool ok = PublicData::get_value(endstops_checksum, get_homing_status_checksum, 0, &homing);
+    bool ok = homing_status.request(&homing);
     if(!ok) homing = false;
     bool running = false;
 
@@ -206,7 +247,9 @@ std::string Kernel::get_query_string()
         running = true;
         str.append("Home");
     } else if(feed_hold) {
-        str.append("Hold");
+        // as grbl, Hold:1 while still decelerating, Hold:0 once stopped and ready to resume
+        running = true;
+        str.append(step_ticker->is_stopped() ? "Hold:0" : "Hold:1");
     } else if(this->conveyor->is_idle()) {
         str.append("Idle");
     } else {
@@ -214,43 +257,34 @@ std::string Kernel::get_query_string()
         str.append("Run");
     }
 
+    // positions are formatted with format_fixed() as this is polled several times a second by the host
     if(running) {
         float mpos[3];
         robot->get_current_machine_position(mpos);
         // current_position/mpos includes the compensation transform so we need to get the inverse to get actual position
         if(robot->compensationTransform) robot->compensationTransform(mpos, true); // get inverse compensation transform
 
-        char buf[128];
         // machine position
-        size_t n = snprintf(buf, sizeof(buf), "%1.4f,%1.4f,%1.4f", robot->from_millimeters(mpos[0]), robot->from_millimeters(mpos[1]), robot->from_millimeters(mpos[2]));
-        if(n > sizeof(buf)) n= sizeof(buf);
-
-        str.append("|MPos:").append(buf, n);
+        append_xyz(str, "|MPos:", robot->from_millimeters(mpos[0]), robot->from_millimeters(mpos[1]), robot->from_millimeters(mpos[2]), 4);
 
 #if MAX_ROBOT_ACTUATORS > 3
         // deal with the ABC axis (E will be A)
         for (int i = A_AXIS; i < robot->get_number_registered_motors(); ++i) {
             // current actuator position
-            n = snprintf(buf, sizeof(buf), ",%1.4f", robot->from_millimeters(robot->actuators[i]->get_current_position()));
-            if(n > sizeof(buf)) n= sizeof(buf);
-            str.append(buf, n);
+            str.append(1, ',');
+            append_fixed(str, robot->from_millimeters(robot->actuators[i]->get_current_position()), 4);
         }
 #endif
 
         // work space position
         Robot::wcs_t pos = robot->mcs2wcs(mpos);
-        n = snprintf(buf, sizeof(buf), "%1.4f,%1.4f,%1.4f", robot->from_millimeters(std::get<X_AXIS>(pos)), robot->from_millimeters(std::get<Y_AXIS>(pos)), robot->from_millimeters(std::get<Z_AXIS>(pos)));
-        if(n > sizeof(buf)) n= sizeof(buf);
-
-        str.append("|WPos:").append(buf, n);
+        append_xyz(str, "|WPos:", robot->from_millimeters(std::get<X_AXIS>(pos)), robot->from_millimeters(std::get<Y_AXIS>(pos)), robot->from_millimeters(std::get<Z_AXIS>(pos)), 4);
 
         // current feedrate and requested fr and override
         float fr= robot->from_millimeters(conveyor->get_current_feedrate()*60.0F);
         float frr= robot->from_millimeters(robot->get_feed_rate());
-        float fro= 6000.0F / robot->get_seconds_per_minute();
-        n = snprintf(buf, sizeof(buf), "|F:%1.1f,%1.1f,%1.1f", fr, frr,fro);
-        if(n > sizeof(buf)) n= sizeof(buf);
-        str.append(buf, n);
+        float fro= 6000.0F / robot->get_seconds_per_minute() * planner->get_speed_override();
+        append_xyz(str, "|F:", fr, frr, fro, 1);
 
 
         // current Laser power
@@ -258,48 +292,40 @@ std::string Kernel::get_query_string()
             Laser *plaser= nullptr;
             if(PublicData::get_value(laser_checksum, (void *)&plaser) && plaser != nullptr) {
                 float lp= plaser->get_current_power();
-                n = snprintf(buf, sizeof(buf), "|L:%1.4f", lp);
-                if(n > sizeof(buf)) n= sizeof(buf);
-                str.append(buf, n);
+                str.append("|L:");
+                append_fixed(str, lp, 4);
                 float sr= robot->get_s_value();
-                n = snprintf(buf, sizeof(buf), "|S:%1.4f", sr);
-                if(n > sizeof(buf)) n= sizeof(buf);
-                str.append(buf, n);
+                str.append("|S:");
+                append_fixed(str, sr, 4);
             }
         #endif
 
     } else {
         // return the last milestone if idle
-        char buf[128];
         // machine position
         Robot::wcs_t mpos = robot->get_axis_position();
-        size_t n = snprintf(buf, sizeof(buf), "%1.4f,%1.4f,%1.4f", robot->from_millimeters(std::get<X_AXIS>(mpos)), robot->from_millimeters(std::get<Y_AXIS>(mpos)), robot->from_millimeters(std::get<Z_AXIS>(mpos)));
-        if(n > sizeof(buf)) n= sizeof(buf);
-
-        str.append("|MPos:").append(buf, n);
+        append_xyz(str, "|MPos:", robot->from_millimeters(std::get<X_AXIS>(mpos)), robot->from_millimeters(std::get<Y_AXIS>(mpos)), robot->from_millimeters(std::get<Z_AXIS>(mpos)), 4);
 
 #if MAX_ROBOT_ACTUATORS > 3
         // deal with the ABC axis (E will be A)
         for (int i = A_AXIS; i < robot->get_number_registered_motors(); ++i) {
             // current actuator position
-            n = snprintf(buf, sizeof(buf), ",%1.4f", robot->from_millimeters(robot->actuators[i]->get_current_position()));
-            if(n > sizeof(buf)) n= sizeof(buf);
-            str.append(buf, n);
+            str.append(1, ',');
+            append_fixed(str, robot->from_millimeters(robot->actuators[i]->get_current_position()), 4);
         }
 #endif
 
         // work space position
         Robot::wcs_t pos = robot->mcs2wcs(mpos);
-        n = snprintf(buf, sizeof(buf), "%1.4f,%1.4f,%1.4f", robot->from_millimeters(std::get<X_AXIS>(pos)), robot->from_millimeters(std::get<Y_AXIS>(pos)), robot->from_millimeters(std::get<Z_AXIS>(pos)));
-        if(n > sizeof(buf)) n= sizeof(buf);
-        str.append("|WPos:").append(buf, n);
+        append_xyz(str, "|WPos:", robot->from_millimeters(std::get<X_AXIS>(pos)), robot->from_millimeters(std::get<Y_AXIS>(pos)), robot->from_millimeters(std::get<Z_AXIS>(pos)), 4);
 
         // requested framerate, and override
         float fr= robot->from_millimeters(robot->get_feed_rate());
-        float fro= 6000.0F / robot->get_seconds_per_minute();
-        n = snprintf(buf, sizeof(buf), "|F:%1.1f,%1.1f", fr, fro);
-        if(n > sizeof(buf)) n= sizeof(buf);
-        str.append(buf, n);
+        float fro= 6000.0F / robot->get_seconds_per_minute() * planner->get_speed_override();
+        str.append("|F:");
+        append_fixed(str, fr, 1);
+        str.append(1, ',');
+        append_fixed(str, fro, 1);
     }
 
     // if not grbl mode get temperatures
@@ -338,9 +364,18 @@ void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod)
 void Kernel::call_event(_EVENT_ENUM id_event, void * argument)
 {
     bool was_idle = true;
+    if(id_event == ON_IDLE && halt_pending) {
+        finish_decelerated_halt();
+    }
+
     if(id_event == ON_HALT) {
         this->halted = (argument == nullptr);
-        if(!this->halted && this->feed_hold) this->feed_hold= false; // also clear feed hold
+        this->halt_pending = false; // done, or overtaken by another halt
+        if(!this->halted) {
+            this->halt_position_kept= false;
+            this->feed_hold= false; // also clear feed hold
+            step_ticker->reset_speed_scale();
+        }
         was_idle = conveyor->is_idle(); // see if we were doing anything like printing
     }
 
@@ -359,6 +394,44 @@ void Kernel::call_event(_EVENT_ENUM id_event, void * argument)
     }
 }
 
+// Feed hold ramps the running block down to a stop at its acceleration and freezes the queue where it is,
+// releasing it ramps back up and carries on with the queue as planned. New moves are not added while held.
+void Kernel::set_feed_hold(bool f)
+{
+    // a decelerated halt holds the queue until it is done, it can not be resumed
+    if(!f && halt_pending) return;
+    feed_hold= f;
+    if(f) {
+        step_ticker->decelerate_to_stop();
+    } else {
+        step_ticker->resume();
+    }
+}
+
+// A halt that first ramps whatever is moving down to a stop at the acceleration of the running block, then flushes
+// the queue as a normal halt does. No steps are lost so the position is still good and there is no need to home again.
+// This only starts the ramp, the queue is held so nothing new is planned and on_idle finishes the halt once stopped.
+void Kernel::decelerated_halt()
+{
+    if(halted || halt_pending) return;
+
+    halt_pending= true;
+    feed_hold= true;
+    halt_start_us= us_ticker_read();
+    step_ticker->decelerate_to_stop();
+}
+
+void Kernel::finish_decelerated_halt()
+{
+    // it takes nominal speed / acceleration, the timeout is in case something stalls the step ticker
+    bool stopped= step_ticker->is_stopped();
+    if(!stopped && us_ticker_read() - halt_start_us < 2000000) return;
+
+    halt_position_kept= stopped;
+    call_event(ON_HALT, nullptr);
+    step_ticker->reset_speed_scale();
+}
+
 // These are used by tests to test for various things. basically mocks
 bool Kernel::kernel_has_event(_EVENT_ENUM id_event, Module *mod)
 {
@@ -32,6 +32,9 @@ class Adc;
 class PublicData;
 class SimpleShell;
 class Configurator;
+class FlashStore;
+class FlightRecorder;
+class LatencyStats;
 
 class Kernel {
     public:
@@ -48,10 +51,16 @@ class Kernel {
 
         bool is_using_leds() const { return use_leds; }
         bool is_halted() const { return halted; }
+        // set while halted after decelerated_halt(), the position is still good and the motors were left enabled
+        bool is_halt_position_kept() const { return halt_position_kept; }
+        bool is_decelerate_on_halt() const { return decelerate_on_halt; }
+        void decelerated_halt();
+        // set from decelerated_halt() until the halt is done
+        bool is_halt_pending() const { return halt_pending; }
         bool is_grbl_mode() const { return grbl_mode; }
         bool is_ok_per_line() const { return ok_per_line; }
 
-        void set_feed_hold(bool f) { feed_hold= f; }
+        void set_feed_hold(bool f);
         bool get_feed_hold() const { return feed_hold; }
         bool is_feed_hold_enabled() const { return enable_feed_hold; }
         bool has_serial_rts_cts_handshake() const { return serial_hw_handshake; }
@@ -68,6 +77,9 @@ class Kernel {
         Conveyor*         conveyor;
         Configurator*     configurator;
         SimpleShell*      simpleshell;
+        FlashStore*       flash_store;
+        FlightRecorder*   flight_recorder;
+        LatencyStats*     latency_stats;
 
         SlowTicker*       slow_ticker;
         StepTicker*       step_ticker;
@@ -78,6 +90,8 @@ class Kernel {
     private:
         // When a module asks to be called for a specific event ( a hook ), this is where that request is remembered
         std::array<std::vector<Module*>, NUMBER_OF_DEFINED_EVENTS> hooks;
+        void finish_decelerated_halt();
+        uint32_t halt_start_us;
         struct {
             bool use_leds:1;
             bool halted:1;
@@ -86,6 +100,9 @@ class Kernel {
             bool ok_per_line:1;
             bool enable_feed_hold:1;
             bool serial_hw_handshake:1;
+            bool halt_position_kept:1;
+            bool decelerate_on_halt:1;
+            bool halt_pending:1;
         };
 
 };
@@ -0,0 +1,138 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LatencyStats.h"
+#include "Kernel.h"
+#include "Block.h"
+#include "Gcode.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "StreamOutput.h"
+#include "stm32f4xx.h"
+#include "us_ticker_api.h"
+
+#include <string.h>
+
+#define latency_stats_checksum              CHECKSUM("latency_stats")
+#define enable_checksum                     CHECKSUM("enable")
+
+static const char *stage_names[]= {"rx>ok", "rx>queued", "queued>started", "started>finished"};
+
+LatencyStats::LatencyStats()
+{
+    memset(histograms, 0, sizeof(histograms));
+    line_rx_us= 0;
+    queue_rx_us= 0;
+    started_us= 0;
+    enabled= false;
+}
+
+void LatencyStats::on_module_loaded()
+{
+    // the kernel keeps a pointer to it so it stays loaded, disabled it does nothing
+    enabled= THEKERNEL->config->value(latency_stats_checksum, enable_checksum)->by_default(false)->as_bool();
+    if(!enabled) return;
+
+    register_for_event(ON_GCODE_RECEIVED);
+}
+
+void LatencyStats::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+
+    if(gcode->has_m && gcode->m == 832) {
+        if(gcode->has_letter('R')) {
+            reset();
+        } else {
+            report(gcode->stream);
+        }
+    }
+}
+
+void LatencyStats::line_ok()
+{
+    if(enabled && line_rx_us != 0) {
+        add(RX_TO_OK, us_ticker_read() - line_rx_us);
+        line_rx_us= 0;
+    }
+}
+
+void LatencyStats::block_queued(Block *block)
+{
+    if(!enabled) return;
+    block->queued_us= us_ticker_read();
+    if(queue_rx_us != 0) {
+        add(RX_TO_QUEUED, block->queued_us - queue_rx_us);
+        queue_rx_us= 0;
+    }
+}
+
+void LatencyStats::block_started(const Block *block)
+{
+    if(!enabled) return;
+    started_us= us_ticker_read();
+    add(QUEUED_TO_STARTED, started_us - block->queued_us);
+}
+
+void LatencyStats::block_finished()
+{
+    if(enabled) add(STARTED_TO_FINISHED, us_ticker_read() - started_us);
+}
+
+void LatencyStats::add(STAGE stage, uint32_t us)
+{
+    histogram_t& h= histograms[stage];
+    int i= us < 2 ? 0 : 31 - __builtin_clz(us);
+    if(i >= k_buckets) i= k_buckets - 1;
+    ++h.bucket[i];
+    ++h.count;
+    h.total_us += us;
+    if(us > h.max_us) h.max_us= us;
+}
+
+void LatencyStats::reset()
+{
+    __disable_irq();
+    memset(histograms, 0, sizeof(histograms));
+    __enable_irq();
+}
+
+// one line per stage, the percentiles are the bucket they fall in, then the non empty buckets as <upper_us:count
+void LatencyStats::report(StreamOutput *stream) const
+{
+    for (int s = 0; s < NSTAGES; ++s) {
+        histogram_t h;
+        __disable_irq();
+        h= histograms[s];
+        __enable_irq();
+
+        stream->printf("%s: n %lu", stage_names[s], (unsigned long)h.count);
+        if(h.count == 0) {
+            stream->printf("\n");
+            continue;
+        }
+        stream->printf(" avg %lu max %lu us", (unsigned long)(h.total_us / h.count), (unsigned long)h.max_us);
+
+        const int percentiles[]= {50, 90, 99};
+        uint64_t sum= 0;
+        int p= 0;
+        for (int i = 0; i < k_buckets && p < 3; ++i) {
+            sum += h.bucket[i];
+            while(p < 3 && sum * 100 >= (uint64_t)percentiles[p] * h.count) {
+                stream->printf(" p%d <%lu", percentiles[p], 2UL << i);
+                ++p;
+            }
+        }
+        stream->printf("\n ");
+
+        for (int i = 0; i < k_buckets; ++i) {
+            if(h.bucket[i] != 0) stream->printf(" <%lu:%lu", 2UL << i, (unsigned long)h.bucket[i]);
+        }
+        stream->printf("\n");
+    }
+}
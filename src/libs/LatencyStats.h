@@ -0,0 +1,61 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Module.h"
+
+#include <stdint.h>
+
+class Block;
+class StreamOutput;
+
+// Histograms of how long a line takes through each stage, from the newline received by SerialConsole to its ok, to
+// its first block going in the queue, and for each block from the queue to the step ticker starting it and to it finishing.
+// Buckets are powers of two microseconds so a few counters cover 1us to seconds. M832 reports them, M832 R resets.
+// Only lines received on a SerialConsole have a receive time, blocks from anywhere else only count the block stages.
+class LatencyStats : public Module {
+    public:
+        enum STAGE { RX_TO_OK, RX_TO_QUEUED, QUEUED_TO_STARTED, STARTED_TO_FINISHED, NSTAGES };
+
+        LatencyStats();
+
+        void on_module_loaded();
+        void on_gcode_received(void *argument);
+
+        bool is_enabled() const { return enabled; }
+
+        // the receive time of the line being dispatched, 0 when it is not known
+        void set_line_received(uint32_t us) { line_rx_us= queue_rx_us= us; }
+        // the ok of the line, a G1 sends it before it is planned
+        void line_ok();
+        // only the first block of a line counts for rx>queued, a line can be split into many
+        void block_queued(Block *block);
+        // called from the step ticker ISR
+        void block_started(const Block *block);
+        void block_finished();
+
+    private:
+        static const int k_buckets= 24; // the last one counts everything from 8 seconds up
+
+        struct histogram_t {
+            uint32_t bucket[k_buckets]; // bucket i counts latencies under 2^(i+1) us
+            uint32_t count;
+            uint32_t max_us;
+            uint64_t total_us;
+        };
+
+        void add(STAGE stage, uint32_t us);
+        void report(StreamOutput *stream) const;
+        void reset();
+
+        histogram_t histograms[NSTAGES];
+        uint32_t line_rx_us;            // cleared when the line has sent its ok
+        uint32_t queue_rx_us;           // cleared when the line has queued its first block
+        uint32_t started_us;
+        bool enabled;
+};
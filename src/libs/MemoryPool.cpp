@@ -208,13 +208,13 @@ void MemoryPool::debug(StreamOutput* str)
     uint32_t free = 0;
     str->printf("Start: %ub MemoryPool at %p\n", size, p);
     do {
-        str->printf("\tChunk at %p (%+4d): %s, %lu bytes\n", p, offset(p), (p->used?"used":"free"), p->next);
+        str->printf("\tChunk at %p (%+4d): %s, %lu bytes\n", p, (int)offset(p), (p->used?"used":"free"), (unsigned long)p->next);
         tot += p->next;
         if (p->used == 0)
             free += p->next;
         if ((offset(p) + p->next >= size) || (p->next <= sizeof(_poolregion)))
         {
-            str->printf("End: total %lub, free: %lub\n", tot, free);
+            str->printf("End: total %lub, free: %lub\n", (unsigned long)tot, (unsigned long)free);
             return;
         }
         p = (_poolregion*) (((uint8_t*) p) + p->next);
@@ -2,7 +2,50 @@
 #include "PublicData.h"
 #include "PublicDataRequest.h"
 
+std::vector<PublicData::entry_t*> PublicData::entries;
+
+PublicData::entry_t *PublicData::add_entry(uint16_t csa, uint16_t csb, uint16_t csc, const void *type, bool (*call)(void*, void*))
+{
+    entry_t *e= find_entry(csa, csb, csc, nullptr);
+    if(e != nullptr) {
+        // all the providers of a value have to agree on its type
+        return e->type == type ? e : nullptr;
+    }
+
+    e= new entry_t;
+    e->cs[0]= csa;
+    e->cs[1]= csb;
+    e->cs[2]= csc;
+    e->type= type;
+    e->call= call;
+    entries.push_back(e);
+    return e;
+}
+
+// type nullptr matches any type
+PublicData::entry_t *PublicData::find_entry(uint16_t csa, uint16_t csb, uint16_t csc, const void *type)
+{
+    for(auto e : entries) {
+        if(e->cs[0] == csa && e->cs[1] == csb && e->cs[2] == csc) {
+            return (type == nullptr || e->type == type) ? e : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+bool PublicData::request(entry_t *entry, void *data)
+{
+    for(auto h : entry->handlers) {
+        if(entry->call(h, data)) return true;
+    }
+    return false;
+}
+
 bool PublicData::get_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data) {
+    // a registered provider works on the caller's storage, so it is the same as a callee that fills in data
+    entry_t *e= find_entry(csa, csb, csc, nullptr);
+    if(e != nullptr && request(e, data)) return true;
+
     PublicDataRequest pdr(csa, csb, csc);
     // the caller may have created the storage for the returned data so we clear the flag,
     // if it gets set by the callee setting the data ptr that means the data is a pointer to a pointer and is set to a pointer to the returned data
@@ -16,6 +59,9 @@ bool PublicData::get_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data)
 }
 
 bool PublicData::set_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data) {
+    entry_t *e= find_entry(csa, csb, csc, nullptr);
+    if(e != nullptr && request(e, data)) return true;
+
     PublicDataRequest pdr(csa, csb, csc);
     pdr.set_data_ptr(data);
     THEKERNEL->call_event(ON_SET_PUBLIC_DATA, &pdr );
@@ -8,12 +8,20 @@
 #ifndef PUBLICDATA_H
 #define PUBLICDATA_H
 
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
 class PublicData {
+    private:
+        struct entry_t;
+
     public:
         // there are two ways to get data from a module
         // 1. pass in a pointer to a data storage area that the caller creates, the callee module will put the returned data in that pointer
         // 2. pass in a pointer to a pointer, the callee will set that pointer to some storage the callee has control over, with the requested data
         // the version used is dependent on the target (callee) module
+        // A registered provider (see below) is called directly, otherwise every module gets an ON_GET_PUBLIC_DATA event.
         static bool get_value(uint16_t csa, void *data) { return get_value(csa, 0, 0, data); }
         static bool get_value(uint16_t csa, uint16_t csb, void *data) { return get_value(csa, csb, 0, data); }
         static bool get_value(uint16_t cs[3], void *data) { return get_value(cs[0], cs[1], cs[2], data); };
@@ -23,6 +31,59 @@ class PublicData {
         static bool set_value(uint16_t csa, uint16_t csb, void *data) { return set_value(csa, csb, 0, data); }
         static bool set_value(uint16_t cs[3], void *data) { return set_value(cs[0], cs[1], cs[2], data); }
         static bool set_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data);
+
+        // Direct access for the values used on hot paths. A module provides a typed handler for a checksum once, from
+        // on_module_loaded, it works on caller supplied storage and returns true if it took the request. A consumer
+        // keeps a Handle, which finds the providers the first time it is used and then calls them directly.
+        // Several modules can provide the same value (eg extruders), they are asked in turn until one takes it.
+        template<typename T> using handler_t= std::function<bool(T *data)>;
+
+        template<typename T>
+        static void provide(uint16_t csa, uint16_t csb, handler_t<T> fnc) { provide(csa, csb, 0, fnc); }
+        template<typename T>
+        static void provide(uint16_t csa, uint16_t csb, uint16_t csc, handler_t<T> fnc)
+        {
+            entry_t *e= add_entry(csa, csb, csc, type_id<T>(), &call<T>);
+            if(e != nullptr) e->handlers.push_back(new handler_t<T>(fnc));
+        }
+
+        template<typename T>
+        class Handle {
+            public:
+                Handle(uint16_t csa, uint16_t csb, uint16_t csc= 0) : cs{csa, csb, csc}, entry(nullptr) {}
+                // false if nothing provides it or no provider took it
+                bool request(T *data)
+                {
+                    if(entry == nullptr) {
+                        entry= find_entry(cs[0], cs[1], cs[2], type_id<T>());
+                        if(entry == nullptr) return false;
+                    }
+                    return PublicData::request(entry, data);
+                }
+
+            private:
+                uint16_t cs[3];
+                entry_t *entry;
+        };
+
+    private:
+        struct entry_t {
+            uint16_t cs[3];
+            const void *type;
+            bool (*call)(void *handler, void *data);
+            std::vector<void*> handlers;
+        };
+
+        // a unique address per type, so a Handle of the wrong type does not find a provider
+        template<typename T> static const void *type_id() { static const char id= 0; return &id; }
+        template<typename T> static bool call(void *handler, void *data) { return (*static_cast<handler_t<T>*>(handler))(static_cast<T*>(data)); }
+
+        static entry_t *add_entry(uint16_t csa, uint16_t csb, uint16_t csc, const void *type, bool (*call)(void*, void*));
+        static entry_t *find_entry(uint16_t csa, uint16_t csb, uint16_t csc, const void *type);
+        static bool request(entry_t *entry, void *data);
+
+        // entries are never freed so a Handle can keep a pointer to one
+        static std::vector<entry_t*> entries;
 };
 
 #endif
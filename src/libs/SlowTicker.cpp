@@ -14,12 +14,14 @@
 #include "modules/robot/Conveyor.h"
 #include "Gcode.h"
 
+#include <algorithm>
+
 #include "stm32f407xx.h" // mbed.h lib
 
 #include <mri.h>
 
-// This module uses a Timer to periodically call hooks
-// Modules register with a function ( callback ) and a frequency, and we then call that function at the given frequency.
+// This module uses a Timer to call hooks when they are due
+// Modules register with a function ( callback ) and a frequency or a delay, and we then call that function at the given time.
 
 
 extern "C" void TIM6_DAC_IRQHandler(void);
@@ -33,16 +35,27 @@ SlowTicker::SlowTicker(){
     //ispbtn.from_string("2.10")->as_input()->pull_up();
 
     __TIM6_CLK_ENABLE();
-    TIM6->CR1 = TIM_CR1_URS;    // int on overflow
+    TIM6->CR1 = TIM_CR1_URS;    // int on overflow, ARR is not buffered so it can be changed on the fly
+    TIM6->PSC = ((SystemCoreClock >> 1) / SLOWTICKER_HZ) - 1; // SystemCoreClock/2 = Timer increments in a second
+    TIM6->ARR = 0xFFFF;
+    TIM6->EGR = TIM_EGR_UG;     // load the prescaler, URS stops this from interrupting
     NVIC_SetVector(TIM6_DAC_IRQn, (uint32_t)TIM6_DAC_IRQHandler);
 
-    max_frequency = 5;  // initial max frequency is set to 5Hz
-    set_frequency(max_frequency);
-    flag_1s_flag = 0;
+    base= 0;
+    started= false;
+    heap.reserve(32);
+
+    // ON_SECOND_TICK is called from the main loop
+    attach(1, this, &SlowTicker::second_tick, true);
 }
 
 void SlowTicker::start()
 {
+    __disable_irq();
+    started= true;
+    program_next();
+    __enable_irq();
+
     TIM6->DIER = TIM_DIER_UIE;      // update interrupt en
     NVIC_EnableIRQ(TIM6_DAC_IRQn);    // Enable interrupt handler
     TIM6->CR1 |= TIM_CR1_CEN;  // start
@@ -52,40 +65,122 @@ void SlowTicker::on_module_loaded(){
     register_for_event(ON_IDLE);
 }
 
-// Set the base frequency we use for all sub-frequencies
-void SlowTicker::set_frequency( int frequency ){
-    this->interval = ((SystemCoreClock >> 1) / SLOWTICKER_PRESCALER) / frequency;   // SystemCoreClock/4 = Timer increments in a second
+void SlowTicker::schedule(Hook *hook, uint32_t delay_us)
+{
+    __disable_irq();
+    if(hook->queued) remove(hook);
+
+    uint32_t now= base + TIM6->CNT;
+    if(hook->periodic) {
+        // align to the interval so hooks with the same or related rates are due in the same interrupt
+        hook->deadline= (now / hook->interval + 1) * hook->interval;
+    }else{
+        hook->deadline= now + delay_us;
+    }
 
-    TIM6->PSC = SLOWTICKER_PRESCALER - 1;
-    TIM6->ARR = this->interval;
+    heap.push_back(hook);
+    std::push_heap(heap.begin(), heap.end(), later);
+    hook->queued= true;
 
-    flag_1s_count= (SystemCoreClock >> 1) / SLOWTICKER_PRESCALER;
+    // if it is the new earliest deadline the timer needs to expire sooner
+    if(started && heap.front() == hook && !program_next()) {
+        // already due, let the interrupt handle it
+        NVIC_SetPendingIRQ(TIM6_DAC_IRQn);
+    }
+    __enable_irq();
 }
 
-// The actual interrupt being called by the timer, this is where work is done
-void SlowTicker::tick(){
-
-    // Call all hooks that need to be called
-    for (Hook* hook : this->hooks){
-        hook->countdown -= this->interval;
-        if (hook->countdown < 0)
-        {
-            hook->countdown += hook->interval;
-            hook->call();
-        }
+void SlowTicker::detach(Hook *hook)
+{
+    __disable_irq();
+    if(hook->queued) remove(hook);
+    __enable_irq();
+}
+
+// must be called with interrupts disabled
+void SlowTicker::remove(Hook *hook)
+{
+    auto i= std::find(heap.begin(), heap.end(), hook);
+    if(i != heap.end()) {
+        heap.erase(i);
+        std::make_heap(heap.begin(), heap.end(), later);
     }
+    hook->queued= false;
+    // the timer is left as it is, an early expiry just finds nothing due
+}
 
-    // deduct tick time from second counter
-    flag_1s_count -= this->interval;
-    // if a whole second has elapsed,
-    if (flag_1s_count < 0)
-    {
-        // add a second to our counter
-        flag_1s_count += (SystemCoreClock >> 1) / SLOWTICKER_PRESCALER;
-        // and set a flag for idle event to pick up
-        flag_1s_flag++;
+// program the timer to expire at the earliest deadline, or as late as it can if there is nothing to do
+// returns false if that deadline is already too close to program, or the counter got past it while it was programmed
+bool SlowTicker::program_next()
+{
+    // masked as the step interrupt could otherwise run between reading the counter and setting ARR
+    uint32_t primask= __get_PRIMASK();
+    __disable_irq();
+
+    // an update event that is not handled yet needs the ARR it happened at, tick() programs the next one
+    if(TIM6->SR & TIM_SR_UIF) {
+        __set_PRIMASK(primask);
+        return true;
+    }
+
+    bool ok= true;
+    uint32_t cnt= TIM6->CNT;
+    uint32_t arr= 0xFFFF;
+    if(!heap.empty()) {
+        int32_t d= heap.front()->deadline - base; // counts from the last update event
+        if(d - 1 < (int32_t)(cnt + SLOWTICKER_MARGIN)) ok= false;
+        else if(d - 1 < (int32_t)arr) arr= d - 1;
+    }
+
+    if(ok) {
+        TIM6->ARR= arr;
+        // a counter already past ARR would run on to 0xFFFF and wrap, ~65ms late, so force the update event now,
+        // URS keeps a forced update from interrupting so the counts it drops go into base here
+        cnt= TIM6->CNT;
+        if(cnt > arr) {
+            TIM6->EGR= TIM_EGR_UG;
+            base += cnt;
+            ok= false;
+        }
     }
 
+    __set_PRIMASK(primask);
+    return ok;
+}
+
+// The actual interrupt being called by the timer, this is where work is done
+void SlowTicker::tick(bool update)
+{
+    // the update event happened exactly when the timer expired, so base does not drift however late we get here
+    if(update) base += TIM6->ARR + 1;
+
+    do {
+        uint32_t now= base + TIM6->CNT;
+
+        // Call the hooks that are due, leaving the rest alone
+        while(!heap.empty() && (int32_t)(heap.front()->deadline - now) <= SLOWTICKER_MARGIN) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            Hook *hook= heap.back();
+
+            if(hook->periodic) {
+                hook->deadline += hook->interval;
+                // if we fell behind skip the missed calls rather than calling it back to back
+                if((int32_t)(hook->deadline - now) <= 0) hook->deadline= now + hook->interval;
+                std::push_heap(heap.begin(), heap.end(), later);
+            }else{
+                heap.pop_back();
+                hook->queued= false;
+            }
+
+            if(hook->in_main_loop) {
+                // only queue it once if the main loop has not caught up yet
+                if(!hook->pending && deferred.put(hook)) hook->pending= true;
+            }else{
+                hook->call();
+            }
+        }
+    } while(!program_next());
+
     // Enter MRI mode if the ISP button is pressed
     // TODO: This should have it's own module
     //if (ispbtn.get() == 0)
@@ -93,23 +188,10 @@ void SlowTicker::tick(){
 
 }
 
-bool SlowTicker::flag_1s(){
-    // atomic flag check routine
-    // first disable interrupts
-    __disable_irq();
-    // then check for a flag
-    if (flag_1s_flag)
-    {
-        // if we have a flag, decrement the counter
-        flag_1s_flag--;
-        // re-enable interrupts
-        __enable_irq();
-        // and tell caller that we consumed a flag
-        return true;
-    }
-    // if no flag, re-enable interrupts and return false
-    __enable_irq();
-    return false;
+uint32_t SlowTicker::second_tick(uint32_t)
+{
+    THEKERNEL->call_event(ON_SECOND_TICK);
+    return 0;
 }
 
 #include "gpio.h"
@@ -122,15 +204,18 @@ void SlowTicker::on_idle(void*)
         leds[1]= (ledcnt++ & 0x1000) ? 1 : 0;
     }
 
-    // if interrupt has set the 1 second flag
-    if (flag_1s())
-        // fire the on_second_tick event
-        THEKERNEL->call_event(ON_SECOND_TICK);
+    // call the hooks the interrupt deferred to us
+    Hook *hook;
+    while(deferred.get(hook)) {
+        hook->pending= false;
+        hook->call();
+    }
 }
 
 extern "C" void TIM6_DAC_IRQHandler (void){
+    // it can also be pended by schedule() when a new hook is already due
+    bool update= (TIM6->SR & TIM_SR_UIF) != 0;
     TIM6->SR = ~TIM_SR_UIF;
 
-    global_slow_ticker->tick();
+    global_slow_ticker->tick(update);
 }
-
@@ -17,9 +17,22 @@
 //#include "system_LPC17xx.h" // for SystemCoreClock
 #include "system_stm32f4xx.h"
 #include <math.h>
-
-#define SLOWTICKER_PRESCALER    (1 << 13)
-
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+#include "TSRingBuffer.h"
+
+// TIM6 counts in microseconds, being a 16 bit timer the longest it can wait is ~65ms after which it is simply reprogrammed
+#define SLOWTICKER_HZ           1000000
+// a deadline closer than this is treated as due, so the timer is never programmed behind its own counter
+#define SLOWTICKER_MARGIN       5
+
+// Timer service for the low frequency periodic and one shot callbacks.
+// Hooks are kept in a min-heap ordered by deadline and TIM6 is programmed to expire at the earliest one,
+// so the interrupt only runs when something is due and only touches the hooks that are due.
+// Periodic hooks are aligned to a multiple of their interval so hooks with related rates share an interrupt.
+// A hook can also be deferred to the main loop, it is then called from on_idle instead of the interrupt.
 class SlowTicker : public Module{
     public:
         SlowTicker();
@@ -27,38 +40,46 @@ class SlowTicker : public Module{
         void on_module_loaded(void);
         void on_idle(void*);
         void start();
-        void set_frequency( int frequency );
-        void tick();
+        void tick(bool update);
+
+        // call fptr frequency times a second
         // For some reason this can't go in the .cpp, see :  http://mbed.org/forum/mbed/topic/2774/?page=1#comment-14221
         // TODO replace this with std::function()
-        template<typename T> Hook* attach( uint32_t frequency, T *optr, uint32_t ( T::*fptr )( uint32_t ) ){
+        template<typename T> Hook* attach( uint32_t frequency, T *optr, uint32_t ( T::*fptr )( uint32_t ), bool in_main_loop= false ){
             Hook* hook = new Hook();
-            hook->interval = floorf(((SystemCoreClock/2) / SLOWTICKER_PRESCALER)/frequency);
             hook->attach(optr, fptr);
-            hook->countdown = hook->interval;
-
-            // to avoid race conditions we must stop the interupts before updating this non thread safe vector
-            __disable_irq();
-            if( frequency > this->max_frequency ){
-                this->max_frequency = frequency;
-                this->set_frequency(frequency);
-            }
-            this->hooks.push_back(hook);
-            __enable_irq();
+            hook->interval = std::max<uint32_t>(1, SLOWTICKER_HZ / frequency);
+            hook->periodic = true;
+            hook->in_main_loop = in_main_loop;
+            schedule(hook, hook->interval);
             return hook;
         }
 
-    private:
-        bool flag_1s();
+        // call fptr once, delay_us from now, the hook can be fired again with schedule()
+        template<typename T> Hook* one_shot( uint32_t delay_us, T *optr, uint32_t ( T::*fptr )( uint32_t ), bool in_main_loop= false ){
+            Hook* hook = new Hook();
+            hook->attach(optr, fptr);
+            hook->periodic = false;
+            hook->in_main_loop = in_main_loop;
+            schedule(hook, delay_us);
+            return hook;
+        }
 
-        std::vector<Hook*> hooks;
-        uint32_t max_frequency;
-        uint32_t interval;
+        // (re)arm a hook, periodic hooks ignore the delay and are aligned to their interval
+        void schedule(Hook *hook, uint32_t delay_us);
+        // stop calling a hook, it is not deleted
+        void detach(Hook *hook);
 
-        Pin ispbtn;
-protected:
-    int flag_1s_count;
-    volatile int flag_1s_flag;
+    private:
+        uint32_t second_tick(uint32_t);
+        bool program_next();
+        void remove(Hook *hook);
+        static bool later(const Hook *a, const Hook *b) { return (int32_t)(a->deadline - b->deadline) > 0; }
+
+        std::vector<Hook*> heap;            // min-heap on deadline
+        TSRingBuffer<Hook*, 16> deferred;   // due hooks waiting for the main loop
+        volatile uint32_t base;             // time of the last update event, us
+        bool started;
 };
 
 
@@ -15,9 +15,14 @@
 #include "StreamOutputPool.h"
 #include "Block.h"
 #include "Conveyor.h"
+#include "MotorChannel.h"
+#include "PositionStrobe.h"
+#include "FlightRecorder.h"
+#include "LatencyStats.h"
 
 #include "stm32f407xx.h" // mbed.h lib
 #include <math.h>
+#include <algorithm>
 #include <mri.h>
 
 #ifdef STEPTICKER_DEBUG_PIN
@@ -61,6 +66,7 @@ StepTicker::StepTicker()
     this->num_motors = 0;
 
     this->running = false;
+    this->channel_stepped = false;
     this->current_block = nullptr;
 
     #ifdef STEPTICKER_DEBUG_PIN
@@ -107,6 +113,27 @@ void StepTicker::set_unstep_time( float microseconds )
     // TODO check that the unstep time is less than the step period, if not slow down step ticker
 }
 
+void StepTicker::set_override(uint32_t scale)
+{
+    // a feed hold can come in from the serial interrupt, and has to win
+    __disable_irq();
+    override_scale= scale;
+    if(target_scale != 0) target_scale= scale;
+    __enable_irq();
+}
+
+// The path acceleration is scale'.v + scale^2.a, when the block accelerates or decelerates the same way as the speed
+// scale ramps the scale^2.a of it leaves scale_rate * (1 - scale^2 / override^2), nothing at or above the override
+// until the block is out of that part of its trapezoid.
+uint32_t StepTicker::shared_scale_rate() const
+{
+    uint32_t s= speed_scale, o= override_scale;
+    if(s >= o) return 0;
+    uint64_t r= ((uint64_t)s << 30) / o;   // s / o, 2.30 and below 1.0
+    r= (r * r) >> 30;                       // (s / o)^2
+    return ((uint64_t)scale_rate * (STEPTICKER_SCALE_ONE - r)) >> 30;
+}
+
 // Reset step pins on any motor that was stepped
 void StepTicker::unstep_tick()
 {
@@ -116,6 +143,13 @@ void StepTicker::unstep_tick()
         }
     }
     this->unstep.reset();
+
+    if(this->channel_stepped) {
+        for (int i = 0; i < num_channels; i++) {
+            this->channels[i]->unstep();
+        }
+        this->channel_stepped = false;
+    }
 }
 
 extern "C" void TIM8_TRG_COM_TIM14_IRQHandler (void)
@@ -146,6 +180,22 @@ void StepTicker::handle_finish (void)
 
 // step clock
 void StepTicker::step_tick (void)
+{
+    // the channels go first so the block motors pulse width is not changed
+    for (int i = 0; i < num_channels; i++) {
+        if(channels[i]->tick()) channel_stepped= true;
+    }
+
+    tick_block();
+
+    if(position_strobe != nullptr) position_strobe->tick();
+
+    // the unstep timer may already have been started for the block motors
+    if(channel_stepped) TIM14->CR1 |= TIM_CR1_CEN;
+}
+
+// step the motors of the current block
+void StepTicker::tick_block (void)
 {
     //SET_STEPTICKER_DEBUG_PIN(running ? 1 : 0);
 
@@ -164,47 +214,96 @@ void StepTicker::step_tick (void)
         running= false;
         current_tick = 0;
         current_block= nullptr;
+        reset_speed_scale();
         return;
     }
 
+    // normally the block time line advances a whole tick every tick, when scaled it advances by a fraction, or by
+    // more than one tick when the speed override is above 100%
+    bool scaled= speed_scale != STEPTICKER_SCALE_ONE || target_scale != STEPTICKER_SCALE_ONE;
+    uint32_t advance= 1;
+    if(scaled) {
+        uint32_t target= std::min((uint32_t)target_scale, scale_limit);
+        if(speed_scale > target) {
+            uint32_t rate= current_tick > current_block->decelerate_after ? shared_scale_rate() : scale_rate;
+            speed_scale= (speed_scale - target > rate) ? speed_scale - rate : target;
+        } else if(speed_scale < target) {
+            uint32_t rate= current_tick < current_block->accelerate_until ? shared_scale_rate() : scale_rate;
+            speed_scale= (target - speed_scale > rate) ? speed_scale + rate : target;
+        }
+        block_time += speed_scale;
+        advance= block_time >> 30;
+        block_time &= STEPTICKER_SCALE_ONE - 1;
+    }
+
     bool still_moving= false;
     // foreach motor, if it is active see if time to issue a step to that motor
     for (uint8_t m = 0; m < num_motors; m++) {
         if(current_block->tick_info[m].steps_to_move == 0) continue; // not active
 
-        current_block->tick_info[m].steps_per_tick += current_block->tick_info[m].acceleration_change;
+        for (uint32_t a = 0; a < advance; ++a) {
+            uint32_t tick= current_tick + a;
+            current_block->tick_info[m].steps_per_tick += current_block->tick_info[m].acceleration_change;
+
+            if(tick == current_block->tick_info[m].next_accel_event && current_block->n_shaper_events > 0) {
+                // an input shaped block, the acceleration changes at each of its events
+                const Block::shaper_event_t *event= current_block->shaper_events;
+                uint8_t n= current_block->n_shaper_events;
+                uint8_t k= 1;
+                while(k < n - 1 && event[k].tick != tick) ++k;
+                float aratio= (1.0F / current_block->steps_event_count) * current_block->steps[m];
+                current_block->tick_info[m].acceleration_change= (int64_t)(event[k].acceleration * aratio);
+                current_block->tick_info[m].next_accel_event= (k + 1 < n) ? event[k + 1].tick : current_block->total_move_ticks + 1;
+                if(tick + 1 == current_block->tick_info[m].accelerate_until && event[k].acceleration == 0) {
+                    // done accelerating and not yet decelerating, drop the rounding errors
+                    current_block->tick_info[m].steps_per_tick = current_block->tick_info[m].plateau_rate;
+                }
 
-        if(current_tick == current_block->tick_info[m].next_accel_event) {
-            if(current_tick == current_block->accelerate_until) { // We are done accelerating, deceleration becomes 0 : plateau
-                current_block->tick_info[m].acceleration_change = 0;
-                if(current_block->decelerate_after < current_block->total_move_ticks) {
-                    current_block->tick_info[m].next_accel_event = current_block->decelerate_after;
-                    if(current_tick != current_block->decelerate_after) { // We are plateauing
-                        // steps/sec / tick frequency to get steps per tick
-                        current_block->tick_info[m].steps_per_tick = current_block->tick_info[m].plateau_rate;
+            } else if(tick == current_block->tick_info[m].next_accel_event) {
+                if(tick == current_block->tick_info[m].accelerate_until) { // We are done accelerating, deceleration becomes 0 : plateau
+                    current_block->tick_info[m].acceleration_change = 0;
+                    if(current_block->tick_info[m].decelerate_after < current_block->total_move_ticks) {
+                        current_block->tick_info[m].next_accel_event = current_block->tick_info[m].decelerate_after;
+                        if(tick != current_block->tick_info[m].decelerate_after) { // We are plateauing
+                            // steps/sec / tick frequency to get steps per tick
+                            current_block->tick_info[m].steps_per_tick = current_block->tick_info[m].plateau_rate;
+                        }
                     }
                 }
+
+                if(tick == current_block->tick_info[m].decelerate_after) { // We start decelerating
+                    current_block->tick_info[m].acceleration_change = current_block->tick_info[m].deceleration_change;
+                }
             }
 
-            if(current_tick == current_block->decelerate_after) { // We start decelerating
-                current_block->tick_info[m].acceleration_change = current_block->tick_info[m].deceleration_change;
+            // protect against rounding errors and such
+            if(current_block->tick_info[m].steps_per_tick <= 0) {
+                current_block->tick_info[m].counter = STEPTICKER_FPSCALE; // we force completion this step by setting to 1.0
+                current_block->tick_info[m].steps_per_tick = 0;
             }
         }
 
-        // protect against rounding errors and such
-        if(current_block->tick_info[m].steps_per_tick <= 0) {
-            current_block->tick_info[m].counter = STEPTICKER_FPSCALE; // we force completion this step by setting to 1.0
-            current_block->tick_info[m].steps_per_tick = 0;
+        if(scaled) {
+            // the block rate times the speed scale, 2.62 >> 30 times 2.30 is 2.62 again, as the rate is <= 1.0 and the
+            // scale <= 2.0 it fits, a motor can still only step once per tick
+            uint64_t rate= ((uint64_t)current_block->tick_info[m].steps_per_tick >> 30) * speed_scale;
+            current_block->tick_info[m].counter += (int64_t)std::min(rate, (uint64_t)STEPTICKER_FPSCALE);
+        } else {
+            current_block->tick_info[m].counter += current_block->tick_info[m].steps_per_tick;
         }
 
-        current_block->tick_info[m].counter += current_block->tick_info[m].steps_per_tick;
-
         if(current_block->tick_info[m].counter >= STEPTICKER_FPSCALE) { // >= 1.0 step time
             current_block->tick_info[m].counter -= STEPTICKER_FPSCALE; // -= 1.0F;
             ++current_block->tick_info[m].step_count;
 
-            // step the motor
-            bool ismoving= motor[m]->step(); // returns false if the moving flag was set to false externally (probes, endstops etc)
+            // step the motor, any backlash is taken up first
+            bool ismoving;
+            if(current_block->tick_info[m].backlash_steps > 0) {
+                --current_block->tick_info[m].backlash_steps;
+                ismoving= motor[m]->slack_step();
+            } else {
+                ismoving= motor[m]->step(); // returns false if the moving flag was set to false externally (probes, endstops etc)
+            }
             // we stepped so schedule an unstep
             unstep.set(m);
 
@@ -220,7 +319,7 @@ void StepTicker::step_tick (void)
     }
 
     // do this after so we start at tick 0
-    current_tick++; // count number of ticks
+    current_tick += advance; // count number of ticks
 
     // We may have set a pin on in this tick, now we reset the timer to set it off
     // Note there could be a race here if we run another tick before the unsteps have happened,
@@ -236,13 +335,13 @@ void StepTicker::step_tick (void)
     if(!still_moving) {
         //SET_STEPTICKER_DEBUG_PIN(0);
 
-        // all moves finished
-        current_tick = 0;
-
         // get next block
         // do it here so there is no delay in ticks
         THECONVEYOR->block_finished();
 
+        // all moves finished
+        current_tick = 0;
+
         if(THECONVEYOR->get_next_block(&current_block)) { // returns false if no new block is available
             running= start_next_block(); // returns true if there is at least one motor with steps to issue
 
@@ -277,6 +376,22 @@ bool StepTicker::start_next_block()
     }
 
     current_tick= 0;
+    block_time= 0;
+
+    if(position_strobe != nullptr) position_strobe->block_started(current_block);
+    THEKERNEL->flight_recorder->block_started(current_block);
+    THEKERNEL->latency_stats->block_started(current_block);
+
+    // the path speed is speed_scale times the block speed v, so a speed scale change alone accelerates it by scale'.v,
+    // that is kept within the acceleration the block was planned for, which is its own times the override squared
+    if(current_block->nominal_speed > 0.0F) {
+        float o= (float)override_scale / STEPTICKER_SCALE_ONE;
+        scale_rate= std::max(1.0F, (current_block->acceleration * o * o / (current_block->nominal_speed * frequency)) * STEPTICKER_SCALE_ONE);
+    } else {
+        scale_rate= STEPTICKER_SCALE_ONE;
+    }
+    // the block was planned to run at the override it started with, a higher one is cut to its max_override
+    scale_limit= std::max((uint32_t)(std::min(current_block->max_override, 2.0F) * STEPTICKER_SCALE_ONE), (uint32_t)override_scale);
 
     if(ok) {
         //SET_STEPTICKER_DEBUG_PIN(1);
@@ -298,3 +413,26 @@ int StepTicker::register_motor(StepperMotor* m)
     motor[num_motors++] = m;
     return num_motors - 1;
 }
+
+bool StepTicker::add_channel(MotorChannel *c)
+{
+    if(num_channels >= k_max_channels) return false;
+    __disable_irq();
+    channels[num_channels++]= c;
+    __enable_irq();
+    return true;
+}
+
+// the channel should be idle, its step pin is reset here in case the unstep timer has not run since its last step
+void StepTicker::remove_channel(MotorChannel *c)
+{
+    __disable_irq();
+    for (int i = 0; i < num_channels; i++) {
+        if(channels[i] == c) {
+            c->unstep();
+            channels[i]= channels[--num_channels];
+            break;
+        }
+    }
+    __enable_irq();
+}
@@ -20,10 +20,14 @@
 
 class StepperMotor;
 class Block;
+class MotorChannel;
+class PositionStrobe;
 
 // handle 2.62 Fixed point
 #define STEPTICKER_FPSCALE (1LL<<62)
 #define STEPTICKER_FROMFP(x) ((float)(x)/STEPTICKER_FPSCALE)
+// the speed scale is 2.30 fixed point
+#define STEPTICKER_SCALE_ONE (1UL<<30)
 
 class StepTicker{
     public:
@@ -35,11 +39,26 @@ class StepTicker{
         float get_frequency() const { return frequency; }
         void unstep_tick();
         const Block *get_current_block() const { return current_block; }
+        uint32_t get_current_tick() const { return current_tick; }
 
         void step_tick (void);
         void handle_finish (void);
         void start();
 
+        // motor channels are stepped every tick independently of the block queue, returns false if there is no room
+        bool add_channel(MotorChannel *c);
+        void remove_channel(MotorChannel *c);
+        // the position compare is checked every tick after the motors are stepped
+        void set_position_strobe(PositionStrobe *p) { position_strobe= p; }
+
+        // ramps the speed down to zero at the acceleration of the running block, the block stays current
+        void decelerate_to_stop() { target_scale= 0; }
+        void resume() { target_scale= override_scale; }
+        bool is_stopped() const { return !running || speed_scale == 0; }
+        void reset_speed_scale() { target_scale= override_scale; speed_scale= override_scale; }
+        // the real time speed override, 2.30 fixed point up to 2.0, the speed ramps to it unless held
+        void set_override(uint32_t scale);
+
         // whatever setup the block should register this to know when it is done
         std::function<void()> finished_fnc{nullptr};
 
@@ -49,6 +68,8 @@ class StepTicker{
         static StepTicker *instance;
 
         bool start_next_block();
+        void tick_block();
+        uint32_t shared_scale_rate() const;
 
         float frequency;
         uint32_t period;
@@ -58,8 +79,23 @@ class StepTicker{
         Block *current_block;
         uint32_t current_tick{0};
 
+        // The block runs on its own time line which advances by speed_scale every tick, so it can be slowed down or
+        // stopped without replanning it. speed_scale moves towards target_scale by scale_rate each tick, less while
+        // the block itself accelerates the same way, see shared_scale_rate().
+        uint32_t block_time{0};                            // 2.30 fraction of the next block tick
+        volatile uint32_t speed_scale{STEPTICKER_SCALE_ONE};
+        volatile uint32_t target_scale{STEPTICKER_SCALE_ONE};
+        volatile uint32_t override_scale{STEPTICKER_SCALE_ONE};
+        uint32_t scale_rate{0};
+        uint32_t scale_limit{2 * STEPTICKER_SCALE_ONE};     // the running block's cap on target_scale, see Block::max_override
+        static const int k_max_channels= 8;
+        std::array<MotorChannel*, k_max_channels> channels;
+        volatile uint8_t num_channels{0};
+        PositionStrobe *position_strobe{nullptr};
+
         struct {
             volatile bool running:1;
+            volatile bool channel_stepped:1;
             uint8_t num_motors:4;
         };
 };
@@ -11,6 +11,7 @@
 #include "StepTicker.h"
 
 #include <math.h>
+#include <algorithm>
 #include "mbed.h"
 
 StepperMotor::StepperMotor(Pin &step, Pin &dir, Pin &en) : step_pin(step), dir_pin(dir), en_pin(en)
@@ -27,6 +28,8 @@ StepperMotor::StepperMotor(Pin &step, Pin &dir, Pin &en) : step_pin(step), dir_p
     current_position_steps= 0;
     moving= false;
     acceleration= NAN;
+    backlash_mm= 0;
+    planned_direction_valid= false;
     selected= true;
     extruder= false;
 
@@ -47,8 +50,11 @@ StepperMotor::~StepperMotor()
 void StepperMotor::on_halt(void *argument)
 {
     if(argument == nullptr) {
-        enable(false);
+        // after a decelerated halt the motors hold position so it stays good
+        if(!THEKERNEL->is_halt_position_kept()) enable(false);
         moving= false;
+        // the queue is flushed so the last direction actually stepped is where the slack is now
+        planned_direction= direction;
     }
 }
 
@@ -56,7 +62,7 @@ void StepperMotor::on_enable(void *argument)
 {
     // argument is a uin32_t where bit0 is on or off, and bit 1:X, 2:Y, 3:Z, 4:A, 5:B, 6:C etc
     // for now if bit0 is 1 we turn all on, if 0 we turn all off otherwise we turn selected axis off
-    uint32_t bm= (uint32_t)argument;
+    uint32_t bm= (uint32_t)(uintptr_t)argument;
     if(bm == 0x01) {
         enable(true);
 
@@ -86,16 +92,18 @@ void StepperMotor::set_last_milestones(float mm, int32_t steps)
     current_position_steps= last_milestone_steps;
 }
 
-void StepperMotor::update_last_milestones(float mm, int32_t steps)
+// takes steps off the position without moving, mm is the new last milestone, only while the motor is not moving
+void StepperMotor::rebase_position(float mm, int32_t steps)
 {
-    last_milestone_steps += steps;
-    last_milestone_mm = mm;
+    last_milestone_mm= mm;
+    last_milestone_steps -= steps;
+    current_position_steps -= steps;
 }
 
-int32_t StepperMotor::steps_to_target(float target)
+void StepperMotor::update_last_milestones(float mm, int32_t steps)
 {
-    int32_t target_steps = lroundf(target * steps_per_mm);
-    return target_steps - last_milestone_steps;
+    last_milestone_steps += steps;
+    last_milestone_mm = mm;
 }
 
 // Does a manual step pulse, used for direct encoder control of a stepper
@@ -121,3 +129,14 @@ void StepperMotor::manual_step(bool dir)
     // keep track of actuators actual position in steps
     this->current_position_steps += (dir ? -1 : 1);
 }
+
+// called by the planner with the direction of each new move, returns the number of steps needed to take up the
+// backlash if the direction has reversed. The first move after boot is assumed to be in the same direction as the slack.
+uint32_t StepperMotor::take_up_backlash(bool dir)
+{
+    bool reversed= planned_direction_valid && dir != planned_direction;
+    planned_direction= dir;
+    planned_direction_valid= true;
+    if(!reversed || backlash_mm <= 0) return 0;
+    return std::min(lroundf(backlash_mm * steps_per_mm), 0xFFFFL); // it has to fit in Block::backlash
+}
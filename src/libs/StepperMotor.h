@@ -9,6 +9,9 @@
 
 #include "Module.h"
 #include "Pin.h"
+#include "InputShaper.h"
+
+#include <math.h>
 
 class StepperMotor  : public Module {
     public:
@@ -20,6 +23,8 @@ class StepperMotor  : public Module {
 
         // called from step ticker ISR
         inline bool step() { step_pin.set(1); current_position_steps += (direction?-1:1); return moving; }
+        // called from step ticker ISR, a step that takes up backlash so does not change the position
+        inline bool slack_step() { step_pin.set(1); return moving; }
         // called from unstep ISR
         inline void unstep() { step_pin.set(0); }
         // called from step ticker ISR
@@ -41,6 +46,7 @@ class StepperMotor  : public Module {
         void change_last_milestone(float);
         void set_last_milestones(float, int32_t);
         void update_last_milestones(float mm, int32_t steps);
+        void rebase_position(float mm, int32_t steps);
         float get_last_milestone(void) const { return last_milestone_mm; }
         int32_t get_last_milestone_steps(void) const { return last_milestone_steps; }
         float get_current_position(void) const { return (float)current_position_steps/steps_per_mm; }
@@ -54,8 +60,17 @@ class StepperMotor  : public Module {
         bool is_extruder() const { return extruder; }
         void set_extruder(bool b) { extruder= b; }
 
-        int32_t steps_to_target(float);
+        // inline as the planner calls it for every actuator of every block
+        int32_t steps_to_target(float target) const { return lroundf(target * steps_per_mm) - last_milestone_steps; }
+
+        void set_backlash(float mm) { backlash_mm= mm; }
+        float get_backlash() const { return backlash_mm; }
+        uint32_t take_up_backlash(bool dir);
+        // after moves that did not go through the planner the slack is on the side it last stepped towards
+        void set_planned_direction_from_last_step() { planned_direction= direction; planned_direction_valid= true; }
 
+        InputShaper& get_input_shaper() { return input_shaper; }
+        const InputShaper& get_input_shaper() const { return input_shaper; }
 
     private:
         void on_halt(void *argument);
@@ -69,6 +84,8 @@ class StepperMotor  : public Module {
         float steps_per_mm;
         float max_rate; // this is not really rate it is in mm/sec, misnamed used in Robot and Extruder
         float acceleration;
+        float backlash_mm;
+        InputShaper input_shaper;
 
         volatile int32_t current_position_steps;
         int32_t last_milestone_steps;
@@ -80,6 +97,8 @@ class StepperMotor  : public Module {
             volatile bool moving:1;
             bool selected:1;
             bool extruder:1;
+            bool planned_direction:1;    // direction of the last move given to the planner
+            bool planned_direction_valid:1;
         };
 };
 
@@ -1,29 +1,23 @@
 #include "StreamOutput.h"
+#include "Format.h"
 
 NullStreamOutput StreamOutput::NullStream;
 
+static void flush_to_stream(void *ctx, const char *s)
+{
+    static_cast<StreamOutput *>(ctx)->puts(s);
+}
+
 int StreamOutput::printf(const char *format, ...)
 {
-    char b[64];
-    char *buffer;
-    // Make the message
+    // the message is formatted a chunk at a time straight to puts(), so nothing is allocated however long it is.
+    // a message longer than the chunk reaches puts() as several calls of up to 63 characters each, where it used to be
+    // one call with the whole message in a heap buffer, the streams queue them in order so the output is the same
+    char chunk[64];
     va_list args;
     va_start(args, format);
-
-    int size = vsnprintf(b, 64, format, args) + 1; // we add one to take into account space for the terminating \0
-
-    if (size < 64) {
-        buffer = b;
-    } else {
-        buffer = new char[size];
-        vsnprintf(buffer, size, format, args);
-    }
+    int n = vformat(chunk, sizeof(chunk), flush_to_stream, this, format, args);
     va_end(args);
 
-    puts(buffer);
-
-    if (buffer != b)
-        delete[] buffer;
-
-    return size - 1;
+    return n;
 }
@@ -2,3 +2,4 @@
 
 MemoryPool* _AHB0;
 MemoryPool* _AHB1;
+MemoryPool* _CCM;
@@ -3,10 +3,14 @@
 
 #include "MemoryPool.h"
 
+// AHB0 is SRAM1 and AHB1 is SRAM2, both reachable by DMA.
+// CCM is the core coupled RAM, zero wait state but not reachable by DMA, used for the data the step interrupts touch
 #define AHB0 (*_AHB0)
 #define AHB1 (*_AHB1)
+#define CCM  (*_CCM)
 
 extern MemoryPool* _AHB0;
 extern MemoryPool* _AHB1;
+extern MemoryPool* _CCM;
 
 #endif /* _PLATFORM_MEMORY_H */
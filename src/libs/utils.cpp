@@ -10,6 +10,7 @@
 //#include "system_LPC17xx.h"
 //#include "LPC17xx.h"
 #include "utils.h"
+#include "Format.h"
 
 #include <string>
 #include <cstring>
@@ -145,6 +146,13 @@ string get_arguments( const string& possible_command )
 // Returns true if the file exists
 bool file_exists( const string file_name )
 {
+#ifdef HOST_BUILD
+    // the host build has /sd/ as a directory, see src/host/HostFiles.cpp, so the config can be read from there
+    FILE *lp = fopen(file_name.c_str(), "r");
+    if(lp == NULL) return false;
+    fclose(lp);
+    return true;
+#endif
     return false; // hopefully this pre-empts all fs related calls
 /*    bool exists = false;
     FILE *lp = fopen(file_name.c_str(), "r");
@@ -251,7 +259,13 @@ int append_parameters(char *buf, std::vector<std::pair<char,float>> params, size
     for(auto &i : params) {
         if(n >= bufsize) break;
         buf[n++]= i.first;
-        n += snprintf(&buf[n], bufsize-n, "%1.4f ", i.second);
+        if(bufsize - n < FORMAT_FIXED_MAX + 1) {
+            n += snprintf(&buf[n], bufsize-n, "%1.4f ", i.second);
+            continue;
+        }
+        n += format_fixed(&buf[n], i.second, 4);
+        buf[n++]= ' ';
+        buf[n]= '\0';
     }
     return n;
 }
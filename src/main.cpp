@@ -13,6 +13,7 @@
 #include "modules/tools/temperaturecontrol/TemperatureControlPool.h"
 #include "modules/tools/endstops/Endstops.h"
 #include "modules/tools/zprobe/ZProbe.h"
+#include "modules/tools/xycompensation/XYCompensation.h"
 #include "modules/tools/scaracal/SCARAcal.h"
 #include "RotaryDeltaCalibration.h"
 #include "modules/tools/switch/SwitchPool.h"
@@ -22,10 +23,14 @@
 #include "MotorDriverControl.h"
 
 #include "modules/robot/Conveyor.h"
+#include "modules/robot/AuxMotion.h"
+#include "modules/robot/PositionStrobe.h"
 #include "modules/utils/simpleshell/SimpleShell.h"
 #include "modules/utils/configurator/Configurator.h"
 #include "modules/utils/currentcontrol/CurrentControl.h"
 #include "modules/utils/player/Player.h"
+#include "modules/utils/macros/Macros.h"
+#include "modules/utils/jobbuffer/JobBuffer.h"
 #include "modules/utils/killbutton/KillButton.h"
 #include "modules/utils/PlayLed/PlayLed.h"
 #include "modules/utils/panel/Panel.h"
@@ -151,9 +156,14 @@ void init() {
     tp->load_tools();
     delete tp;
     #endif
+    kernel->add_module( new(AHB0) AuxMotion() );
+    kernel->add_module( new(AHB0) PositionStrobe() );
     #ifndef NO_TOOLS_ENDSTOPS
     kernel->add_module( new(AHB0) Endstops() );
     #endif
+    #ifndef NO_TOOLS_XYCOMPENSATION
+    kernel->add_module( new(AHB0) XYCompensation() );
+    #endif
     #ifndef NO_TOOLS_LASER
     kernel->add_module( new Laser() );
     #endif
@@ -163,6 +173,12 @@ void init() {
     delete sm;
     //kernel->add_module( new(AHB0) Spindle() );
     #endif
+    #ifndef NO_UTILS_MACROS
+    kernel->add_module( new(AHB0) Macros() );
+    #endif
+    #ifndef NO_UTILS_JOBBUFFER
+    kernel->add_module( new(AHB0) JobBuffer() );
+    #endif
     #ifndef NO_UTILS_PANEL
     kernel->add_module( new(AHB0) Panel() );
     #endif
@@ -236,23 +252,8 @@ void init() {
         //leds[3]= sdok?1:0; // 4th led indicates sdcard is available (TODO maye should indicate config was found)
     }
 
-    /*if(sdok) {
-        // load config override file if present
-        // NOTE only Mxxx commands that set values should be put in this file. The file is generated by M500
-        FILE *fp= fopen(kernel->config_override_filename(), "r");
-        if(fp != NULL) {
-            char buf[132];
-            kernel->streams->printf("Loading config override file: %s...\n", kernel->config_override_filename());
-            while(fgets(buf, sizeof buf, fp) != NULL) {
-                kernel->streams->printf("  %s", buf);
-                if(buf[0] == ';') continue; // skip the comments
-                struct SerialMessage message= {&(StreamOutput::NullStream), buf};
-                kernel->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
-            }
-            kernel->streams->printf("config override file executed\n");
-            fclose(fp);
-        }
-    }*/
+    // restore the settings saved with M500, modules that own other stored settings restore them when loaded
+    THEROBOT->restore_settings();
 
     // start the timers and interrupts
     THEKERNEL->conveyor->start(THEROBOT->get_number_registered_motors());
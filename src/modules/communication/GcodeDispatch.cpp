@@ -17,16 +17,22 @@
 #include "libs/StreamOutputPool.h"
 #include "libs/FileStream.h"
 #include "libs/AppendFileStream.h"
+#include "libs/StringStream.h"
+#include "libs/FlashStore.h"
+#include "libs/LatencyStats.h"
 #include "Config.h"
 #include "checksumm.h"
 #include "ConfigValue.h"
 #include "PublicDataRequest.h"
 #include "PublicData.h"
 #include "SimpleShell.h"
+#include "modules/utils/macros/MacrosPublicAccess.h"
 #include "utils.h"
 #include "stm32f4xx.h"
 #include "version.h"
 
+#include <algorithm>
+
 #define panel_display_message_checksum CHECKSUM("display_message")
 #define panel_checksum             CHECKSUM("panel")
 
@@ -156,12 +162,16 @@ try_again:
                     // Prepare gcode for dispatch
                     Gcode *gcode = new Gcode(single_command, new_message.stream);
 
+                    // nothing runs while a decelerated halt ramps down, after that it is halted
+                    while(THEKERNEL->is_halt_pending()) THEKERNEL->call_event(ON_IDLE, this);
+
                     if(THEKERNEL->is_halted()) {
                         // we ignore all commands until M999, unless it is in the exceptions list (like M105 get temp)
                         if(gcode->has_m && gcode->m == 999) {
                             if(THEKERNEL->is_halted()) {
+                                bool kept= THEKERNEL->is_halt_position_kept();
                                 THEKERNEL->call_event(ON_HALT, (void *)1); // clears on_halt
-                                new_message.stream->printf("WARNING: After HALT you should HOME as position is currently unknown\n");
+                                if(!kept) new_message.stream->printf("WARNING: After HALT you should HOME as position is currently unknown\n");
                             }
                             new_message.stream->printf("ok\n");
                             delete gcode;
@@ -215,6 +225,7 @@ try_again:
                             if(!sent_ok) {
                                 sent_ok= true;
                                 new_message.stream->printf("ok\n");
+                                THEKERNEL->latency_stats->line_ok();
                             }
                         }
 
@@ -261,6 +272,14 @@ try_again:
 
                             case 112: // emergency stop, do the best we can with this
                                 // this is also handled out-of-band (it is now with ^X in the serial driver)
+                                if(gcode->subcode == 1) {
+                                    // M112.1 decelerates to a stop first so the position is kept, then halts
+                                    THEKERNEL->decelerated_halt();
+                                    while(THEKERNEL->is_halt_pending()) THEKERNEL->call_event(ON_IDLE, this);
+                                    THEKERNEL->streams->printf("ok Controlled Stop, position kept - M999 required to exit HALT state\r\n");
+                                    delete gcode;
+                                    return;
+                                }
                                 // disables heaters and motors, ignores further incoming Gcode and clears block queue
                                 THEKERNEL->call_event(ON_HALT, nullptr);
                                 THEKERNEL->streams->printf("ok Emergency Stop Requested - reset or M999 required to exit HALT state\r\n");
@@ -270,7 +289,7 @@ try_again:
                             case 115: { // M115 Get firmware version and capabilities
                                 Version vers;
 
-                                new_message.stream->printf("FIRMWARE_NAME:Smoothieware, FIRMWARE_URL:http%%3A//smoothieware.org, X-SOURCE_CODE_URL:https%%3A//github.com/vespaman/Smoothieware-CHMT, FIRMWARE_VERSION:%s, X-FIRMWARE_BUILD_DATE:%s, X-SYSTEM_CLOCK:%ldMHz, X-AXES:%d, X-PAXES:%d, X-GRBL_MODE:%d, X-SERIAL_FLOW:%s", vers.get_build(), vers.get_build_date(), SystemCoreClock / 1000000, MAX_ROBOT_ACTUATORS, N_PRIMARY_AXIS, THEKERNEL->is_grbl_mode(), THEKERNEL->has_serial_rts_cts_handshake()?"RTS/CTS":"NONE");
+                                new_message.stream->printf("FIRMWARE_NAME:Smoothieware, FIRMWARE_URL:http%%3A//smoothieware.org, X-SOURCE_CODE_URL:https%%3A//github.com/vespaman/Smoothieware-CHMT, FIRMWARE_VERSION:%s, X-FIRMWARE_BUILD_DATE:%s, X-SYSTEM_CLOCK:%luMHz, X-AXES:%d, X-PAXES:%d, X-GRBL_MODE:%d, X-SERIAL_FLOW:%s", vers.get_build(), vers.get_build_date(), (unsigned long)(SystemCoreClock / 1000000), MAX_ROBOT_ACTUATORS, N_PRIMARY_AXIS, THEKERNEL->is_grbl_mode(), THEKERNEL->has_serial_rts_cts_handshake()?"RTS/CTS":"NONE");
 
                                 #ifdef CNC
                                 new_message.stream->printf(", X-CNC:1");
@@ -297,6 +316,22 @@ try_again:
                                 return;
                             }
 
+                            case 840: // M840 name cmd|cmd|... defines a macro, the rest of the line is the body so it must not be split into commands
+                            {
+                                macro_definition d;
+                                string str= single_command + possible_command;
+                                d.text= str.substr(std::min(str.size(), str.find_first_not_of("M0123456789.")));
+                                d.stream= new_message.stream;
+                                d.append= gcode->subcode == 1;
+                                d.ok= false;
+                                // without the macros module it is left to the modules like any other M code
+                                if(!PublicData::set_value(macros_checksum, define_macro_checksum, &d)) break;
+                                delete gcode;
+                                // the error has been reported, an ok would tell the host it worked
+                                if(d.ok) new_message.stream->printf("ok\r\n");
+                                return;
+                            }
+
                             case 1000: // M1000 is a special command that will pass thru the raw lowercased command to the simpleshell (for hosts that do not allow such things)
                             {
                                 // reconstruct entire command line again
@@ -321,24 +356,26 @@ try_again:
                                 return;
                             }
 
-                            case 500: // M500 save volatile settings to config-override
-                                THEKERNEL->conveyor->wait_for_idle(); //just to be safe as it can take a while to run
-                                //remove(THEKERNEL->config_override_filename()); // seems to cause a hang every now and then
-                                __disable_irq();
-                                {
-                                    FileStream fs(THEKERNEL->config_override_filename());
-                                    fs.printf("; DO NOT EDIT THIS FILE\n");
-                                    // this also will truncate the existing file instead of deleting it
-                                }
-                                // replace stream with one that writes to config-override file
-                                gcode->stream = new AppendFileStream(THEKERNEL->config_override_filename());
-                                // dispatch the M500 here so we can free up the stream when done
+                            case 500: { // M500 save volatile settings to the flash store
+                                // modules put their values in the flash store and print only the settings they can not store
+                                StringStream not_stored;
+                                gcode->stream = &not_stored;
                                 THEKERNEL->call_event(ON_GCODE_RECEIVED, gcode );
-                                delete gcode->stream;
                                 delete gcode;
-                                __enable_irq();
-                                new_message.stream->printf("Settings Stored to %s\r\nok\r\n", THEKERNEL->config_override_filename());
+                                // programming stalls any code running from flash so wait for motion to stop, ok only once it is written
+                                THECONVEYOR->wait_for_idle();
+                                if(!THEKERNEL->flash_store->flush()) {
+                                    new_message.stream->printf("%sSettings not stored, flash write failed\r\n", THEKERNEL->is_grbl_mode() ? "error:" : "Error: ");
+                                    return;
+                                }
+                                new_message.stream->printf("Settings Stored to flash\r\n");
+                                if(!not_stored.getOutput().empty()) {
+                                    new_message.stream->printf(";These are not stored, set them in config:\r\n");
+                                    new_message.stream->puts(not_stored.getOutput().c_str());
+                                }
+                                new_message.stream->printf("ok\r\n");
                                 continue;
+                            }
 
                             case 501: // load config override
                             case 504: // save to specific config override file
@@ -353,20 +390,24 @@ try_again:
                                 new_message.stream->printf("ok\r\n");
                                 return;
 
-                            case 502: // M502 deletes config-override so everything defaults to what is in config
-                                remove(THEKERNEL->config_override_filename());
+                            case 502: // M502 clears the flash store so everything defaults to what is in config
                                 delete gcode;
-                                new_message.stream->printf("config override file deleted %s, reboot needed\r\nok\r\n", THEKERNEL->config_override_filename());
+                                THECONVEYOR->wait_for_idle();
+                                THEKERNEL->flash_store->clear();
+                                if(!THEKERNEL->flash_store->flush()) {
+                                    new_message.stream->printf("%sStored settings not cleared, flash write failed\r\n", THEKERNEL->is_grbl_mode() ? "error:" : "Error: ");
+                                    return;
+                                }
+                                new_message.stream->printf("stored settings cleared, reboot needed\r\nok\r\n");
                                 continue;
 
-                            case 503: { // M503 display live settings and indicates if there is an override file
-                                FILE *fd = fopen(THEKERNEL->config_override_filename(), "r");
-                                if(fd != NULL) {
-                                    fclose(fd);
-                                    new_message.stream->printf("; config override present: %s\n",  THEKERNEL->config_override_filename());
+                            case 503: { // M503 display live settings and indicates if there are stored settings
+                                FlashStore *store= THEKERNEL->flash_store;
+                                if(store->get_count() > 0 || store->is_pending()) {
+                                    new_message.stream->printf("; stored settings: %u, flash used %u of %u bytes%s\n", (unsigned)store->get_count(), (unsigned)store->get_used(), (unsigned)store->get_size(), store->is_pending() ? ", write pending" : "");
 
                                 } else {
-                                    new_message.stream->printf("; No config override\n");
+                                    new_message.stream->printf("; No stored settings\n");
                                 }
                                 gcode->add_nl= true;
                                 break; // fall through to process by modules
@@ -422,6 +463,8 @@ try_again:
                                 new_message.stream->printf("ok\r\n");
                             }
                         }
+
+                        if(possible_command.empty()) THEKERNEL->latency_stats->line_ok();
                     }
 
                     delete gcode;
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <stdarg.h>
+#include <math.h>
 using std::string;
 #include "libs/Module.h"
 #include "libs/Kernel.h"
@@ -16,6 +17,12 @@ using std::string;
 #include "libs/SerialMessage.h"
 #include "libs/StreamOutput.h"
 #include "libs/StreamOutputPool.h"
+#include "libs/StepTicker.h"
+#include "FlightRecorder.h"
+#include "LatencyStats.h"
+#include "us_ticker_api.h"
+#include "cmsis.h"
+#include "Planner.h"
 
 // Serial reading module
 // Treats every received line as a command and passes it ( via event call ) to the command dispatcher.
@@ -31,7 +38,13 @@ void SerialConsole::on_module_loaded() {
     this->serial->attach(this, &SerialConsole::on_serial_char_received, mbed::Serial::RxIrq);
     query_flag= false;
     halt_flag= false;
+    hold_flag= false;
+    resume_flag= false;
+    override_reset_flag= false;
+    override_change= 0;
     rx_data_held_flag = false;
+    lines_received= 0;
+    lines_read= 0;
 
     // We only call the command dispatcher in the main loop, nowhere else
     this->register_for_event(ON_MAIN_LOOP);
@@ -49,17 +62,11 @@ void SerialConsole::on_serial_char_received(){
         if ( (this->buffer.capacity())-this->buffer.size() > 0 )
         {
             char received = this->serial->getrx();
-            if(received == '?') {
-                query_flag= true;
-                continue;
-            }
-            if(received == 'X'-'A'+1) { // ^X
-                halt_flag= true;
-                continue;
-            }
+            if(realtime_char(received)) continue;
             // convert CR to NL (for host OSs that don't send NL)
             if( received == '\r' ){ received = '\n'; }
             this->buffer.push_back(received);
+            if( received == '\n' ){ line_received(); }
             
         }
         else // Buffer is full, defer until we dealt with some..
@@ -75,15 +82,84 @@ void SerialConsole::on_serial_char_received(){
     }
 }
 
+// a newline went in the buffer, from the rx interrupt or when held data is read
+void SerialConsole::line_received()
+{
+    THEKERNEL->flight_recorder->record(FlightRecorder::RECEIVE, this->buffer.size());
+    if(THEKERNEL->latency_stats->is_enabled()) line_rx_us[lines_received % k_line_times]= us_ticker_read();
+    lines_received++;
+}
+
+// real time characters are acted on as soon as they arrive and do not go in the buffer, returns true if c was one
+bool SerialConsole::realtime_char(char c)
+{
+    if(c == '?') {
+        query_flag= true;
+        return true;
+    }
+    if(c == 'X'-'A'+1) { // ^X
+        halt_flag= true;
+        return true;
+    }
+
+    if(THEKERNEL->is_grbl_mode() || THEKERNEL->is_feed_hold_enabled()) {
+        // the step ticker starts ramping down or up right away, the kernel state follows in on_idle
+        if(c == '!') { // feed hold
+            THEKERNEL->step_ticker->decelerate_to_stop();
+            hold_flag= true;
+            return true;
+        }
+        if(c == '~') { // resume
+            THEKERNEL->step_ticker->resume();
+            resume_flag= true;
+            return true;
+        }
+
+        // grbl's feed override characters, the queued blocks have to be replanned so it is done in on_idle
+        switch((uint8_t)c) {
+            case 0x90: override_reset_flag= true; override_change= 0; return true;
+            case 0x91: override_change += 10; return true;
+            case 0x92: override_change -= 10; return true;
+            case 0x93: override_change += 1; return true;
+            case 0x94: override_change -= 1; return true;
+        }
+    }
+
+    return false;
+}
+
 void SerialConsole::on_idle(void * argument)
 {
     if(query_flag) {
         query_flag= false;
         puts(THEKERNEL->get_query_string().c_str());
     }
+    if(hold_flag) {
+        hold_flag= false;
+        THEKERNEL->set_feed_hold(true);
+    }
+    if(resume_flag) {
+        resume_flag= false;
+        THEKERNEL->set_feed_hold(false);
+    }
+    if(override_reset_flag || override_change != 0) {
+        // the serial interrupt adds to these, so they are taken and cleared with it masked
+        __disable_irq();
+        bool reset= override_reset_flag;
+        int16_t change= override_change;
+        override_reset_flag= false;
+        override_change= 0;
+        __enable_irq();
+        float percent= reset ? 100 : roundf(THEKERNEL->planner->get_speed_override() * 100);
+        THEKERNEL->planner->set_speed_override((percent + change) / 100);
+    }
     if(halt_flag) {
         halt_flag= false;
-        THEKERNEL->call_event(ON_HALT, nullptr);
+        if(THEKERNEL->is_decelerate_on_halt()) {
+            THEKERNEL->decelerated_halt();
+        } else {
+            THEKERNEL->call_event(ON_HALT, nullptr);
+        }
         if(THEKERNEL->is_grbl_mode()) {
             puts("ALARM: Abort during cycle\r\n");
         } else {
@@ -101,10 +177,16 @@ void SerialConsole::on_main_loop(void * argument){
            char c;
            this->buffer.pop_front(c);
            if( c == '\n' ){
+                // the time is lost if more lines were received since than are kept
+                uint32_t rx_us= lines_received - lines_read <= (uint32_t)k_line_times ? line_rx_us[lines_read % k_line_times] : 0;
+                lines_read++;
+
                 struct SerialMessage message;
                 message.message = received;
                 message.stream = this;
+                THEKERNEL->latency_stats->set_line_received(rx_us);
                 THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
+                THEKERNEL->latency_stats->set_line_received(0);
                 return;
             }else{
                 received += c;
@@ -116,16 +198,13 @@ void SerialConsole::on_main_loop(void * argument){
     {
 #if 1
         char received = rx_save;
-        if(received == '?') {
-            query_flag= true;
-        }
-        else if(received == 'X'-'A'+1) { // ^X
-            halt_flag= true;
-        }
-        else if( received == '\r' ) { 
-            received = '\n'; 
+        if(!realtime_char(received)) {
+            if( received == '\r' ) {
+                received = '\n';
+            }
+            this->buffer.push_back(received);
+            if( received == '\n' ){ line_received(); }
         }
-        this->buffer.push_back(received);
 #endif
         // enable interrupt again
         rx_data_held_flag = false;
@@ -29,6 +29,8 @@ class SerialConsole : public Module, public StreamOutput {
         void on_main_loop(void * argument);
         void on_idle(void * argument);
         bool has_char(char letter);
+        bool realtime_char(char c);
+        void line_received();
 
         int _putc(int c);
         int _getc(void);
@@ -38,11 +40,19 @@ class SerialConsole : public Module, public StreamOutput {
         RingBuffer<char,256> buffer;             // Receive buffer
         mbed::Serial* serial;
         char rx_save;
-        struct {
-          bool query_flag:1;
-          bool halt_flag:1;
-          bool rx_data_held_flag:1;
-        };
+        // when the last lines were received for LatencyStats, by line number modulo their number
+        static const int k_line_times= 16;
+        uint32_t line_rx_us[k_line_times];
+        volatile uint32_t lines_received;
+        uint32_t lines_read;
+        volatile int16_t override_change;        // speed override change in %, applied in on_idle
+        // set by the receive interrupt and cleared in the main loop, so not bitfields sharing a word
+        volatile bool query_flag;
+        volatile bool halt_flag;
+        volatile bool hold_flag;
+        volatile bool resume_flag;
+        volatile bool override_reset_flag;
+        volatile bool rx_data_held_flag;
 };
 
 #endif
@@ -0,0 +1,157 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AuxMotion.h"
+
+#include "libs/Kernel.h"
+#include "Conveyor.h"
+#include "StepTicker.h"
+#include "StepperMotor.h"
+#include "MotorChannel.h"
+#include "Pin.h"
+#include "Gcode.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "StreamOutputPool.h"
+#include "ActuatorCoordinates.h"
+
+#include <ctype.h>
+
+#define aux_motion_checksum                  CHECKSUM("aux_motion")
+#define enable_checksum                      CHECKSUM("enable")
+#define letter_checksum                      CHECKSUM("letter")
+#define step_pin_checksum                    CHECKSUM("step_pin")
+#define dir_pin_checksum                     CHECKSUM("dir_pin")
+#define en_pin_checksum                      CHECKSUM("en_pin")
+#define steps_per_mm_checksum                CHECKSUM("steps_per_mm")
+#define max_rate_checksum                    CHECKSUM("max_rate")
+#define acceleration_checksum                CHECKSUM("acceleration")
+#define default_feed_rate_checksum           CHECKSUM("default_feed_rate")
+
+AuxMotion::AuxMotion()
+{
+}
+
+void AuxMotion::on_module_loaded()
+{
+    if(!load_channels()) {
+        // as not needed free up resource
+        delete this;
+        return;
+    }
+
+    register_for_event(ON_GCODE_RECEIVED);
+    register_for_event(ON_HALT);
+
+    for(auto c : channels) {
+        THEKERNEL->step_ticker->add_channel(c->channel);
+    }
+}
+
+// aux_motion.<name>.* defines a channel, returns false if none are enabled
+bool AuxMotion::load_channels()
+{
+    std::vector<uint16_t> modules;
+    THEKERNEL->config->get_module_list(&modules, aux_motion_checksum);
+
+    for(auto cs : modules) {
+        if(!THEKERNEL->config->value(aux_motion_checksum, cs, enable_checksum)->by_default(false)->as_bool()) continue;
+
+        std::string s= THEKERNEL->config->value(aux_motion_checksum, cs, letter_checksum)->by_default("")->as_string();
+        char letter= s.empty() ? 0 : toupper(s[0]);
+        if(letter < 'A' || letter > 'Z' || letter == 'F' || letter == 'S') {
+            THEKERNEL->streams->printf("Error: aux_motion channel needs a letter that is not F or S, channel disabled\n");
+            continue;
+        }
+
+        Pin step_pin, dir_pin, en_pin;
+        step_pin.from_string(THEKERNEL->config->value(aux_motion_checksum, cs, step_pin_checksum)->by_default("nc")->as_string())->as_output();
+        dir_pin.from_string( THEKERNEL->config->value(aux_motion_checksum, cs, dir_pin_checksum )->by_default("nc")->as_string())->as_output();
+        en_pin.from_string(  THEKERNEL->config->value(aux_motion_checksum, cs, en_pin_checksum  )->by_default("nc")->as_string())->as_output();
+        if(!step_pin.connected() || !dir_pin.connected()) {
+            THEKERNEL->streams->printf("Error: aux_motion channel %c needs a step and dir pin, channel disabled\n", letter);
+            continue;
+        }
+
+        StepperMotor *motor= new StepperMotor(step_pin, dir_pin, en_pin);
+        // not a robot actuator, keep the id clear of the axis bits used by M18/M84
+        motor->set_motor_id(k_max_actuators + channels.size());
+        motor->change_steps_per_mm(THEKERNEL->config->value(aux_motion_checksum, cs, steps_per_mm_checksum)->by_default(80)->as_number());
+        motor->set_max_rate(THEKERNEL->config->value(aux_motion_checksum, cs, max_rate_checksum)->by_default(30000)->as_number() / 60.0F); // mm/min converted to mm/sec
+        motor->set_acceleration(THEKERNEL->config->value(aux_motion_checksum, cs, acceleration_checksum)->by_default(1000)->as_number()); // mm/sec²
+
+        channel_t *c= new channel_t;
+        c->channel= new MotorChannel(motor);
+        c->rate= THEKERNEL->config->value(aux_motion_checksum, cs, default_feed_rate_checksum)->by_default(6000)->as_number() / 60.0F; // mm/min converted to mm/sec
+        c->letter= letter;
+
+        channels.push_back(c);
+    }
+
+    return !channels.empty();
+}
+
+void AuxMotion::on_halt(void *argument)
+{
+    if(argument == nullptr) {
+        // the ISR drops the queued moves, what was actually stepped is where we are now
+        for(auto c : channels) {
+            StepperMotor *m= c->channel->get_motor();
+            m->change_last_milestone(m->get_current_position());
+        }
+    }
+}
+
+void AuxMotion::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+
+    if(!gcode->has_m) return;
+
+    if(gcode->m == 870) {
+        if(gcode->get_num_args() == 0) {
+            // M870 reports the position of each channel
+            for(auto c : channels) {
+                gcode->stream->printf("%c:%1.4f ", c->letter, c->channel->get_motor()->get_current_position());
+            }
+            gcode->stream->printf("%s\n", is_idle() ? "idle" : "moving");
+            return;
+        }
+
+        // S1 holds the moves until the block queue has finished everything queued before this
+        if(gcode->has_letter('S') && gcode->get_value('S') != 0) {
+            THECONVEYOR->wait_for_idle();
+        }
+
+        for(auto c : channels) {
+            if(!gcode->has_letter(c->letter)) continue;
+            if(gcode->has_letter('F')) c->rate= gcode->get_value('F') / 60.0F; // F is modal for the channel
+            c->channel->move(gcode->get_value(c->letter), c->rate, c->channel->get_motor()->get_acceleration());
+        }
+
+    } else if(gcode->m == 400) {
+        // the block queue has already been waited for by Robot
+        wait_for_idle();
+    }
+}
+
+bool AuxMotion::is_idle() const
+{
+    for(auto c : channels) {
+        if(!c->channel->is_idle()) return false;
+    }
+    return true;
+}
+
+void AuxMotion::wait_for_idle()
+{
+    while(!is_idle()) {
+        THEKERNEL->call_event(ON_IDLE, this);
+        if(THEKERNEL->is_halted()) return;
+    }
+}
@@ -0,0 +1,45 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "libs/Module.h"
+
+class MotorChannel;
+class Gcode;
+
+// Motion channels for auxiliary actuators (tape peeler, feeder drive) that run independently of the block queue.
+// Each channel is a MotorChannel with its own small queue of moves with a simple rest to rest trapezoid, stepped from
+// the step ticker interrupt alongside whatever block is running, so a peel can overlap the XY move to the next feeder.
+// M870 L2 F6000 queues a relative move on the channel with letter L and returns right away, S1 waits for the
+// block queue to empty first, M400 waits for the channels as well as the block queue.
+class AuxMotion : public Module {
+    public:
+        AuxMotion();
+
+        void on_module_loaded();
+        void on_gcode_received(void *argument);
+        void on_halt(void *argument);
+
+        bool is_idle() const;
+        void wait_for_idle();
+
+    private:
+        struct channel_t {
+            MotorChannel *channel;
+            float rate;                  // default rate mm/sec
+            char letter;
+        };
+
+        bool load_channels();
+
+        std::vector<channel_t*> channels;
+};
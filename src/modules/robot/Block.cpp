@@ -16,6 +16,9 @@
 #include "Gcode.h"
 #include "libs/StreamOutputPool.h"
 #include "StepTicker.h"
+#include "Robot.h"
+#include "StepperMotor.h"
+#include "InputShaper.h"
 #include "platform_memory.h"
 
 #include "mri.h"
@@ -26,6 +29,7 @@ using std::string;
 #define STEP_TICKER_FREQUENCY THEKERNEL->step_ticker->get_frequency()
 
 uint8_t Block::n_actuators= 0;
+uint8_t Block::max_shaper_events= 0;
 double Block::fp_scale= 0;
 
 // A block represents a movement, it's length for each stepper motor, and the corresponding acceleration curves.
@@ -36,6 +40,7 @@ double Block::fp_scale= 0;
 Block::Block()
 {
     tick_info= nullptr;
+    shaper_events= nullptr;
     clear();
 }
 
@@ -43,6 +48,15 @@ void Block::init(uint8_t n)
 {
     n_actuators= n;
     fp_scale= (double)STEPTICKER_FPSCALE / pow((double)STEP_TICKER_FREQUENCY, 2.0); // we scale up by fixed point offset first to avoid tiny values
+
+    // the blocks only get room for the shaper events if any actuator has an input shaper configured
+    max_shaper_events= 0;
+    for (uint8_t m = 0; m < n; ++m) {
+        if(THEROBOT->actuators[m]->get_input_shaper().get_type() != InputShaper::NONE) {
+            // a start and an end for each impulse of the acceleration and of the deceleration, and the final one
+            max_shaper_events= 4 * InputShaper::max_impulses + 1;
+        }
+    }
 }
 
 void Block::clear()
@@ -50,6 +64,7 @@ void Block::clear()
     is_ready            = false;
 
     this->steps.fill(0);
+    this->backlash.fill(0);
 
     steps_event_count   = 0;
     nominal_rate        = 0.0F;
@@ -65,17 +80,30 @@ void Block::clear()
     recalculate_flag    = false;
     nominal_length_flag = false;
     max_entry_speed     = 0.0F;
+    max_override        = 2.0F;
     is_ticking          = false;
     is_g123             = false;
+    uncoordinated       = false;
     locked              = false;
     s_value             = 0.0F;
+    shaper              = nullptr;
+    n_shaper_events     = 0;
+    queued_us           = 0;
+    is_finished         = false;
 
     total_move_ticks= 0;
     if(tick_info == nullptr) {
-        // we create this once for this block
-        tick_info= new tickinfo_t[n_actuators]; //(tickinfo_t *)malloc(sizeof(tickinfo_t) * n_actuators);
+        // we create this once for this block, in CCM as it is used by the step interrupt
+        tick_info= (tickinfo_t *)CCM.alloc(sizeof(tickinfo_t) * n_actuators);
         if(tick_info == nullptr) {
-            // if we ran out of memory in AHB0 just stop here
+            // if we ran out of memory in CCM just stop here
+            __debugbreak();
+        }
+    }
+
+    if(shaper_events == nullptr && max_shaper_events > 0) {
+        shaper_events= (shaper_event_t *)CCM.alloc(sizeof(shaper_event_t) * max_shaper_events);
+        if(shaper_events == nullptr) {
             __debugbreak();
         }
     }
@@ -89,24 +117,27 @@ void Block::clear()
         tick_info[i].steps_to_move= 0;
         tick_info[i].step_count= 0;
         tick_info[i].next_accel_event= 0;
+        tick_info[i].accelerate_until= 0;
+        tick_info[i].decelerate_after= 0;
+        tick_info[i].backlash_steps= 0;
     }
 }
 
 void Block::debug() const
 {
-    THEKERNEL->streams->printf("%p: steps-X:%lu Y:%lu Z:%lu ", this, this->steps[0], this->steps[1], this->steps[2]);
+    THEKERNEL->streams->printf("%p: steps-X:%lu Y:%lu Z:%lu ", this, (unsigned long)this->steps[0], (unsigned long)this->steps[1], (unsigned long)this->steps[2]);
     for (size_t i = E_AXIS; i < n_actuators; ++i) {
-        THEKERNEL->streams->printf("%c:%lu ", 'A' + i-E_AXIS, this->steps[i]);
+        THEKERNEL->streams->printf("%c:%lu ", (int)('A' + i-E_AXIS), (unsigned long)this->steps[i]);
     }
     THEKERNEL->streams->printf("(max:%lu) nominal:r%1.4f/s%1.4f mm:%1.4f acc:%1.2f accu:%lu decu:%lu ticks:%lu rates:%1.4f/%1.4f entry/max:%1.4f/%1.4f exit:%1.4f primary:%d ready:%d locked:%d ticking:%d recalc:%d nomlen:%d time:%f\r\n",
-                               this->steps_event_count,
+                               (unsigned long)this->steps_event_count,
                                this->nominal_rate,
                                this->nominal_speed,
                                this->millimeters,
                                this->acceleration,
-                               this->accelerate_until,
-                               this->decelerate_after,
-                               this->total_move_ticks,
+                               (unsigned long)this->accelerate_until,
+                               (unsigned long)this->decelerate_after,
+                               (unsigned long)this->total_move_ticks,
                                this->initial_rate,
                                this->maximum_rate,
                                this->entry_speed,
@@ -137,6 +168,15 @@ void Block::calculate_trapezoid( float entryspeed, float exitspeed )
     // if block is currently executing, don't touch anything!
     if (is_ticking) return;
 
+    if(uncoordinated) {
+        // always from rest to rest, but the speed override may have changed
+        this->locked= true;
+        this->exit_speed = 0;
+        prepare_uncoordinated();
+        this->locked= false;
+        return;
+    }
+
     float initial_rate = this->nominal_rate * (entryspeed / this->nominal_speed); // steps/sec
     float final_rate = this->nominal_rate * (exitspeed / this->nominal_speed);
     //printf("Initial rate: %f, final_rate: %f\n", initial_rate, final_rate);
@@ -177,6 +217,17 @@ void Block::calculate_trapezoid( float entryspeed, float exitspeed )
         plateau_time = plateau_distance / this->maximum_rate;
     }
 
+    // an input shaped block has a time line of its own, if it can not be shaped without slowing down it is not
+    if(this->shaper != nullptr && this->shaper_events != nullptr && this->shaper->is_enabled()) {
+        this->locked= true;
+        if(prepare_shaped(initial_rate, final_rate, time_to_accelerate, time_to_decelerate)) {
+            this->exit_speed = exitspeed;
+            this->locked= false;
+            return;
+        }
+        this->locked= false;
+    }
+
     // Figure out how long the move takes total ( in seconds )
     float total_move_time = time_to_accelerate + time_to_decelerate + plateau_time;
     //puts "total move time: #{total_move_time}s time to accelerate: #{time_to_accelerate}, time to decelerate: #{time_to_decelerate}"
@@ -217,6 +268,7 @@ void Block::calculate_trapezoid( float entryspeed, float exitspeed )
 
     this->initial_rate = initial_rate;
     this->exit_speed = exitspeed;
+    this->n_shaper_events = 0;
 
     // prepare the block for stepticker
     this->prepare(acceleration_in_steps, deceleration_in_steps);
@@ -289,6 +341,10 @@ float Block::max_exit_speed()
     if(is_ticking)
         return this->exit_speed;
 
+    // it stops at the end whatever comes next
+    if(uncoordinated)
+        return 0;
+
     // if nominal_length_flag is asserted
     // we are guaranteed to reach nominal speed regardless of entry speed
     // thus, max exit will always be nominal
@@ -320,6 +376,7 @@ void Block::prepare(float acceleration_in_steps, float deceleration_in_steps)
         uint32_t steps = this->steps[m];
         this->tick_info[m].steps_to_move = steps;
         if(steps == 0) continue;
+        this->tick_info[m].backlash_steps = this->backlash[m];
 
         float aratio = inv * steps;
 
@@ -327,6 +384,8 @@ void Block::prepare(float acceleration_in_steps, float deceleration_in_steps)
         this->tick_info[m].counter = 0; // 2.62 fixed point
         this->tick_info[m].step_count = 0;
         this->tick_info[m].next_accel_event = this->total_move_ticks + 1;
+        this->tick_info[m].accelerate_until = this->accelerate_until;
+        this->tick_info[m].decelerate_after = this->decelerate_after;
 
         double acceleration_change = 0;
         if(this->accelerate_until != 0) { // If the next accel event is the end of accel
@@ -363,6 +422,171 @@ void Block::prepare(float acceleration_in_steps, float deceleration_in_steps)
     }
 }
 
+// prepare an uncoordinated block, each motor gets a rest to rest trapezoid of its own at the max_rate and acceleration
+// of its actuator, so it takes as long as that motor alone needs. The block is done when the slowest motor is.
+void Block::prepare_uncoordinated()
+{
+    float frequency= STEP_TICKER_FREQUENCY;
+    // the step ticker runs the block speed_override times faster, plan it slower so the limits still hold
+    float k= THEKERNEL->planner->get_speed_override();
+    uint32_t longest= 0;
+
+    for (uint8_t m = 0; m < n_actuators; m++) {
+        uint32_t n = this->steps[m];
+        tickinfo_t& ti= this->tick_info[m];
+        ti.steps_to_move = n;
+        if(n == 0) continue;
+        ti.backlash_steps = this->backlash[m];
+        ti.counter = 0;
+        ti.step_count = 0;
+
+        StepperMotor *motor= THEROBOT->actuators[m];
+        float acceleration= motor->get_acceleration();
+        if(isnan(acceleration)) acceleration= THEROBOT->get_default_acceleration();
+        acceleration *= motor->get_steps_per_mm() / (k * k); // steps/sec²
+
+        // the step ticker can issue at most one step per tick
+        float nominal_rate= std::min(std::min(this->nominal_speed, motor->get_max_rate()) * motor->get_steps_per_mm() / k, frequency); // steps/sec
+
+        // the same trapezoid MotorChannel::move plans, a triangle if there are not enough steps to reach the rate
+        float maximum_rate= std::min(nominal_rate, sqrtf(n * acceleration));
+        float time_to_accelerate= maximum_rate / acceleration;
+        float plateau_time= (n - maximum_rate * time_to_accelerate) / maximum_rate;
+        uint32_t acceleration_ticks= floorf(time_to_accelerate * frequency);
+        uint32_t total_move_ticks= floorf((2.0F * time_to_accelerate + plateau_time) * frequency);
+        longest= std::max(longest, total_move_ticks);
+
+        ti.plateau_rate= (int64_t)round(((double)maximum_rate / frequency) * STEPTICKER_FPSCALE);
+        if(acceleration_ticks == 0) {
+            // too short to ramp, just run at the plateau rate
+            ti.steps_per_tick= ti.plateau_rate;
+            ti.acceleration_change= 0;
+            ti.deceleration_change= 0;
+            ti.accelerate_until= UINT32_MAX;
+            ti.decelerate_after= UINT32_MAX;
+            ti.next_accel_event= UINT32_MAX;
+
+        } else {
+            // adjust the acceleration so the maximum rate is reached in a whole number of ticks
+            double acceleration_per_tick= (maximum_rate / (acceleration_ticks / frequency)) * fp_scale;
+            ti.steps_per_tick= 0;
+            ti.acceleration_change= (int64_t)round(acceleration_per_tick);
+            ti.deceleration_change= -ti.acceleration_change;
+            ti.accelerate_until= acceleration_ticks;
+            ti.decelerate_after= total_move_ticks - acceleration_ticks;
+            ti.next_accel_event= acceleration_ticks;
+        }
+    }
+
+    // for the queue time, the block time line of a coordinated block is not used
+    this->total_move_ticks= longest;
+    this->accelerate_until= 0;
+    this->decelerate_after= longest;
+    this->initial_rate= 0;
+    this->maximum_rate= this->nominal_rate;
+}
+
+// prepare an input shaped block, the trapezoid is convolved with the impulses of the shaper: each impulse gets a copy
+// of the acceleration and of the deceleration ramp, as much smaller as its amplitude and delayed by its time. The rate
+// still goes from the initial rate up to the maximum rate and down to the final rate, but over the shaper duration
+// longer. To cover the same steps the deceleration starts later, by enough to make up for the later acceleration.
+// The acceleration is constant between the starts and ends of the ramp copies, those are the shaper events.
+// Returns false if the block can not be shaped, when the deceleration would have to start before the acceleration
+// ends which can only happen if it does not start and end at rest.
+bool Block::prepare_shaped(float initial_rate, float final_rate, float time_to_accelerate, float time_to_decelerate)
+{
+    float frequency= STEP_TICKER_FREQUENCY;
+    uint32_t ta= floorf(time_to_accelerate * frequency);
+    uint32_t td= floorf(time_to_decelerate * frequency);
+    if(ta == 0 && td == 0) return false; // nothing to shape
+
+    // all in ticks and steps per tick from here
+    float v0= initial_rate / frequency;
+    float vm= this->maximum_rate / frequency;
+    float v1= final_rate / frequency;
+    float dva= vm - v0;
+    float dvd= vm - v1;
+
+    const uint8_t n= shaper->n_impulses;
+    uint32_t impulse[InputShaper::max_impulses];
+    float centre= 0; // of the impulses, weighted by their amplitude
+    for (int i = 0; i < n; ++i) {
+        impulse[i]= lroundf(shaper->impulse_time[i] * frequency);
+        centre += shaper->amplitude[i] * impulse[i];
+    }
+    uint32_t duration= impulse[n - 1];
+
+    // the acceleration takes centre longer to cover its steps, the deceleration loses duration - centre
+    float total= (this->steps_event_count + dva * (centre + ta / 2.0F) + dvd * (td / 2.0F + duration - centre)) / vm;
+    int32_t decelerate_after= lroundf(total) - (int32_t)(td + duration);
+    if(decelerate_after < (int32_t)ta) return false;
+
+    // the ramp copies, each adds its acceleration from its start up to its end
+    struct { uint32_t start, end; float acceleration; } ramp[2 * InputShaper::max_impulses];
+    int nramps= 0;
+    float la= ta > 0 ? dva / ta * STEPTICKER_FPSCALE : 0;
+    float ld= td > 0 ? -dvd / td * STEPTICKER_FPSCALE : 0;
+    for (int i = 0; i < n; ++i) {
+        if(ta > 0) ramp[nramps++]= {impulse[i], impulse[i] + ta, shaper->amplitude[i] * la};
+        if(td > 0) ramp[nramps++]= {decelerate_after + impulse[i], decelerate_after + impulse[i] + td, shaper->amplitude[i] * ld};
+    }
+
+    // the ticks the acceleration changes at in order, with 0 first
+    uint32_t change[4 * InputShaper::max_impulses + 1];
+    int nchanges= 0;
+    change[nchanges++]= 0;
+    for (int r = 0; r < nramps; ++r) {
+        for (uint32_t t : {ramp[r].start, ramp[r].end}) {
+            int j= nchanges;
+            while(j > 0 && change[j - 1] > t) --j;
+            if(j > 0 && change[j - 1] == t) continue;
+            for (int k = nchanges; k > j; --k) change[k]= change[k - 1];
+            change[j]= t;
+            ++nchanges;
+        }
+    }
+
+    // the step ticker adds the acceleration before it looks for an event, so a change at a tick is an event the tick
+    // before. When it stops at the end there is no last event, it keeps decelerating until the steps are done.
+    uint8_t nevents= 0;
+    for (int j = 0; j < nchanges; ++j) {
+        if(j == nchanges - 1 && v1 <= 0) break;
+        float acceleration= 0;
+        for (int r = 0; r < nramps; ++r) {
+            if(ramp[r].start <= change[j] && change[j] < ramp[r].end) acceleration += ramp[r].acceleration;
+        }
+        shaper_events[nevents++]= {j == 0 ? 0 : change[j] - 1, acceleration};
+    }
+    this->n_shaper_events= nevents;
+
+    this->accelerate_until= ta > 0 ? ta + duration : 0;
+    this->decelerate_after= decelerate_after;
+    this->total_move_ticks= decelerate_after + td + duration;
+    this->initial_rate= initial_rate;
+
+    float inv = 1.0F / this->steps_event_count;
+    for (uint8_t m = 0; m < n_actuators; m++) {
+        tickinfo_t& ti= this->tick_info[m];
+        uint32_t steps = this->steps[m];
+        ti.steps_to_move = steps;
+        if(steps == 0) continue;
+        ti.backlash_steps = this->backlash[m];
+
+        float aratio = inv * steps;
+        ti.steps_per_tick= (int64_t)round((((double)initial_rate * aratio) / frequency) * STEPTICKER_FPSCALE);
+        ti.counter= 0;
+        ti.step_count= 0;
+        ti.acceleration_change= (int64_t)(shaper_events[0].acceleration * aratio);
+        ti.deceleration_change= 0;
+        ti.plateau_rate= (int64_t)round(((this->maximum_rate * aratio) / frequency) * STEPTICKER_FPSCALE);
+        ti.accelerate_until= this->accelerate_until;
+        ti.decelerate_after= this->decelerate_after;
+        ti.next_accel_event= nevents > 1 ? shaper_events[1].tick : this->total_move_ticks + 1;
+    }
+
+    return true;
+}
+
 // returns current rate (steps/sec) for the given actuator
 float Block::get_trapezoid_rate(int i) const
 {
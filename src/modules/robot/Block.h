@@ -10,6 +10,8 @@
 #include <bitset>
 #include "ActuatorCoordinates.h"
 
+class InputShaper;
+
 class Block {
     public:
         Block();
@@ -29,11 +31,14 @@ class Block {
     private:
         float max_allowable_speed( float acceleration, float target_velocity, float distance);
         void prepare(float acceleration_in_steps, float deceleration_in_steps);
+        void prepare_uncoordinated();
+        bool prepare_shaped(float initial_rate, float final_rate, float time_to_accelerate, float time_to_decelerate);
 
         static double fp_scale; // optimize to store this as it does not change
 
     public:
         std::array<uint32_t, k_max_actuators> steps; // Number of steps for each axis for this block
+        std::array<uint16_t, k_max_actuators> backlash; // Steps at the start of steps[] that take up backlash
         uint32_t steps_event_count;  // Steps for the longest axis
         float nominal_rate;       // Nominal rate in steps per second
         float nominal_speed;      // Nominal speed in mm per second
@@ -45,6 +50,7 @@ class Block {
         float maximum_rate;
 
         float max_entry_speed;
+        float max_override;       // the highest speed override its nominal speed stays within the actuator limits at
 
         // this is tick info needed for this block. applies to all motors
         uint32_t accelerate_until;
@@ -60,14 +66,32 @@ class Block {
             int64_t deceleration_change; // 2.62 fixed point
             int64_t plateau_rate; // 2.62 fixed point
             uint32_t steps_to_move;
+            uint32_t backlash_steps; // issued first and not counted in the motor position
             uint32_t step_count;
             uint32_t next_accel_event;
+            uint32_t accelerate_until; // the block's, unless the motor has its own trapezoid in an uncoordinated block
+            uint32_t decelerate_after;
         };
 
         // need info for each active motor
         tickinfo_t *tick_info;
 
+        // the acceleration of an input shaped block changes at each of these, see prepare_shaped()
+        using shaper_event_t= struct {
+            uint32_t tick; // the new acceleration applies from the tick after this one
+            float acceleration; // of the steps_event_count motor, 2.62 fixed point
+        };
+        const InputShaper *shaper; // set by the planner, nullptr if the block is not to be shaped
+        shaper_event_t *shaper_events; // in CCM as it is used by the step interrupt, only if a shaper is configured
+        uint8_t n_shaper_events; // 0 if the block runs the plain trapezoid
+
+        uint32_t queued_us; // us_ticker time it went in the queue, for LatencyStats
+        // set by the step ticker when it ran to its end, not when a flush or halt discarded it, not a bitfield as the
+        // step interrupt writes it
+        volatile bool is_finished;
+
         static uint8_t n_actuators;
+        static uint8_t max_shaper_events;
 
         struct {
             bool recalculate_flag:1;             // Planner flag to recalculate trapezoids on entry junction
@@ -75,6 +99,7 @@ class Block {
             bool is_ready:1;
             bool primary_axis:1;                 // set if this move is a primary axis
             bool is_g123:1;                      // set if this is a G1, G2 or G3
+            bool uncoordinated:1;                // each motor runs its own trapezoid from rest to rest, see prepare_uncoordinated()
             volatile bool is_ticking:1;          // set when this block is being actively ticked by the stepticker
             volatile bool locked:1;              // set to true when the critical data is being updated, stepticker will have to skip if this is set
             uint16_t s_value:12;                 // for laser 1.11 Fixed point
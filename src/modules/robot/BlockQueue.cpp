@@ -20,7 +20,8 @@ BlockQueue::BlockQueue(unsigned int length)
 {
     head_i = tail_i = 0;
     isr_tail_i = tail_i;
-    void *v= AHB0.alloc(sizeof(Block) * length);
+    // blocks are read by the step interrupts so they live in CCM
+    void *v= CCM.alloc(sizeof(Block) * length);
     ring = new(v) Block[length];
     // TODO: handle allocation failure
     this->length = length;
@@ -35,7 +36,7 @@ BlockQueue::~BlockQueue()
     head_i = tail_i = length = 0;
     isr_tail_i = tail_i;
     if(ring != nullptr)
-        AHB0.dealloc(ring); // delete [] ring;
+        CCM.dealloc(ring); // delete [] ring;
     ring = nullptr;
 }
 
@@ -141,6 +142,13 @@ bool BlockQueue::is_full() const
     return r;
 }
 
+// number of blocks between tail and head, including any the step ticker is still running
+unsigned int BlockQueue::count() const
+{
+    if (length == 0) return 0;
+    return (head_i + length - tail_i) % length;
+}
+
 bool BlockQueue::is_empty() const
 {
     //__disable_irq();
@@ -169,7 +177,7 @@ bool BlockQueue::resize(unsigned int length)
                 __enable_irq();
 
                 if (ring != nullptr)
-                    AHB0.dealloc(ring); // delete [] ring;
+                    CCM.dealloc(ring); // delete [] ring;
                 ring = nullptr;
 
                 return true;
@@ -181,7 +189,9 @@ bool BlockQueue::resize(unsigned int length)
         }
 
         // Note: we don't use realloc so we can fall back to the existing ring if allocation fails
-        void *v= AHB0.alloc(sizeof(Block) * length);
+        void *v= CCM.alloc(sizeof(Block) * length);
+        if (v == nullptr)
+            return false;
         Block* newring = new(v) Block[length];
 
         if (newring != nullptr)
@@ -199,14 +209,14 @@ bool BlockQueue::resize(unsigned int length)
                 __enable_irq();
 
                 if (oldring != nullptr)
-                    AHB0.dealloc(oldring); // delete [] oldring;
+                    CCM.dealloc(oldring); // delete [] oldring;
 
                 return true;
             }
 
             __enable_irq();
 
-            AHB0.dealloc(newring); // delete [] newring;
+            CCM.dealloc(newring); // delete [] newring;
         }
     }
 
@@ -37,6 +37,7 @@ public:
      */
     bool is_empty(void) const;
     bool is_full(void) const;
+    unsigned int count(void) const;
 
     /*
      * resize
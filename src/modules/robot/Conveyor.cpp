@@ -13,6 +13,8 @@
 #include "wait_api.h" // mbed.h lib
 #include "Block.h"
 #include "Conveyor.h"
+#include "FlightRecorder.h"
+#include "LatencyStats.h"
 #include "Planner.h"
 #include "mri.h"
 #include "checksumm.h"
@@ -24,6 +26,7 @@
 #include "StepperMotor.h"
 
 #include <functional>
+#include <algorithm>
 
 #include "mbed.h"
 
@@ -63,12 +66,14 @@ Conveyor::Conveyor()
     running = false;
     allow_fetch = false;
     flush= false;
+    reset_times();
 }
 
 void Conveyor::on_module_loaded()
 {
     register_for_event(ON_IDLE);
     register_for_event(ON_HALT);
+    register_for_event(ON_GCODE_RECEIVED);
 
     // Attach to the end_of_move stepper event
     //THEKERNEL->step_ticker->finished_fnc = std::bind( &Conveyor::all_moves_finished, this);
@@ -97,6 +102,12 @@ void Conveyor::on_idle(void*)
         check_queue();
     }
 
+    uint32_t now= us_ticker_read();
+    if(queue.is_empty() && !THEKERNEL->is_halted()) {
+        idle_us += now - last_idle_us;
+    }
+    last_idle_us= now;
+
     // we can garbage collect the block queue here
     if (queue.tail_i != queue.isr_tail_i) {
         if (queue.is_empty()) {
@@ -105,6 +116,11 @@ void Conveyor::on_idle(void*)
             // Cleanly delete block
             Block* block = queue.tail_ref();
             //block->debug();
+            // blocks a flush or halt discarded did not move, or not all of it
+            if(block->is_finished) {
+                motion_ticks += block->total_move_ticks;
+                ++motion_blocks;
+            }
             block->clear();
             queue.consume_tail();
         }
@@ -126,11 +142,25 @@ bool Conveyor::is_idle() const
     return false;
 }
 
+// true when a block is running and at most one more is waiting behind it,
+// a block queued now can still be planned so the one before it runs on into it
+bool Conveyor::is_running_low()
+{
+    unsigned int i= queue.isr_tail_i;
+    if(i == queue.head_i || !queue.item_ref(i)->is_ticking) return false;
+    i= queue.next(i);
+    return i == queue.head_i || queue.next(i) == queue.head_i;
+}
+
 // Wait for the queue to be empty and for all the jobs to finish in step ticker
 void Conveyor::wait_for_idle(bool wait_for_motors)
 {
+    // a line held back for blending is waited for too
+    THEROBOT->flush_held_move();
+
     // wait for the job queue to empty, this means cycling everything on the block queue into the job queue
     // forcing them to be jobs
+    uint32_t start= us_ticker_read();
     running = false; // stops on_idle calling check_queue
     while (!queue.is_empty()) {
         check_queue(true); // forces queue to be made available to stepticker
@@ -145,9 +175,56 @@ void Conveyor::wait_for_idle(bool wait_for_motors)
     }
 
     running = true;
+    drain_us += us_ticker_read() - start;
+    ++drains;
     // returning now means that everything has totally finished
 }
 
+// M830 reports the planned time of the queue and the cycle times since the last M830 R, R resets them
+void Conveyor::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+
+    if(gcode->has_m && gcode->m == 830) {
+        report_times(gcode->stream);
+        if(gcode->has_letter('R')) reset_times();
+    }
+}
+
+// the time left for the blocks in the queue as they were planned, a feed hold or speed override is not included
+float Conveyor::get_queued_time(unsigned int& n)
+{
+    uint64_t ticks= 0;
+    n= 0;
+    for (unsigned int i = queue.isr_tail_i; i != queue.head_i; i = queue.next(i)) {
+        const Block *b= queue.item_ref(i);
+        ticks += b->total_move_ticks;
+        if(b->is_ticking) ticks -= std::min(b->total_move_ticks, THEKERNEL->step_ticker->get_current_tick());
+        ++n;
+    }
+    return ticks / THEKERNEL->step_ticker->get_frequency();
+}
+
+void Conveyor::report_times(StreamOutput *stream)
+{
+    float f= THEKERNEL->step_ticker->get_frequency();
+    unsigned int n;
+    float t= get_queued_time(n);
+    stream->printf("queue: %u blocks %1.3fs planned\n", n, t);
+    stream->printf("job: motion %1.3fs in %lu blocks, idle %1.3fs, drain %1.3fs in %lu waits\n",
+                   motion_ticks / f, (unsigned long)motion_blocks, idle_us / 1e6F, drain_us / 1e6F, (unsigned long)drains);
+}
+
+void Conveyor::reset_times()
+{
+    motion_ticks= 0;
+    motion_blocks= 0;
+    idle_us= 0;
+    drain_us= 0;
+    drains= 0;
+    last_idle_us= us_ticker_read();
+}
+
 /*
  * push the pre-prepared head block onto the queue
  */
@@ -166,6 +243,7 @@ void Conveyor::queue_head_block()
         return; // if we got a halt then we are done here
     }
 
+    THEKERNEL->latency_stats->block_queued(queue.head_ref());
     queue.produce_head();
 
     // not sure if this is the correct place but we need to turn on the motors if they were not already on
@@ -227,6 +305,10 @@ bool Conveyor::get_next_block(Block **block)
 // called from step ticker ISR when block is finished, do not do anything slow here
 void Conveyor::block_finished()
 {
+    THEKERNEL->flight_recorder->block_finished(queue.item_ref(queue.isr_tail_i), THEKERNEL->step_ticker->get_current_tick());
+    THEKERNEL->latency_stats->block_finished();
+    queue.item_ref(queue.isr_tail_i)->is_finished= true;
+
     // we increment the isr_tail_i so we can get the next block
     queue.isr_tail_i= queue.next(queue.isr_tail_i);
 }
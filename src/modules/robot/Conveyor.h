@@ -11,6 +11,7 @@
 #include "BlockQueue.h"
 
 class Block;
+class StreamOutput;
 
 class Conveyor : public Module
 {
@@ -21,11 +22,18 @@ public:
     void on_module_loaded(void);
     void on_idle(void *);
     void on_halt(void *);
+    void on_gcode_received(void *);
 
     void wait_for_idle(bool wait_for_motors=true);
     bool is_queue_empty() { return queue.is_empty(); };
     bool is_queue_full() { return queue.is_full(); };
+    unsigned int get_queue_count() const { return queue.count(); }
+    // the block the next move will be queued in, the step ticker does not get it before then
+    const Block *get_head_block() { return queue.head_ref(); }
+    size_t get_queue_size() const { return queue_size; }
+    uint32_t get_queue_delay_time_ms() const { return queue_delay_time_ms; }
     bool is_idle() const;
+    bool is_running_low();
 
     // returns next available block writes it to block and returns true
     bool get_next_block(Block **block);
@@ -41,6 +49,9 @@ public:
 private:
     void check_queue(bool force= false);
     void queue_head_block(void);
+    float get_queued_time(unsigned int& n);
+    void report_times(StreamOutput *stream);
+    void reset_times();
 
     using  Queue_t= BlockQueue;
     Queue_t queue;  // Queue of Blocks
@@ -49,6 +60,14 @@ private:
     size_t queue_size;
     float current_feedrate{0}; // actual nominal feedrate that current block is running at in mm/sec
 
+    // cycle time accounting since the last M830 R, the motion time is the planned time of the blocks that ran to their end
+    uint64_t motion_ticks;
+    uint32_t motion_blocks;
+    uint64_t idle_us;        // queue empty
+    uint64_t drain_us;       // in wait_for_idle()
+    uint32_t drains;
+    uint32_t last_idle_us;
+
     struct {
         volatile bool running:1;
         volatile bool allow_fetch:1;
@@ -0,0 +1,84 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "InputShaper.h"
+
+#include <math.h>
+
+#define PI 3.14159265358979323846F // force to be float, do not use M_PI
+
+bool InputShaper::set_type(const std::string& name)
+{
+    if(name == "zv") type= ZV;
+    else if(name == "zvd") type= ZVD;
+    else if(name == "ei") type= EI;
+    else if(name == "none") type= NONE;
+    else return false;
+
+    return set(frequency, damping);
+}
+
+const char *InputShaper::get_type_name() const
+{
+    switch(type) {
+        case ZV: return "zv";
+        case ZVD: return "zvd";
+        case EI: return "ei";
+        default: return "none";
+    }
+}
+
+// the usual shapers for a damped resonance, see Singhose, "Command shaping for flexible systems"
+bool InputShaper::set(float f, float zeta)
+{
+    if(zeta < 0 || zeta >= 1) return false;
+
+    frequency= f;
+    damping= zeta;
+    n_impulses= 0;
+    if(type == NONE || f <= 0) return true;
+
+    float df= sqrtf(1.0F - zeta * zeta);
+    float k= expf(-zeta * PI / df);
+    float period= 1.0F / (f * df); // the damped period
+
+    switch(type) {
+        case ZV:
+            amplitude[0]= 1;
+            amplitude[1]= k;
+            n_impulses= 2;
+            break;
+
+        case ZVD:
+            amplitude[0]= 1;
+            amplitude[1]= 2 * k;
+            amplitude[2]= k * k;
+            n_impulses= 3;
+            break;
+
+        case EI: {
+            // for 5% of the vibration left at the frequency, the price of being tolerant to it being wrong
+            const float v= 0.05F;
+            amplitude[0]= 0.25F * (1 + v);
+            amplitude[1]= 0.5F * (1 - v) * k;
+            amplitude[2]= amplitude[0] * k * k;
+            n_impulses= 3;
+            break;
+        }
+
+        default: break;
+    }
+
+    float sum= 0;
+    for (int i = 0; i < n_impulses; ++i) sum += amplitude[i];
+    for (int i = 0; i < n_impulses; ++i) {
+        amplitude[i] /= sum;
+        impulse_time[i]= i * period / 2;
+    }
+
+    return true;
+}
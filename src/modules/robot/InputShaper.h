@@ -0,0 +1,48 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// An input shaper for one actuator: a few impulses, sized and timed from the frequency and damping of a resonance so
+// that the ringing each of them excites cancels the others. A move convolved with them leaves nothing ringing when it
+// stops, at the cost of its ramps taking get_duration() longer. Block::calculate_trapezoid() does the convolution.
+class InputShaper {
+    public:
+        enum TYPE_T {
+            NONE,
+            ZV,     // two impulses over half a period, least delay, needs the frequency to be right
+            ZVD,    // three over a period, less sensitive to the frequency being off
+            EI      // three over a period, most tolerant of the frequency being off
+        };
+        static const int max_impulses= 3;
+
+        InputShaper() : n_impulses(0), type(NONE), frequency(0), damping(0) {}
+
+        bool set_type(const std::string& name);
+        TYPE_T get_type() const { return type; }
+        const char *get_type_name() const;
+        // a frequency of 0 turns it off, returns false if the damping is not below 1
+        bool set(float frequency, float damping);
+        float get_frequency() const { return frequency; }
+        float get_damping() const { return damping; }
+
+        bool is_enabled() const { return n_impulses > 0; }
+        float get_duration() const { return n_impulses > 0 ? impulse_time[n_impulses - 1] : 0; }
+
+        // the impulses, the amplitudes add up to 1, times are in seconds from the first
+        uint8_t n_impulses;
+        float amplitude[max_impulses];
+        float impulse_time[max_impulses];
+
+    private:
+        TYPE_T type;
+        float frequency;
+        float damping;
+};
@@ -0,0 +1,140 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MotorChannel.h"
+
+#include "libs/Kernel.h"
+#include "StepTicker.h"
+#include "StepperMotor.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+// plan a rest to rest trapezoid for a relative move and hand it to the ISR
+bool MotorChannel::move(float distance, float rate_mm_s, float acceleration)
+{
+    if(THEKERNEL->is_halted() || rate_mm_s <= 0.0F) return false;
+
+    StepperMotor *m= motor;
+    float target= m->get_last_milestone() + distance;
+    int32_t steps= m->steps_to_target(target);
+    if(steps == 0) return false;
+
+    float frequency= THEKERNEL->step_ticker->get_frequency();
+    acceleration *= m->get_steps_per_mm(); // steps/sec²
+    uint32_t n= abs(steps);
+
+    // the step ticker can issue at most one step per tick
+    float nominal_rate= std::min(std::min(rate_mm_s, m->get_max_rate()) * m->get_steps_per_mm(), frequency); // steps/sec
+
+    // the ramps take maximum_rate * time_to_accelerate steps between them, if there are not enough steps it is a triangle
+    float maximum_rate= std::min(nominal_rate, sqrtf(n * acceleration));
+    float time_to_accelerate= maximum_rate / acceleration;
+    float plateau_time= (n - maximum_rate * time_to_accelerate) / maximum_rate;
+    uint32_t acceleration_ticks= floorf(time_to_accelerate * frequency);
+    uint32_t total_move_ticks= floorf((2.0F * time_to_accelerate + plateau_time) * frequency);
+
+    move_t move;
+    move.steps_to_move= n;
+    move.direction= steps < 0;
+    move.plateau_rate= (int64_t)round(((double)maximum_rate / frequency) * STEPTICKER_FPSCALE);
+
+    if(acceleration_ticks == 0) {
+        // too short to ramp, just run at the plateau rate
+        move.initial_rate= move.plateau_rate;
+        move.acceleration= 0;
+        move.accelerate_until= UINT32_MAX;
+        move.decelerate_after= UINT32_MAX;
+
+    } else {
+        // as Block::calculate_trapezoid does, adjust the acceleration so the maximum rate is reached in a whole number of ticks
+        double acceleration_in_steps= maximum_rate / (acceleration_ticks / frequency);
+        move.initial_rate= 0;
+        move.acceleration= (int64_t)round(acceleration_in_steps * ((double)STEPTICKER_FPSCALE / ((double)frequency * frequency)));
+        move.accelerate_until= acceleration_ticks;
+        move.decelerate_after= total_move_ticks - acceleration_ticks;
+    }
+
+    while(!queue.put(move)) {
+        THEKERNEL->call_event(ON_IDLE, this);
+        if(THEKERNEL->is_halted()) return false;
+    }
+
+    m->update_last_milestones(target, steps);
+    return true;
+}
+
+// same fixed point rate generation as StepTicker::step_tick but for a single motor
+bool MotorChannel::tick()
+{
+    if(THEKERNEL->is_halted()) {
+        // drop everything, the owner resyncs the position
+        move_t discard;
+        while(queue.get(discard)) ;
+        running= false;
+        return false;
+    }
+
+    if(!running) {
+        if(!queue.get(current)) return false;
+
+        steps_per_tick= current.initial_rate;
+        acceleration_change= current.acceleration;
+        counter= 0;
+        step_count= 0;
+        current_tick= 0;
+        motor->set_direction(current.direction);
+        motor->start_moving();
+        running= true;
+    }
+
+    steps_per_tick += acceleration_change;
+
+    if(current_tick == current.accelerate_until) {
+        // done accelerating, plateau unless deceleration starts right away
+        acceleration_change= 0;
+        if(current_tick != current.decelerate_after) {
+            steps_per_tick= current.plateau_rate;
+        }
+    }
+
+    if(current_tick == current.decelerate_after) {
+        acceleration_change= -current.acceleration;
+    }
+
+    // protect against rounding errors and such
+    if(steps_per_tick <= 0) {
+        counter= STEPTICKER_FPSCALE; // we force completion this step by setting to 1.0
+        steps_per_tick= 0;
+    }
+
+    counter += steps_per_tick;
+    current_tick++;
+
+    if(counter < STEPTICKER_FPSCALE) return false;
+
+    counter -= STEPTICKER_FPSCALE;
+    bool ismoving= motor->step(); // returns false if the moving flag was set to false externally (endstops)
+    stepped= true;
+
+    if(!ismoving || ++step_count == current.steps_to_move) {
+        motor->stop_moving();
+        running= false;
+    }
+
+    return true;
+}
+
+// called from the unstep ISR
+void MotorChannel::unstep()
+{
+    if(stepped) {
+        motor->unstep();
+        stepped= false;
+    }
+}
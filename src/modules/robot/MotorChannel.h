@@ -0,0 +1,57 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "TSRingBuffer.h"
+
+class StepperMotor;
+
+// One motor stepped on its own, outside the block queue. Each move is a rest to rest trapezoid planned when it is
+// queued, the step ticker steps every channel added to it every tick alongside whatever block is running.
+// The aux motion channels use it, and concurrent homing runs each robot actuator on one while the queue is idle.
+class MotorChannel {
+    public:
+        MotorChannel(StepperMotor *motor) : motor(motor), running(false), stepped(false) {}
+
+        // queue a relative move, acceleration in mm/sec², returns false if there is nothing to move
+        // NOTE this will block until there is room in the queue
+        bool move(float distance, float rate_mm_s, float acceleration);
+        bool is_idle() const { return !running && queue.empty(); }
+        StepperMotor *get_motor() const { return motor; }
+
+        // called from the step ticker ISR, returns true if the motor was stepped
+        bool tick();
+        // called from the unstep ISR
+        void unstep();
+
+    private:
+        // everything the ISR needs to run one move, computed when the move is queued
+        struct move_t {
+            int64_t initial_rate;        // 2.62 fixed point steps per tick
+            int64_t acceleration;        // 2.62 fixed point change in steps per tick each tick
+            int64_t plateau_rate;        // 2.62 fixed point steps per tick
+            uint32_t steps_to_move;
+            uint32_t accelerate_until;
+            uint32_t decelerate_after;
+            bool direction;
+        };
+
+        StepperMotor *motor;
+        TSRingBuffer<move_t, 8> queue;
+        move_t current;                  // the move being stepped, owned by the ISR
+        int64_t steps_per_tick;          // 2.62 fixed point
+        int64_t acceleration_change;     // 2.62 fixed point
+        int64_t counter;                 // 2.62 fixed point
+        uint32_t step_count;
+        uint32_t current_tick;
+        volatile bool running;
+        volatile bool stepped;
+};
@@ -17,10 +17,13 @@ using namespace std;
 #include "Planner.h"
 #include "Conveyor.h"
 #include "StepperMotor.h"
+#include "InputShaper.h"
 #include "Config.h"
 #include "checksumm.h"
 #include "Robot.h"
 #include "ConfigValue.h"
+#include "StepTicker.h"
+#include "utils.h"
 
 #include <math.h>
 #include <algorithm>
@@ -36,6 +39,7 @@ using namespace std;
 Planner::Planner()
 {
     memset(this->previous_unit_vec, 0, sizeof this->previous_unit_vec);
+    speed_override= 1.0F;
     config_load();
 }
 
@@ -49,7 +53,7 @@ void Planner::config_load()
 
 
 // Append a block to the queue, compute it's speed factors
-bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, float s_value, bool g123)
+bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors, float rate_mm_s, float distance, float *unit_vec, float acceleration, float s_value, bool g123, bool uncoordinated)
 {
     // Create ( recycle ) a new block
     Block* block = THECONVEYOR->queue.head_ref();
@@ -71,8 +75,11 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
 
         // find direction
         block->direction_bits[i] = (steps < 0) ? 1 : 0;
+        // on a reversal the motor has to take up the slack first, blending that into the start of this move
+        // saves the host having to send an approach move from one direction
+        block->backlash[i] = (steps != 0) ? THEROBOT->actuators[i]->take_up_backlash(steps < 0) : 0;
         // save actual steps in block
-        block->steps[i] = labs(steps);
+        block->steps[i] = labs(steps) + block->backlash[i];
         // check if Z only
         if (i != GAMMA_STEPPER && block->steps[i] != 0) {
             z_only = false;
@@ -92,6 +99,20 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     // info needed by laser
     block->s_value = roundf(s_value*(1<<11)); // 1.11 fixed point
     block->is_g123 = g123;
+    block->uncoordinated = uncoordinated;
+
+    // a block is shaped with the shaper of the moving actuator that takes longest, the lowest frequency, all of them
+    // run the same shaped trapezoid so the path is kept
+    block->shaper = nullptr;
+    if(!uncoordinated && block->shaper_events != nullptr) {
+        for (size_t i = 0; i < n_motors; i++) {
+            if(block->steps[i] == 0) continue;
+            const InputShaper& shaper = THEROBOT->actuators[i]->get_input_shaper();
+            if(shaper.is_enabled() && (block->shaper == nullptr || shaper.get_duration() > block->shaper->get_duration())) {
+                block->shaper = &shaper;
+            }
+        }
+    }
 
     // use default JD
     float junction_deviation = this->junction_deviation;
@@ -101,7 +122,8 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
         junction_deviation = this->z_junction_deviation;
     }
 
-    block->acceleration = acceleration; // save in block
+    // the step ticker runs the block speed_override times faster so it sees speed_override^2 times the acceleration
+    block->acceleration = acceleration / (speed_override * speed_override); // save in block
 
     // Max number of steps, for all axes
     auto mi = std::max_element(block->steps.begin(), block->steps.end());
@@ -118,6 +140,42 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
         block->nominal_rate  = 0;
     }
 
+    // a block taking up backlash is slowed down to the motor doing it, so the slack is taken up at a bounded rate
+    if(block->nominal_rate > 0) {
+        float rate_scale = 1.0F, accel_scale = 1.0F;
+        for (size_t i = 0; i < n_motors; i++) {
+            if(block->backlash[i] == 0) continue;
+            StepperMotor *m = THEROBOT->actuators[i];
+            rate_scale = std::min(rate_scale, backlash_rate_scale(block->nominal_rate, block->steps_event_count, block->steps[i], m->get_max_rate() * m->get_steps_per_mm()));
+            accel_scale = std::min(accel_scale, backlash_accel_scale(block->steps[i], block->backlash[i]));
+        }
+        block->nominal_speed *= rate_scale;
+        block->nominal_rate *= rate_scale;
+        block->acceleration *= accel_scale;
+    }
+
+    // the step ticker runs the block speed_override times faster, above max_override a motor would go over its max_rate
+    // or have to step more than once a tick, or an axis over its max speed, so then the nominal speed is cut down to it
+    if(block->nominal_rate > 0) {
+        float max_tick_rate = THEKERNEL->step_ticker->get_frequency();
+        for (size_t i = 0; i < n_motors; i++) {
+            if(block->steps[i] == 0) continue;
+            StepperMotor *m = THEROBOT->actuators[i];
+            float rate = block->nominal_rate * block->steps[i] / block->steps_event_count;
+            float max_rate = std::min(m->get_max_rate() * m->get_steps_per_mm(), max_tick_rate);
+            block->max_override = std::min(block->max_override, max_rate / rate);
+        }
+        if(unit_vec != nullptr) {
+            for (size_t i = X_AXIS; i <= Z_AXIS; i++) {
+                float v = block->nominal_speed * fabsf(unit_vec[i]);
+                if(v > 0.0F) block->max_override = std::min(block->max_override, THEROBOT->max_speeds[i] / v);
+            }
+        }
+        float f = override_speed_factor(block->max_override, speed_override);
+        block->nominal_speed *= f;
+        block->nominal_rate *= f;
+    }
+
     // Compute the acceleration rate for the trapezoid generator. Depending on the slope of the line
     // average travel per step event changes. For a line along one axis the travel per step event
     // is equal to the travel/step in the particular axis. For a 45 degree line the steppers of both
@@ -141,6 +199,7 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     if (unit_vec != nullptr && !THECONVEYOR->is_queue_empty()) {
         Block *prev_block = THECONVEYOR->queue.item_ref(THECONVEYOR->queue.prev(THECONVEYOR->queue.head_i));
         if (junction_deviation > 0.0F 
+            && !prev_block->uncoordinated && !uncoordinated // those start and stop at rest
             && prev_block->primary_axis == block->primary_axis // distance calculation (primary/auxiliary) must match
             && prev_block->nominal_speed > 0.0F) {
             // Compute cosine of angle between previous and current path. (prev_unit_vec is negative)
@@ -148,9 +207,11 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
             float cos_theta = - this->previous_unit_vec[X_AXIS] * unit_vec[X_AXIS]
                               - this->previous_unit_vec[Y_AXIS] * unit_vec[Y_AXIS]
                               - this->previous_unit_vec[Z_AXIS] * unit_vec[Z_AXIS];
+            #if MAX_ROBOT_ACTUATORS > 3
             for (int i = 3; i < n_motors; ++i) {
                     cos_theta -= this->previous_unit_vec[i] * unit_vec[i];
                 }
+            #endif
 
             // Skip and use default max junction speed for 0 degree acute junction.
             if (cos_theta <= 0.9999F) {
@@ -173,6 +234,7 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
             }
         }
     }
+    if(uncoordinated) vmax_junction = 0;
     block->max_entry_speed = vmax_junction;
 
     // Initialize block entry speed. Compute based on deceleration to user-defined minimum_planner_speed.
@@ -201,7 +263,7 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     }
 
     // Math-heavy re-computing of the whole queue to take the new
-    this->recalculate();
+    this->recalculate(THECONVEYOR->queue.head_i);
 
     // The block can now be used
     block->ready();
@@ -211,7 +273,8 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     return true;
 }
 
-void Planner::recalculate()
+// newest is the index of the last block to plan, normally the head block that is being appended
+void Planner::recalculate(unsigned int newest)
 {
     Conveyor::Queue_t &queue = THECONVEYOR->queue;
 
@@ -253,7 +316,7 @@ void Planner::recalculate()
 
     float entry_speed = minimum_planner_speed;
 
-    block_index = queue.head_i;
+    block_index = newest;
     current     = queue.item_ref(block_index);
 
     if (!queue.is_empty()) {
@@ -275,7 +338,7 @@ void Planner::recalculate()
 
         float exit_speed = current->max_exit_speed();
 
-        while (block_index != queue.head_i) {
+        while (block_index != newest) {
             previous    = current;
             block_index = queue.next(block_index);
             current     = queue.item_ref(block_index);
@@ -298,6 +361,59 @@ void Planner::recalculate()
     current->calculate_trapezoid(current->entry_speed, minimum_planner_speed);
 }
 
+// Sets the real time speed override, the step ticker scales the rate of the running block right away, the queued blocks
+// are replanned so that their acceleration and junction speeds are still within the limits at the new speed.
+// The running block keeps its plan, only its speed changes, at its own acceleration.
+void Planner::set_speed_override(float k)
+{
+    k= confine(k, 0.1F, 2.0F);
+    if(k == speed_override) return;
+
+    Conveyor::Queue_t &queue = THECONVEYOR->queue;
+    // the head block is already planned if it is waiting for room in the queue
+    bool head_ready= queue.head_ref()->is_ready;
+    if(queue.isr_tail_i == queue.head_i && !head_ready) {
+        // nothing waiting to run
+        speed_override= k;
+        THEKERNEL->step_ticker->set_override(k * STEPTICKER_SCALE_ONE);
+        return;
+    }
+
+    // a block at speed v accelerating at a runs at k*v and k^2*a, so rescale to the new override
+    float r= speed_override / k;
+    float r2= r * r;
+    unsigned int newest= head_ready ? queue.head_i : queue.prev(queue.head_i);
+    Block *previous= nullptr;
+    for (unsigned int i = queue.isr_tail_i; ; i = queue.next(i)) {
+        Block *b= queue.item_ref(i);
+        if(!b->is_ticking) {
+            b->acceleration *= r2;
+            // a block that can not run k times faster keeps to its max_override
+            float f= override_speed_factor(b->max_override, k) / override_speed_factor(b->max_override, speed_override);
+            b->nominal_speed *= f;
+            b->nominal_rate *= f;
+            if(previous != nullptr && previous->is_ticking) {
+                // the running block keeps its plan, so the next one has to start at the speed it ends at,
+                // recalculate() stops its reverse pass here and ramps on from it
+                b->max_entry_speed= b->entry_speed= previous->exit_speed;
+                b->recalculate_flag= false;
+            } else {
+                // the junction speed limit scales with sqrt(acceleration), but it can never be above the nominal speeds
+                float v= b->max_entry_speed * r;
+                if(previous != nullptr) v= std::min(v, previous->nominal_speed);
+                b->max_entry_speed= std::min(v, b->nominal_speed);
+                b->recalculate_flag= true;
+            }
+            b->nominal_length_flag= b->nominal_speed <= max_allowable_speed(-b->acceleration, minimum_planner_speed, b->millimeters);
+        }
+        previous= b;
+        if(i == newest) break;
+    }
+
+    speed_override= k;
+    THEKERNEL->step_ticker->set_override(k * STEPTICKER_SCALE_ONE);
+    recalculate(newest);
+}
 
 // Calculates the maximum allowable speed at this point when you must be able to reach target_velocity using the
 // acceleration within the allotted distance.
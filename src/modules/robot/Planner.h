@@ -9,6 +9,8 @@
 #define PLANNER_H
 
 #include "ActuatorCoordinates.h"
+
+#include <stdint.h>
 class Block;
 
 class Planner
@@ -17,16 +19,39 @@ public:
     Planner();
     float max_allowable_speed( float acceleration, float target_velocity, float distance);
 
+    // real time speed override, 1.0 is 100%, limited to 0.1 to 2.0
+    void set_speed_override(float k);
+    float get_speed_override() const { return speed_override; }
+
+    // backlash steps come on top of the steps of the move, these slow a block down so the motor taking up the slack
+    // stays within its max_rate and accelerates no harder than the move alone would make it
+    static float backlash_rate_scale(float nominal_rate, uint32_t steps_event_count, uint32_t steps, float max_step_rate)
+    {
+        float motor_rate= nominal_rate * steps / steps_event_count;
+        return motor_rate > max_step_rate ? max_step_rate / motor_rate : 1.0F;
+    }
+    static float backlash_accel_scale(uint32_t steps, uint32_t backlash)
+    {
+        return steps > backlash ? (float)(steps - backlash) / steps : 1.0F;
+    }
+
+    // the share of its nominal speed a block with the given max_override is planned at with override k
+    static float override_speed_factor(float max_override, float k)
+    {
+        return k > max_override ? max_override / k : 1.0F;
+    }
+
     friend class Robot; // for acceleration, junction deviation, minimum_planner_speed
 
 private:
-    bool append_block(ActuatorCoordinates &target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float accleration, float s_value, bool g123);
-    void recalculate();
+    bool append_block(ActuatorCoordinates &target, uint8_t n_motors, float rate_mm_s, float distance, float unit_vec[], float accleration, float s_value, bool g123, bool uncoordinated= false);
+    void recalculate(unsigned int newest);
     void config_load();
     float previous_unit_vec[MAX_ROBOT_ACTUATORS];
     float junction_deviation;    // Setting
     float z_junction_deviation;  // Setting
     float minimum_planner_speed; // Setting
+    float speed_override;
 };
 
 
@@ -0,0 +1,213 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PositionStrobe.h"
+
+#include "libs/Kernel.h"
+#include "Robot.h"
+#include "Conveyor.h"
+#include "StepTicker.h"
+#include "StepperMotor.h"
+#include "Gcode.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "StreamOutput.h"
+#include "StreamOutputPool.h"
+#include "arm_solutions/BaseSolution.h"
+
+#include <math.h>
+
+#define position_strobe_checksum             CHECKSUM("position_strobe")
+#define enable_checksum                      CHECKSUM("enable")
+#define pin_checksum                         CHECKSUM("pin")
+#define pulse_us_checksum                    CHECKSUM("pulse_us")
+
+PositionStrobe::PositionStrobe()
+{
+    pulse_ticks= 0;
+    n_latched= 0;
+    arm_block= nullptr;
+    axes= 0;
+    reached= 0;
+    active= false;
+    fired= false;
+}
+
+void PositionStrobe::on_module_loaded()
+{
+    if(!THEKERNEL->config->value(position_strobe_checksum, enable_checksum)->by_default(false)->as_bool()) {
+        // as not needed free up resource
+        delete this;
+        return;
+    }
+
+    pin.from_string(THEKERNEL->config->value(position_strobe_checksum, pin_checksum)->by_default("nc")->as_string())->as_output();
+    if(!pin.connected()) {
+        THEKERNEL->streams->printf("WARNING: position_strobe.pin is not defined, position strobe disabled\n");
+        delete this;
+        return;
+    }
+    pin.set(false);
+
+    float us= THEKERNEL->config->value(position_strobe_checksum, pulse_us_checksum)->by_default(1000)->as_number();
+    pulse_length= std::max(1L, lroundf(us * THEKERNEL->step_ticker->get_frequency() / 1000000.0F));
+
+    motor[0]= THEROBOT->actuators[X_AXIS];
+    motor[1]= THEROBOT->actuators[Y_AXIS];
+
+    register_for_event(ON_GCODE_RECEIVED);
+    register_for_event(ON_IDLE);
+    register_for_event(ON_HALT);
+
+    // take the position compare slot in the step ticker
+    THEKERNEL->step_ticker->set_position_strobe(this);
+}
+
+void PositionStrobe::on_halt(void *argument)
+{
+    if(argument == nullptr) {
+        disarm();
+        pulse_ticks= 0;
+        pin.set(false);
+    }
+}
+
+void PositionStrobe::on_idle(void *argument)
+{
+    if(fired) {
+        fired= false;
+        report(THEKERNEL->streams);
+    }
+}
+
+void PositionStrobe::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+
+    if(!gcode->has_m) return;
+
+    if(gcode->m == 828) {
+        if(gcode->get_num_args() == 0) {
+            // M828 reports where it fired last and if it is armed
+            if(n_latched > 0) report(gcode->stream);
+            gcode->stream->printf("strobe %s\n", active ? "active" : (arm_block != nullptr ? "armed" : "off"));
+            return;
+        }
+        arm(gcode);
+
+    } else if(gcode->m == 829) {
+        disarm();
+    }
+}
+
+// M828 Xnnn Ynnn, the position is in the current WCS, an axis that is not given is not compared
+void PositionStrobe::arm(Gcode *gcode)
+{
+    float pos[3];
+    THEROBOT->get_axis_position(pos);
+    Robot::wcs_t wpos= THEROBOT->mcs2wcs(pos);
+    if(gcode->has_letter('X')) std::get<X_AXIS>(wpos)= THEROBOT->to_millimeters(gcode->get_value('X'));
+    if(gcode->has_letter('Y')) std::get<Y_AXIS>(wpos)= THEROBOT->to_millimeters(gcode->get_value('Y'));
+    std::tie(pos[X_AXIS], pos[Y_AXIS], pos[Z_AXIS])= THEROBOT->wcs2mcs(wpos);
+
+    // where the motors will be, as for a move to there
+    if(THEROBOT->compensationTransform) THEROBOT->compensationTransform(pos, false);
+    ActuatorCoordinates actuator_pos;
+    THEROBOT->arm_solution->cartesian_to_actuator(pos, actuator_pos);
+
+    uint8_t a= (gcode->has_letter('X') ? 1 : 0) | (gcode->has_letter('Y') ? 2 : 0);
+    if(a == 0) return;
+
+    __disable_irq();
+    for (int i = 0; i < 2; ++i) {
+        target[i]= lroundf(actuator_pos[i] * motor[i]->get_steps_per_mm());
+    }
+    axes= a;
+    reached= 0;
+    active= false;
+    // the moves already queued may pass the position on their way, it is only compared from the next move on
+    arm_block= THECONVEYOR->get_head_block();
+    __enable_irq();
+}
+
+void PositionStrobe::disarm()
+{
+    __disable_irq();
+    arm_block= nullptr;
+    active= false;
+    axes= 0;
+    __enable_irq();
+}
+
+void PositionStrobe::report(StreamOutput *stream) const
+{
+    ActuatorCoordinates actuator_pos;
+    actuator_pos.fill(0);
+    for (int i = 0; i < n_latched; ++i) {
+        actuator_pos[i]= latched[i] / THEROBOT->actuators[i]->get_steps_per_mm();
+    }
+    float mpos[3];
+    THEROBOT->arm_solution->actuator_to_cartesian(actuator_pos, mpos);
+    if(THEROBOT->compensationTransform) THEROBOT->compensationTransform(mpos, true);
+    Robot::wcs_t wpos= THEROBOT->mcs2wcs(mpos);
+
+    stream->printf("strobe: X:%1.4f Y:%1.4f Z:%1.4f MCS: X:%1.4f Y:%1.4f Z:%1.4f steps: X:%ld Y:%ld\n",
+                   THEROBOT->from_millimeters(std::get<X_AXIS>(wpos)), THEROBOT->from_millimeters(std::get<Y_AXIS>(wpos)), THEROBOT->from_millimeters(std::get<Z_AXIS>(wpos)),
+                   mpos[X_AXIS], mpos[Y_AXIS], mpos[Z_AXIS], (long)latched[X_AXIS], (long)latched[Y_AXIS]);
+}
+
+// called from the step ticker ISR
+void PositionStrobe::block_started(const Block *block)
+{
+    if(block == arm_block) {
+        arm_block= nullptr;
+        for (int i = 0; i < 2; ++i) {
+            last_step[i]= motor[i]->get_current_step();
+        }
+        active= true;
+    }
+}
+
+// called from the step ticker ISR every tick
+void PositionStrobe::tick()
+{
+    if(pulse_ticks > 0 && --pulse_ticks == 0) pin.set(false);
+
+    if(!active) return;
+
+    // it fires on the tick the last compared axis crosses its target, an axis that moves has to have crossed it
+    // since the last time it fired, one that stands still has to stand on it
+    bool crossing= false;
+    uint8_t at= 0;
+    for (int i = 0; i < 2; ++i) {
+        if(!(axes & (1 << i))) continue;
+        int32_t step= motor[i]->get_current_step();
+        if(step != last_step[i]) {
+            // the motor is already stopped on the tick of its last step
+            if(crossed(last_step[i], step, target[i])) {
+                reached |= (1 << i);
+                crossing= true;
+            }
+        } else if(!motor[i]->is_moving()) {
+            reached &= ~(1 << i);
+            if(step == target[i]) at |= (1 << i);
+        }
+        last_step[i]= step;
+    }
+    if(!crossing || (reached | at) != axes) return;
+
+    pin.set(true);
+    pulse_ticks= pulse_length;
+    for (int i = 0; i < THEROBOT->get_number_registered_motors(); ++i) {
+        latched[i]= THEROBOT->actuators[i]->get_current_step();
+    }
+    n_latched= THEROBOT->get_number_registered_motors();
+    // stays active so the next pass fires again
+    reached= 0;
+    fired= true;
+}
@@ -0,0 +1,68 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "libs/Module.h"
+#include "Pin.h"
+#include "ActuatorCoordinates.h"
+
+class Block;
+class StepperMotor;
+class Gcode;
+class StreamOutput;
+
+// Position compare for fly-by vision: pulses an output pin (the camera trigger or a strobe light) at the step the
+// X and Y motors pass a programmed position, without stopping there. It is checked in the step ticker interrupt after
+// the motors are stepped so it is exact to the step, and the step position of every motor is latched when it fires
+// and reported, so the host can correct for how far the part moved while the picture was taken.
+// M828 X Y arms it for the moves queued after it, the moves already queued can not fire it. It fires each time the
+// position is passed again, until M829 disarms it.
+class PositionStrobe : public Module {
+    public:
+        PositionStrobe();
+
+        void on_module_loaded();
+        void on_gcode_received(void *argument);
+        void on_idle(void *argument);
+        void on_halt(void *argument);
+
+        // called from the step ticker ISR when it starts a block
+        void block_started(const Block *block);
+        // called from the step ticker ISR every tick, after the motors have been stepped
+        void tick();
+
+        // true if a motor stepping from prev to cur reached or went past target in the direction it travels,
+        // a motor that did not step did not cross
+        static bool crossed(int32_t prev, int32_t cur, int32_t target)
+        {
+            return (prev < target && cur >= target) || (prev > target && cur <= target);
+        }
+
+    private:
+        void arm(Gcode *gcode);
+        void disarm();
+        void report(StreamOutput *stream) const;
+
+        Pin pin;
+        uint32_t pulse_length;                  // in ticks
+        volatile uint32_t pulse_ticks;          // left of the pulse being output
+
+        StepperMotor *motor[2];                 // X and Y
+        int32_t target[2];                      // in steps
+        int32_t last_step[2];                   // the step positions on the previous tick
+        int32_t latched[k_max_actuators];       // step positions when it fired
+        uint8_t n_latched;                      // 0 until it has fired once
+        const Block *volatile arm_block;        // the compare starts with this block, the first queued after M828
+
+        volatile uint8_t axes;                  // the axes compared, bit 0 X, bit 1 Y
+        volatile uint8_t reached;               // the moving axes that have crossed their target since it last fired
+        volatile bool active;                   // checked every tick
+        volatile bool fired;                    // latched is set and not reported yet
+};
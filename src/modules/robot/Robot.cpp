@@ -24,6 +24,7 @@
 #include "arm_solutions/HBotSolution.h"
 #include "arm_solutions/CoreXZSolution.h"
 #include "arm_solutions/MorganSCARASolution.h"
+#include "arm_solutions/CamZSolution.h"
 #include "StepTicker.h"
 #include "checksumm.h"
 #include "utils.h"
@@ -34,8 +35,10 @@
 #include "GcodeDispatch.h"
 #include "ActuatorCoordinates.h"
 #include "EndstopsPublicAccess.h"
+#include "FlashStore.h"
 
 #include "mbed.h" // for us_ticker_read()
+#include "Format.h"
 #include "mri.h"
 
 #include <fastmath.h>
@@ -53,10 +56,24 @@
 #define  y_axis_max_speed_checksum           CHECKSUM("y_axis_max_speed")
 #define  z_axis_max_speed_checksum           CHECKSUM("z_axis_max_speed")
 #define  segment_z_moves_checksum            CHECKSUM("segment_z_moves")
+#define  path_blending_checksum              CHECKSUM("path_blending")
+#define  path_blend_tolerance_checksum       CHECKSUM("path_blend_tolerance")
+#define  uncoordinated_rapids_checksum       CHECKSUM("uncoordinated_rapids")
 #define  save_g92_checksum                   CHECKSUM("save_g92")
 #define  save_g54_checksum                   CHECKSUM("save_g54")
 #define  set_g92_checksum                    CHECKSUM("set_g92")
 
+// keys of the settings M500 saves in the flash store
+#define  store_steps_per_mm_checksum         CHECKSUM("store_steps_per_mm")
+#define  store_acceleration_checksum         CHECKSUM("store_acceleration")
+#define  store_max_rate_checksum             CHECKSUM("store_max_rate")
+#define  store_max_speeds_checksum           CHECKSUM("store_max_speeds")
+#define  store_junction_deviation_checksum   CHECKSUM("store_junction_deviation")
+#define  store_wcs_checksum                  CHECKSUM("store_wcs")
+#define  store_g92_checksum                  CHECKSUM("store_g92")
+#define  store_backlash_checksum             CHECKSUM("store_backlash")
+#define  store_input_shaper_checksum         CHECKSUM("store_input_shaper")
+
 // arm solutions
 #define  arm_solution_checksum               CHECKSUM("arm_solution")
 #define  cartesian_checksum                  CHECKSUM("cartesian")
@@ -70,6 +87,7 @@
 #define  corexz_checksum                     CHECKSUM("corexz")
 #define  kossel_checksum                     CHECKSUM("kossel")
 #define  morgan_checksum                     CHECKSUM("morgan")
+#define  cam_z_checksum                      CHECKSUM("cam_z")
 
 // new-style actuator stuff
 #define  actuator_checksum                   CHEKCSUM("actuator")
@@ -118,9 +136,13 @@ Robot::Robot()
     this->get_e_scale_fnc= nullptr;
     this->wcs_offsets.fill(wcs_t(0.0F, 0.0F, 0.0F));
     memset(this->g92_offset, 0, sizeof g92_offset);
+    memset(this->rotary_turns, 0, sizeof rotary_turns);
     this->next_command_is_MCS = false;
     this->disable_segmentation= false;
     this->disable_arm_solution= false;
+    this->move_held= false;
+    this->is_uncoordinated= false;
+    this->blend_tolerance= 0;
     this->n_motors= 0;
 }
 
@@ -128,9 +150,13 @@ Robot::Robot()
 void Robot::on_module_loaded()
 {
     this->register_for_event(ON_GCODE_RECEIVED);
+    this->register_for_event(ON_IDLE);
+    this->register_for_event(ON_HALT);
 
     // Configuration
     this->load_config();
+
+    if(rotary_wrap.any()) this->register_for_event(ON_MAIN_LOOP);
 }
 
 #define ACTUATOR_CHECKSUMS(X) {     \
@@ -139,7 +165,12 @@ void Robot::on_module_loaded()
     CHECKSUM(X "_en_pin"),          \
     CHECKSUM(X "_steps_per_mm"),    \
     CHECKSUM(X "_max_rate"),        \
-    CHECKSUM(X "_acceleration")     \
+    CHECKSUM(X "_acceleration"),    \
+    CHECKSUM(X "_rotary_wrap"),     \
+    CHECKSUM(X "_backlash"),        \
+    CHECKSUM(X "_input_shaper"),    \
+    CHECKSUM(X "_input_shaper_frequency"), \
+    CHECKSUM(X "_input_shaper_damping") \
 }
 
 void Robot::load_config()
@@ -149,6 +180,7 @@ void Robot::load_config()
     // To make adding those solution easier, they have their own, separate object.
     // Here we read the config to find out which arm solution to use
     if (this->arm_solution) delete this->arm_solution;
+    this->cartesian_arm= false;
     int solution_checksum = get_checksum(THEKERNEL->config->value(arm_solution_checksum)->by_default("cartesian")->as_string());
     // Note checksums are not const expressions when in debug mode, so don't use switch
     if(solution_checksum == hbot_checksum || solution_checksum == corexy_checksum) {
@@ -169,11 +201,16 @@ void Robot::load_config()
     } else if(solution_checksum == morgan_checksum) {
         this->arm_solution = new MorganSCARASolution(THEKERNEL->config);
 
+    } else if(solution_checksum == cam_z_checksum) {
+        this->arm_solution = new CamZSolution(THEKERNEL->config);
+
     } else if(solution_checksum == cartesian_checksum) {
         this->arm_solution = new CartesianSolution(THEKERNEL->config);
+        this->cartesian_arm= true;
 
     } else {
         this->arm_solution = new CartesianSolution(THEKERNEL->config);
+        this->cartesian_arm= true;
     }
 
     this->feed_rate           = THEKERNEL->config->value(default_feed_rate_checksum   )->by_default(  100.0F)->as_number();
@@ -191,6 +228,10 @@ void Robot::load_config()
     this->max_speed           = THEKERNEL->config->value(max_speed_checksum           )->by_default(  -60.0F)->as_number() / 60.0F;
 
     this->segment_z_moves     = THEKERNEL->config->value(segment_z_moves_checksum     )->by_default(true)->as_bool();
+    this->uncoordinated_rapids= THEKERNEL->config->value(uncoordinated_rapids_checksum)->by_default(false)->as_bool();
+    this->path_blend_tolerance= THEKERNEL->config->value(path_blend_tolerance_checksum)->by_default(0.5F)->as_number();
+    // G64 at startup
+    this->blend_tolerance     = THEKERNEL->config->value(path_blending_checksum       )->by_default(false)->as_bool() ? path_blend_tolerance : 0;
     this->save_g92            = THEKERNEL->config->value(save_g92_checksum            )->by_default(false)->as_bool();
     this->save_g54            = THEKERNEL->config->value(save_g54_checksum            )->by_default(THEKERNEL->is_grbl_mode())->as_bool();
     string g92                = THEKERNEL->config->value(set_g92_checksum             )->by_default("")->as_string();
@@ -208,7 +249,7 @@ void Robot::load_config()
     this->s_value             = THEKERNEL->config->value(laser_module_default_power_checksum)->by_default(0.8F)->as_number();
 
      // Make our Primary XYZ StepperMotors, and potentially A B C
-    uint16_t const motor_checksums[][6] = {
+    uint16_t const motor_checksums[][11] = {
         ACTUATOR_CHECKSUMS("alpha"), // X
         ACTUATOR_CHECKSUMS("beta"),  // Y
         ACTUATOR_CHECKSUMS("gamma"), // Z
@@ -235,7 +276,7 @@ void Robot::load_config()
 
         if(!pins[0].connected() || !pins[1].connected()) { // step and dir must be defined, but enable is optional
             if(a <= Z_AXIS) {
-                THEKERNEL->streams->printf("FATAL: motor %c is not defined in config\n", 'X'+a);
+                THEKERNEL->streams->printf("FATAL: motor %c is not defined in config\n", (int)('X'+a));
                 n_motors= a; // we only have this number of motors
                 return;
             }
@@ -247,13 +288,30 @@ void Robot::load_config()
         uint8_t n= register_motor(sm);
         if(n != a) {
             // this is a fatal error
-            THEKERNEL->streams->printf("FATAL: motor %d does not match index %d\n", n, a);
+            THEKERNEL->streams->printf("FATAL: motor %d does not match index %d\n", n, (int)a);
             return;
         }
 
         actuators[a]->change_steps_per_mm(THEKERNEL->config->value(motor_checksums[a][3])->by_default(a == 2 ? 2560.0F : 80.0F)->as_number());
         actuators[a]->set_max_rate(THEKERNEL->config->value(motor_checksums[a][4])->by_default(30000.0F)->as_number()/60.0F); // it is in mm/min and converted to mm/sec
         actuators[a]->set_acceleration(THEKERNEL->config->value(motor_checksums[a][5])->by_default(NAN)->as_number()); // mm/secs²
+        actuators[a]->set_backlash(THEKERNEL->config->value(motor_checksums[a][7])->by_default(0.0F)->as_number()); // mm of slack taken up on a reversal
+
+        // an input shaper cancels the ringing of a resonance of this axis at the frequency, see InputShaper.h
+        InputShaper& shaper= actuators[a]->get_input_shaper();
+        string shaper_type= THEKERNEL->config->value(motor_checksums[a][8])->by_default("none")->as_string();
+        if(!shaper.set_type(shaper_type)) {
+            THEKERNEL->streams->printf("WARNING: unknown input shaper %s for actuator %d, use zv, zvd or ei\n", shaper_type.c_str(), (int)a);
+        }
+        if(!shaper.set(THEKERNEL->config->value(motor_checksums[a][9])->by_default(0.0F)->as_number(),
+                       THEKERNEL->config->value(motor_checksums[a][10])->by_default(0.1F)->as_number())) {
+            THEKERNEL->streams->printf("WARNING: input shaper damping for actuator %d must be below 1\n", (int)a);
+        }
+
+        // a rotary ABC axis (eg nozzle rotation) can wrap at 360° and always take the shortest way round
+        if(a >= A_AXIS) {
+            rotary_wrap[a]= THEKERNEL->config->value(motor_checksums[a][6])->by_default(false)->as_bool();
+        }
     }
 
     check_max_actuator_speeds(); // check the configs are sane
@@ -274,10 +332,12 @@ void Robot::load_config()
         actuators[i]->change_last_milestone(actuator_pos[i]);
     }
 
+    #if MAX_ROBOT_ACTUATORS > 3
     // initialize any extra axis to machine position
     for (size_t i = A_AXIS; i < n_motors; i++) {
          actuators[i]->change_last_milestone(machine_position[i]);
     }
+    #endif
 
     //this->clearToolOffset();
 
@@ -354,6 +414,23 @@ void Robot::get_current_machine_position(float *pos) const
     arm_solution->actuator_to_cartesian(current_position, pos);
 }
 
+// appends " X:x Y:y Z:z" after the label as %1.4f would
+static void append_axes(std::string& res, const char *label, float x, float y, float z)
+{
+    res.append(label);
+    res.append(" X:"); append_fixed(res, x, 4);
+    res.append(" Y:"); append_fixed(res, y, 4);
+    res.append(" Z:"); append_fixed(res, z, 4);
+}
+
+#if MAX_ROBOT_ACTUATORS > 3
+static void append_axis(std::string& res, char axis, float v)
+{
+    res.append(1, ' ').append(1, axis).append(1, ':');
+    append_fixed(res, v, 4);
+}
+#endif
+
 void Robot::print_position(uint8_t subcode, std::string& res, bool ignore_extruders) const
 {
     // M114.1 is a new way to do this (similar to how GRBL does it).
@@ -361,20 +438,19 @@ void Robot::print_position(uint8_t subcode, std::string& res, bool ignore_extrud
     // this does require a FK to get a machine position from the actuator position
     // and then invert all the transforms to get a workspace position from machine position
     // M114 just does it the old way uses machine_position and does inverse transforms to get the requested position
-    uint32_t n = 0;
-    char buf[64];
+    // the values are formatted with format_fixed() rather than snprintf("%1.4f") as this is polled a lot by hosts
     if(subcode == 0) { // M114 print WCS
         wcs_t pos= mcs2wcs(machine_position);
-        n = snprintf(buf, sizeof(buf), "C: X:%1.4f Y:%1.4f Z:%1.4f", from_millimeters(std::get<X_AXIS>(pos)), from_millimeters(std::get<Y_AXIS>(pos)), from_millimeters(std::get<Z_AXIS>(pos)));
+        append_axes(res, "C:", from_millimeters(std::get<X_AXIS>(pos)), from_millimeters(std::get<Y_AXIS>(pos)), from_millimeters(std::get<Z_AXIS>(pos)));
 
     } else if(subcode == 4) {
         // M114.4 print last milestone
-        n = snprintf(buf, sizeof(buf), "MP: X:%1.4f Y:%1.4f Z:%1.4f", machine_position[X_AXIS], machine_position[Y_AXIS], machine_position[Z_AXIS]);
+        append_axes(res, "MP:", machine_position[X_AXIS], machine_position[Y_AXIS], machine_position[Z_AXIS]);
 
     } else if(subcode == 5) {
         // M114.5 print last machine position (which should be the same as M114.1 if axis are not moving and no level compensation)
         // will differ from LMS by the compensation at the current position otherwise
-        n = snprintf(buf, sizeof(buf), "CMP: X:%1.4f Y:%1.4f Z:%1.4f", compensated_machine_position[X_AXIS], compensated_machine_position[Y_AXIS], compensated_machine_position[Z_AXIS]);
+        append_axes(res, "CMP:", compensated_machine_position[X_AXIS], compensated_machine_position[Y_AXIS], compensated_machine_position[Z_AXIS]);
 
     } else {
         // get real time positions
@@ -386,10 +462,10 @@ void Robot::print_position(uint8_t subcode, std::string& res, bool ignore_extrud
 
         if(subcode == 1) { // M114.1 print realtime WCS
             wcs_t pos= mcs2wcs(mpos);
-            n = snprintf(buf, sizeof(buf), "WCS: X:%1.4f Y:%1.4f Z:%1.4f", from_millimeters(std::get<X_AXIS>(pos)), from_millimeters(std::get<Y_AXIS>(pos)), from_millimeters(std::get<Z_AXIS>(pos)));
+            append_axes(res, "WCS:", from_millimeters(std::get<X_AXIS>(pos)), from_millimeters(std::get<Y_AXIS>(pos)), from_millimeters(std::get<Z_AXIS>(pos)));
 
         } else if(subcode == 2) { // M114.2 print realtime Machine coordinate system
-            n = snprintf(buf, sizeof(buf), "MCS: X:%1.4f Y:%1.4f Z:%1.4f", mpos[X_AXIS], mpos[Y_AXIS], mpos[Z_AXIS]);
+            append_axes(res, "MCS:", mpos[X_AXIS], mpos[Y_AXIS], mpos[Z_AXIS]);
 
         } else if(subcode == 3) { // M114.3 print realtime actuator position
             // get real time current actuator position in mm
@@ -398,31 +474,26 @@ void Robot::print_position(uint8_t subcode, std::string& res, bool ignore_extrud
                 actuators[Y_AXIS]->get_current_position(),
                 actuators[Z_AXIS]->get_current_position()
             };
-            n = snprintf(buf, sizeof(buf), "APOS: X:%1.4f Y:%1.4f Z:%1.4f", current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS]);
+            append_axes(res, "APOS:", current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS]);
         }
     }
 
-    if(n > sizeof(buf)) n= sizeof(buf);
-    res.append(buf, n);
 
     #if MAX_ROBOT_ACTUATORS > 3
     // deal with the ABC axis
     for (int i = A_AXIS; i < n_motors; ++i) {
-        n= 0;
         if(ignore_extruders && actuators[i]->is_extruder()) continue; // don't show an extruder as that will be E
         if(subcode == 0) { // M114 print last milestone which is the machine position with g92 offset applied for ABC
-            n= snprintf(buf, sizeof(buf), " %c:%1.4f", 'A'+i-A_AXIS, machine_position[i] + g92_offset[i]);
+            append_axis(res, 'A'+i-A_AXIS, machine_position[i] + g92_offset[i]);
         }else if(subcode == 4) { // M114.4 print last milestone in machine coordinates
-            n= snprintf(buf, sizeof(buf), " %c:%1.4f", 'A'+i-A_AXIS, machine_position[i]);
+            append_axis(res, 'A'+i-A_AXIS, machine_position[i]);
         }else if(subcode == 1) { // M114.1 prints real time position which is the machine position with g92 offset applied for ABC
             // current position 
-            n= snprintf(buf, sizeof(buf), " %c:%1.4f", 'A'+i-A_AXIS,  actuators[i]->get_current_position() + g92_offset[i]);
+            append_axis(res, 'A'+i-A_AXIS, actuators[i]->get_current_position() - rotary_turns[i] + g92_offset[i]);
         }else if(subcode == 2 || subcode == 3) { // M114.1/M114.2/M114.3 print actuator position which is the same as machine position for ABC
             // current actuator position
-            n= snprintf(buf, sizeof(buf), " %c:%1.4f", 'A'+i-A_AXIS, actuators[i]->get_current_position());
+            append_axis(res, 'A'+i-A_AXIS, actuators[i]->get_current_position());
         }
-        if(n > sizeof(buf)) n= sizeof(buf);
-        if(n > 0) res.append(buf, n);
     }
     #endif
 }
@@ -447,6 +518,138 @@ Robot::wcs_t Robot::wcs2mcs(const Robot::wcs_t& pos) const
     );
 }
 
+// Save the settings M500 used to write to config-override in the flash store, M500 programs it once they are all put
+void Robot::save_settings()
+{
+    FlashStore *store= THEKERNEL->flash_store;
+    float buf[1 + MAX_WCS * 3];
+
+    for (int i = 0; i < n_motors; ++i) buf[i]= actuators[i]->get_steps_per_mm();
+    store->put(store_steps_per_mm_checksum, buf, n_motors * sizeof(float));
+
+    buf[0]= default_acceleration;
+    for (int i = 0; i < n_motors; ++i) buf[i + 1]= actuators[i]->get_acceleration();
+    store->put(store_acceleration_checksum, buf, (n_motors + 1) * sizeof(float));
+
+    for (int i = 0; i < n_motors; ++i) buf[i]= actuators[i]->get_max_rate();
+    store->put(store_max_rate_checksum, buf, n_motors * sizeof(float));
+
+    buf[0]= max_speeds[X_AXIS];
+    buf[1]= max_speeds[Y_AXIS];
+    buf[2]= max_speeds[Z_AXIS];
+    buf[3]= max_speed;
+    store->put(store_max_speeds_checksum, buf, 4 * sizeof(float));
+
+    buf[0]= THEKERNEL->planner->junction_deviation;
+    buf[1]= THEKERNEL->planner->z_junction_deviation;
+    buf[2]= THEKERNEL->planner->minimum_planner_speed;
+    store->put(store_junction_deviation_checksum, buf, 3 * sizeof(float));
+
+    for (int i = 0; i < n_motors; ++i) buf[i]= actuators[i]->get_backlash();
+    store->put(store_backlash_checksum, buf, n_motors * sizeof(float));
+
+    for (int i = 0; i < n_motors; ++i) {
+        buf[i * 2]= actuators[i]->get_input_shaper().get_frequency();
+        buf[i * 2 + 1]= actuators[i]->get_input_shaper().get_damping();
+    }
+    store->put(store_input_shaper_checksum, buf, n_motors * 2 * sizeof(float));
+
+    if(save_g54) {
+        buf[0]= current_wcs;
+        for (size_t i = 0; i < MAX_WCS; ++i) {
+            std::tie(buf[1 + i * 3], buf[2 + i * 3], buf[3 + i * 3]) = wcs_offsets[i];
+        }
+        store->put(store_wcs_checksum, buf, (1 + MAX_WCS * 3) * sizeof(float));
+    }
+
+    if(save_g92) {
+        store->put(store_g92_checksum, g92_offset, 3 * sizeof(float));
+    }
+}
+
+// any arm solution specific optional values, they are not stored in the flash store
+void Robot::print_arm_options(StreamOutput *stream) const
+{
+    BaseSolution::arm_options_t options;
+    if(arm_solution->get_optional(options) && !options.empty()) {
+        stream->printf(";Optional arm solution specific settings:\nM665");
+        for(auto &i : options) {
+            stream->printf(" %c%1.4f", i.first, i.second);
+        }
+        stream->printf("\n");
+    }
+}
+
+// Restore the settings saved by M500, called once all modules are loaded.
+// Values saved with a different number of actuators are ignored
+void Robot::restore_settings()
+{
+    FlashStore *store= THEKERNEL->flash_store;
+    float buf[1 + MAX_WCS * 3];
+
+    if(store->get(store_steps_per_mm_checksum, buf, n_motors * sizeof(float))) {
+        for (int i = 0; i < n_motors; ++i) {
+            if(actuators[i]->is_extruder()) continue; //extruders handle this themselves
+            actuators[i]->change_steps_per_mm(buf[i]);
+        }
+    }
+
+    if(store->get(store_acceleration_checksum, buf, (n_motors + 1) * sizeof(float))) {
+        default_acceleration= buf[0];
+        for (int i = 0; i < n_motors; ++i) {
+            if(actuators[i]->is_extruder()) continue;
+            actuators[i]->set_acceleration(buf[i + 1]);
+        }
+    }
+
+    if(store->get(store_max_rate_checksum, buf, n_motors * sizeof(float))) {
+        for (int i = 0; i < n_motors; ++i) {
+            if(actuators[i]->is_extruder()) continue;
+            actuators[i]->set_max_rate(buf[i]);
+        }
+    }
+
+    if(store->get(store_max_speeds_checksum, buf, 4 * sizeof(float))) {
+        max_speeds[X_AXIS]= buf[0];
+        max_speeds[Y_AXIS]= buf[1];
+        max_speeds[Z_AXIS]= buf[2];
+        max_speed= buf[3];
+    }
+
+    if(store->get(store_backlash_checksum, buf, n_motors * sizeof(float))) {
+        for (int i = 0; i < n_motors; ++i) {
+            if(actuators[i]->is_extruder()) continue;
+            actuators[i]->set_backlash(buf[i]);
+        }
+    }
+
+    if(store->get(store_input_shaper_checksum, buf, n_motors * 2 * sizeof(float))) {
+        for (int i = 0; i < n_motors; ++i) {
+            if(actuators[i]->is_extruder()) continue;
+            actuators[i]->get_input_shaper().set(buf[i * 2], buf[i * 2 + 1]);
+        }
+    }
+
+    if(store->get(store_junction_deviation_checksum, buf, 3 * sizeof(float))) {
+        THEKERNEL->planner->junction_deviation= buf[0];
+        THEKERNEL->planner->z_junction_deviation= buf[1];
+        THEKERNEL->planner->minimum_planner_speed= buf[2];
+    }
+
+    if(save_g54 && store->get(store_wcs_checksum, buf, (1 + MAX_WCS * 3) * sizeof(float))) {
+        current_wcs= std::min((size_t)buf[0], MAX_WCS - 1);
+        for (size_t i = 0; i < MAX_WCS; ++i) {
+            wcs_offsets[i]= wcs_t(buf[1 + i * 3], buf[2 + i * 3], buf[3 + i * 3]);
+        }
+    }
+
+    if(save_g92) {
+        store->get(store_g92_checksum, g92_offset, 3 * sizeof(float));
+    }
+
+    check_max_actuator_speeds();
+}
+
 // this does a sanity check that actuator speeds do not exceed steps rate capability
 // we will override the actuator max_rate if the combination of max_rate and steps/sec exceeds base_stepping_frequency
 void Robot::check_max_actuator_speeds()
@@ -457,7 +660,7 @@ void Robot::check_max_actuator_speeds()
         float step_freq = actuators[i]->get_max_rate() * actuators[i]->get_steps_per_mm();
         if (step_freq > THEKERNEL->base_stepping_frequency) {
             actuators[i]->set_max_rate(floorf(THEKERNEL->base_stepping_frequency / actuators[i]->get_steps_per_mm()));
-            THEKERNEL->streams->printf("WARNING: actuator %d rate exceeds base_stepping_frequency * ..._steps_per_mm: %f, setting to %f\n", i, step_freq, actuators[i]->get_max_rate());
+            THEKERNEL->streams->printf("WARNING: actuator %d rate exceeds base_stepping_frequency * ..._steps_per_mm: %f, setting to %f\n", (int)i, step_freq, actuators[i]->get_max_rate());
         }
     }
 }
@@ -470,6 +673,9 @@ void Robot::on_gcode_received(void *argument)
 
     enum MOTION_MODE_T motion_mode= NONE;
 
+    // anything but another line has to find the held back line in the queue
+    if(move_held && !(gcode->has_g && (gcode->g == 0 || gcode->g == 1))) flush_held_move();
+
     if( gcode->has_g) {
         switch( gcode->g ) {
             case 0:  motion_mode = SEEK;    break;
@@ -552,6 +758,12 @@ void Robot::on_gcode_received(void *argument)
             case 20: this->inch_mode = true;   break;
             case 21: this->inch_mode = false;   break;
 
+            case 61: this->blend_tolerance = 0; break; // exact path
+            case 64: // G64 [Pn] blend the corners between lines, within n mm of the programmed path
+                this->blend_tolerance = gcode->has_letter('P') ? to_millimeters(gcode->get_value('P')) : path_blend_tolerance;
+                if(this->blend_tolerance < 0) this->blend_tolerance = 0;
+                break;
+
             case 54: case 55: case 56: case 57: case 58: case 59:
                 // select WCS 0-8: G54..G59, G59.1, G59.2, G59.3
                 current_wcs = gcode->g - 54;
@@ -672,7 +884,7 @@ void Robot::on_gcode_received(void *argument)
                     }
 
                     THEKERNEL->conveyor->wait_for_idle();
-                    THEKERNEL->call_event(ON_ENABLE, (void *)bm);
+                    THEKERNEL->call_event(ON_ENABLE, (void *)(uintptr_t)bm);
                     break;
                 }
                 // fall through
@@ -715,12 +927,12 @@ void Robot::on_gcode_received(void *argument)
             case 203: // M203 Set maximum feedrates in mm/sec, M203.1 set maximum actuator feedrates
                     if(gcode->get_num_args() == 0) {
                         for (size_t i = X_AXIS; i <= Z_AXIS; i++) {
-                            gcode->stream->printf(" %c: %g ", 'X' + i, gcode->subcode == 0 ? this->max_speeds[i] : actuators[i]->get_max_rate());
+                            gcode->stream->printf(" %c: %g ", (int)('X' + i), gcode->subcode == 0 ? this->max_speeds[i] : actuators[i]->get_max_rate());
                         }
                         if(gcode->subcode == 1) {
                             for (size_t i = A_AXIS; i < n_motors; i++) {
                                 if(actuators[i]->is_extruder()) continue; //extruders handle this themselves
-                                gcode->stream->printf(" %c: %g ", 'A' + i - A_AXIS, actuators[i]->get_max_rate());
+                                gcode->stream->printf(" %c: %g ", (int)('A' + i - A_AXIS), actuators[i]->get_max_rate());
                             }
                         }else{
                             gcode->stream->printf(" S: %g ", this->max_speed);
@@ -843,7 +1055,7 @@ void Robot::on_gcode_received(void *argument)
 
                     seconds_per_minute = 6000.0F / factor;
                 } else {
-                    gcode->stream->printf("Speed factor at %6.2f %%\n", 6000.0F / seconds_per_minute);
+                    gcode->stream->printf("Speed factor at %6.2f %%, real time override at %6.2f %%\n", 6000.0F / seconds_per_minute, THEKERNEL->planner->get_speed_override() * 100.0F);
                 }
                 break;
 
@@ -851,7 +1063,57 @@ void Robot::on_gcode_received(void *argument)
                 THEKERNEL->conveyor->wait_for_idle();
                 break;
 
-            case 500: // M500 saves some volatile settings to config override file
+            case 425: // M425 Xnnn Ynnn... sets the backlash of each actuator in mm, with no args reports it
+                if(gcode->get_num_args() == 0) {
+                    gcode->stream->printf("Backlash mm: ");
+                }
+                for (int i = 0; i < n_motors; ++i) {
+                    if(actuators[i]->is_extruder()) continue;
+                    char axis= (i <= Z_AXIS ? 'X'+i : 'A'+(i-A_AXIS));
+                    if(gcode->has_letter(axis)) {
+                        actuators[i]->set_backlash(std::max(gcode->get_value(axis), 0.0F));
+                    } else if(gcode->get_num_args() == 0) {
+                        gcode->stream->printf("%c:%1.4f ", axis, actuators[i]->get_backlash());
+                    }
+                }
+                if(gcode->get_num_args() == 0) gcode->stream->printf("\n");
+                break;
+
+            case 593: { // M593 [X][Y].. F<Hz> D<damping> sets the input shaper of the given actuators, all of them without any, F0 turns it off
+                bool all= true;
+                for (int i = 0; i < n_motors; ++i) {
+                    char axis= (i <= Z_AXIS ? 'X'+i : 'A'+(i-A_AXIS));
+                    if(!actuators[i]->is_extruder() && gcode->has_letter(axis)) all= false;
+                }
+                for (int i = 0; i < n_motors; ++i) {
+                    if(actuators[i]->is_extruder()) continue;
+                    char axis= (i <= Z_AXIS ? 'X'+i : 'A'+(i-A_AXIS));
+                    if(!all && !gcode->has_letter(axis)) continue;
+                    InputShaper& shaper= actuators[i]->get_input_shaper();
+                    if(shaper.get_type() == InputShaper::NONE) {
+                        if(!all) gcode->stream->printf("%c has no input shaper configured\n", axis);
+                        continue;
+                    }
+                    if(gcode->has_letter('F') || gcode->has_letter('D')) {
+                        float f= gcode->has_letter('F') ? gcode->get_value('F') : shaper.get_frequency();
+                        float d= gcode->has_letter('D') ? gcode->get_value('D') : shaper.get_damping();
+                        if(!shaper.set(std::max(f, 0.0F), d)) {
+                            gcode->stream->printf("error:damping must be from 0 to below 1\n");
+                            break;
+                        }
+                    } else {
+                        gcode->stream->printf("%c: %s %1.2fHz damping %1.3f%s\n", axis, shaper.get_type_name(), shaper.get_frequency(), shaper.get_damping(), shaper.is_enabled() ? "" : " (off)");
+                    }
+                }
+            }
+            break;
+
+            case 500: // M500 saves some volatile settings to the flash store
+                save_settings();
+                // what is not stored is printed, M500 reports it
+                print_arm_options(gcode->stream);
+                break;
+
             case 503: { // M503 just prints the settings
                 gcode->stream->printf(";Steps per unit:\nM92 ");
                 for (int i = 0; i < n_motors; ++i) {
@@ -882,16 +1144,23 @@ void Robot::on_gcode_received(void *argument)
                 }
                 gcode->stream->printf("\n");
 
-                // get or save any arm solution specific optional values
-                BaseSolution::arm_options_t options;
-                if(arm_solution->get_optional(options) && !options.empty()) {
-                    gcode->stream->printf(";Optional arm solution specific settings:\nM665");
-                    for(auto &i : options) {
-                        gcode->stream->printf(" %c%1.4f", i.first, i.second);
-                    }
-                    gcode->stream->printf("\n");
+                gcode->stream->printf(";Backlash in mm:\nM425 ");
+                for (int i = 0; i < n_motors; ++i) {
+                    if(actuators[i]->is_extruder()) continue;
+                    char axis= (i <= Z_AXIS ? 'X'+i : 'A'+(i-A_AXIS));
+                    gcode->stream->printf("%c%1.4f ", axis, actuators[i]->get_backlash());
+                }
+                gcode->stream->printf("\n");
+
+                for (int i = 0; i < n_motors; ++i) {
+                    const InputShaper& shaper= actuators[i]->get_input_shaper();
+                    if(actuators[i]->is_extruder() || shaper.get_type() == InputShaper::NONE) continue;
+                    char axis= (i <= Z_AXIS ? 'X'+i : 'A'+(i-A_AXIS));
+                    gcode->stream->printf(";Input shaper %s, frequency Hz and damping:\nM593 %c F%1.2f D%1.3f\n", shaper.get_type_name(), axis, shaper.get_frequency(), shaper.get_damping());
                 }
 
+                print_arm_options(gcode->stream);
+
                 // save wcs_offsets and current_wcs
                 // TODO this may need to be done whenever they change to be compliant
                 if(save_g54) {
@@ -1060,6 +1329,13 @@ void Robot::process_move(Gcode *gcode, enum MOTION_MODE_T motion_mode)
             float p= gcode->get_value(letter);
             if(this->absolute_mode) {
                 target[i]= p - g92_offset[i];
+                if(rotary_wrap[i]) {
+                    // machine_position is kept in [0, 360) so take the shortest signed delta to the requested angle
+                    float d= fmodf(target[i] - machine_position[i], 360.0F);
+                    if(d > 180.0F) d -= 360.0F;
+                    else if(d <= -180.0F) d += 360.0F;
+                    target[i]= machine_position[i] + d;
+                }
             }else{
                 target[i]= p + machine_position[i];
             }
@@ -1077,6 +1353,23 @@ void Robot::process_move(Gcode *gcode, enum MOTION_MODE_T motion_mode)
     // S is modal When specified on a G0/1/2/3 command
     if(gcode->has_letter('S')) s_value= gcode->get_value('S');
 
+    // the arm solution would otherwise go somewhere else than commanded without a word, eg past the travel of cam_z,
+    // handled like a soft endstop
+    if(motion_mode != NONE && !arm_solution->is_reachable(target)) {
+        if(THEKERNEL->is_grbl_mode()) {
+            THEKERNEL->streams->printf("error:");
+        }else{
+            THEKERNEL->streams->printf("Error: ");
+        }
+        if(soft_endstop_halt) {
+            THEKERNEL->streams->printf("Target out of reach of the arm solution - reset or $X or M999 required\n");
+            THEKERNEL->call_event(ON_HALT, nullptr);
+        } else {
+            THEKERNEL->streams->printf("Target out of reach of the arm solution - entire move ignored\n");
+        }
+        return;
+    }
+
     bool moved= false;
 
     // Perform any physical actions
@@ -1104,9 +1397,24 @@ void Robot::process_move(Gcode *gcode, enum MOTION_MODE_T motion_mode)
     if(moved) {
         // set machine_position to the calculated target
         memcpy(machine_position, target, n_motors*sizeof(float));
+        #if MAX_ROBOT_ACTUATORS > 3
+        for (int i = A_AXIS; i < n_motors; ++i) {
+            if(rotary_wrap[i]) wrap_rotary_position(i);
+        }
+        #endif
     }
 }
 
+// keep a wrapping rotary axis in [0, 360), the whole turns go into rotary_turns so the actuator position does not change
+void Robot::wrap_rotary_position(int axis)
+{
+    float turns= floorf(machine_position[axis] / 360.0F) * 360.0F;
+    if(turns == 0) return;
+    machine_position[axis] -= turns;
+    compensated_machine_position[axis] -= turns;
+    rotary_turns[axis] += turns;
+}
+
 // reset the machine position for all axis. Used for homing.
 // after homing we supply the cartesian coordinates that the head is at when homed,
 // however for Z this is the compensated machine position (if enabled)
@@ -1144,6 +1452,8 @@ void Robot::reset_axis_position(float position, int axis)
         // ABC and/or extruders need to be set as there is no arm solution for them
         machine_position[axis]= compensated_machine_position[axis]= position;
         actuators[axis]->change_last_milestone(machine_position[axis]);
+        rotary_turns[axis]= 0;
+        if(rotary_wrap[axis]) wrap_rotary_position(axis);
 #endif
     }
 }
@@ -1193,6 +1503,8 @@ void Robot::reset_position_from_current_actuator_position()
         if(actuators[i]->is_extruder() && get_e_scale_fnc) ap /= get_e_scale_fnc(); // inverse E scale if there is one and this is an extruder
         machine_position[i]= compensated_machine_position[i]= ap;
         actuators[i]->change_last_milestone(actuator_pos[i]); // this updates the last_milestone in the actuator
+        rotary_turns[i]= 0;
+        if(rotary_wrap[i]) wrap_rotary_position(i);
     }
     #endif
 }
@@ -1201,10 +1513,22 @@ void Robot::reset_position_from_current_actuator_position()
 // target is in machine coordinates without the compensation transform, however we save a compensated_machine_position that includes
 // all transforms and is what we actually convert to actuator positions
 bool Robot::append_milestone(const float target[], float rate_mm_s)
+{
+#ifdef CARTESIAN_FAST_PATH
+    // with the arm solution known at compile time its conversion is inlined rather than a virtual call for every block
+    if(cartesian_arm) return append_milestone_for<CartesianSolution>(target, rate_mm_s);
+#endif
+    return append_milestone_for<BaseSolution>(target, rate_mm_s);
+}
+
+template<class Solution>
+bool Robot::append_milestone_for(const float target[], float rate_mm_s)
 {
     float deltas[n_motors];
     float transformed_target[n_motors]; // adjust target for bed compensation
     float unit_vec[MAX_ROBOT_ACTUATORS];
+    // an uncoordinated move limits each actuator on its own to this, see Block::prepare_uncoordinated()
+    float requested_rate_mm_s= rate_mm_s;
 
     // unity transform by default
     memcpy(transformed_target, target, n_motors*sizeof(float));
@@ -1355,7 +1679,7 @@ bool Robot::append_milestone(const float target[], float rate_mm_s)
         }
 
     if(!disable_arm_solution) {
-        arm_solution->cartesian_to_actuator( transformed_target, actuator_pos );
+        static_cast<const Solution*>(arm_solution)->cartesian_to_actuator( transformed_target, actuator_pos );
 
     }else{
         // basically the same as cartesian, would be used for special homing situations like for scara
@@ -1385,7 +1709,7 @@ bool Robot::append_milestone(const float target[], float rate_mm_s)
             actuator_pos[i] = actuators[i]->get_last_milestone();
         }
         else { 
-        actuator_pos[i]= transformed_target[i];
+        actuator_pos[i]= transformed_target[i] + rotary_turns[i]; // rotary_turns is only non zero for a wrapping rotary axis
         if(actuators[i]->is_extruder() && get_e_scale_fnc) {
             // NOTE this relies on the fact only one extruder is active at a time
             // scale for volumetric or flow rate
@@ -1464,7 +1788,7 @@ bool Robot::append_milestone(const float target[], float rate_mm_s)
     // Append the block to the planner
     // NOTE that distance here should be either the distance travelled by the XYZ axis, or the E mm travel if a solo E move
     // NOTE this call will bock until there is room in the block queue, on_idle will continue to be called
-    if(THEKERNEL->planner->append_block( actuator_pos, n_motors, rate_mm_s, distance, unit_vec, acceleration, s_value, is_g123)) {
+    if(THEKERNEL->planner->append_block( actuator_pos, n_motors, is_uncoordinated ? requested_rate_mm_s : rate_mm_s, distance, unit_vec, acceleration, s_value, is_g123, is_uncoordinated)) {
         // this is the new compensated machine position
         memcpy(this->compensated_machine_position, transformed_target, n_motors*sizeof(float));
         return true;
@@ -1478,6 +1802,7 @@ bool Robot::append_milestone(const float target[], float rate_mm_s)
 bool Robot::delta_move(const float *delta, float rate_mm_s, uint8_t naxis)
 {
     if(THEKERNEL->is_halted()) return false;
+    flush_held_move();
 
     // catch negative or zero feed rates
     if(rate_mm_s <= 0.0F) {
@@ -1502,6 +1827,44 @@ bool Robot::delta_move(const float *delta, float rate_mm_s, uint8_t naxis)
     return false;
 }
 
+// Moves all the axis to an absolute machine position like a G53 G1 would, but without a Gcode, segmented only as much
+// as the arm solution needs, wrapping rotary axis take the shortest way round
+bool Robot::move_to(const float target[], float rate_mm_s)
+{
+    if(THEKERNEL->is_halted()) return false;
+    flush_held_move();
+
+    if(rate_mm_s <= 0.0F) {
+        return false;
+    }
+
+    float t[n_motors];
+    memcpy(t, target, n_motors*sizeof(float));
+
+    #if MAX_ROBOT_ACTUATORS > 3
+    for (int i = A_AXIS; i < n_motors; ++i) {
+        if(rotary_wrap[i]) {
+            float d= fmodf(t[i] - machine_position[i], 360.0F);
+            if(d > 180.0F) d -= 360.0F;
+            else if(d <= -180.0F) d += 360.0F;
+            t[i]= machine_position[i] + d;
+        }
+    }
+    #endif
+
+    uint16_t segments= disable_segmentation ? 1 : arm_solution->segments_needed(machine_position, t);
+    if(!append_segments(machine_position, t, rate_mm_s, segments)) return false;
+
+    memcpy(machine_position, t, n_motors*sizeof(float));
+    memcpy(arc_milestone, t, sizeof(arc_milestone));
+    #if MAX_ROBOT_ACTUATORS > 3
+    for (int i = A_AXIS; i < n_motors; ++i) {
+        if(rotary_wrap[i]) wrap_rotary_position(i);
+    }
+    #endif
+    return true;
+}
+
 // Append a move to the queue ( cutting it into segments if needed )
 bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, float delta_e)
 {
@@ -1527,8 +1890,9 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
         NOTE we need to do this before we segment the line (for deltas)
     */
     if(!isnan(delta_e) && gcode->has_g && gcode->g == 1) {
+        static PublicData::Handle<float> extruder_target(extruder_checksum, target_checksum);
         float data[2]= {delta_e, rate_mm_s / millimeters_of_travel};
-        if(PublicData::set_value(extruder_checksum, target_checksum, data)) {
+        if(extruder_target.request(data)) {
             rate_mm_s *= data[1]; // adjust the feedrate
         }
     }
@@ -1558,16 +1922,50 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
         }
     }
 
+    this->next_command_is_MCS = false; // always reset this
+
+    // an uncoordinated G0 starts and ends at rest so it is never blended, each actuator gets there as fast as it can
+    if(uncoordinated_rapids && !is_g123 && segments == 1 && isnan(delta_e)) {
+        flush_held_move();
+        is_uncoordinated= true;
+        bool moved= append_milestone(target, rate_mm_s);
+        is_uncoordinated= false;
+        return moved;
+    }
+
+    // with G64 an XYZ only line is held back until the next one is known, so the corner between them can be rounded
+    if(blend_tolerance > 0 && segments == 1 && isnan(delta_e)) {
+        bool xyz_only= true;
+        #if MAX_ROBOT_ACTUATORS > 3
+        for (int i = A_AXIS; i < n_motors; i++) {
+            if(target[i] != machine_position[i]) xyz_only= false;
+        }
+        #endif
+        if(xyz_only) return blend_line(target, rate_mm_s);
+    }
+    flush_held_move();
+
+    // non linear arm solutions may need shorter segments than the settings above give
+    if(!this->disable_segmentation) {
+        segments = max(segments, arm_solution->segments_needed(machine_position, target));
+    }
+
+    return append_segments(machine_position, target, rate_mm_s, segments);
+}
+
+// Append the line from -> to to the queue cut into the given number of equal segments, from is where the queue ends
+bool Robot::append_segments(const float from[], const float to[], float rate_mm_s, uint16_t segments)
+{
     bool moved= false;
     if (segments > 1) {
         // A vector to keep track of the endpoint of each segment
         float segment_delta[n_motors];
         float segment_end[n_motors];
-        memcpy(segment_end, machine_position, n_motors*sizeof(float));
+        memcpy(segment_end, from, n_motors*sizeof(float));
 
         // How far do we move each segment?
         for (int i = 0; i < n_motors; i++)
-            segment_delta[i] = (target[i] - machine_position[i]) / segments;
+            segment_delta[i] = (to[i] - from[i]) / segments;
 
         // segment 0 is already done - it's the end point of the previous move so we start at segment 1
         // We always add another point after this loop so we stop at segments-1, ie i < segments
@@ -1584,13 +1982,158 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
     }
 
     // Append the end of this full move to the queue
-    if(this->append_milestone(target, rate_mm_s)) moved= true;
-
-    this->next_command_is_MCS = false; // always reset this
+    if(this->append_milestone(to, rate_mm_s)) moved= true;
 
     return moved;
 }
 
+// a blended line, only the segments the arm solution needs
+bool Robot::append_blend_segment(const float from[], const float to[], float rate_mm_s)
+{
+    return append_segments(from, to, rate_mm_s, disable_segmentation ? 1 : arm_solution->segments_needed(from, to));
+}
+
+/*
+    G64 path blending. The line ending at machine_position is held back, when the next line comes the corner between
+    them is replaced by an arc tangent to both that stays within blend_tolerance of the corner, so a Z lift, an XY
+    travel and a Z descend become one move that does not stop: XY starts before Z is all the way up and Z starts down
+    before XY gets there. The arc is no longer than half the next line, the other half may be needed for its own end.
+    The last line is appended when something other than a G0/G1 comes, on a wait for idle, or when nothing came for
+    the queue delay time.
+*/
+bool Robot::blend_line(const float target[], float rate_mm_s)
+{
+    float corner[n_motors];
+    memcpy(corner, machine_position, n_motors*sizeof(float));
+
+    if(move_held) {
+        float u1[3], u2[3], l1= 0, l2= 0, c= 0;
+        for (int i = X_AXIS; i <= Z_AXIS; i++) {
+            u1[i]= corner[i] - held_from[i];
+            u2[i]= target[i] - corner[i];
+            l1 += u1[i] * u1[i];
+            l2 += u2[i] * u2[i];
+        }
+        l1= sqrtf(l1);
+        l2= sqrtf(l2);
+        for (int i = X_AXIS; i <= Z_AXIS; i++) {
+            u1[i] /= l1;
+            u2[i] /= l2;
+            c += u1[i] * u2[i];
+        }
+
+        float from[n_motors];
+        memcpy(from, corner, n_motors*sizeof(float));
+        for (int i = X_AXIS; i <= Z_AXIS; i++) from[i]= held_from[i];
+        move_held= false;
+
+        if(fabsf(c) > 0.9999F) {
+            // straight on, or straight back which has to stop anyway
+            append_blend_segment(from, corner, held_rate);
+
+        } else {
+            // the arc of radius r through the corner at distance l from it on both lines is tolerance off the corner
+            float half= acosf(c) / 2; // half the angle turned
+            float r= blend_tolerance * cosf(half) / (1 - cosf(half));
+            float l= std::min(r * tanf(half), std::min(l1, l2 / 2));
+            r= l / tanf(half);
+
+            float a[n_motors], b[n_motors];
+            memcpy(a, corner, n_motors*sizeof(float));
+            for (int i = X_AXIS; i <= Z_AXIS; i++) a[i] -= u1[i] * l;
+            if(l < l1) append_blend_segment(from, a, held_rate);
+
+            // the arc by angle from a about its center, same limits on the chords as G2/G3
+            float angle= 2 * half;
+            float arc_segment = this->mm_per_arc_segment;
+            if ((this->mm_max_arc_error > 0) && (2 * r > this->mm_max_arc_error)) {
+                float min_err_segment = 2 * sqrtf((this->mm_max_arc_error * (2 * r - this->mm_max_arc_error)));
+                if (arc_segment < min_err_segment) arc_segment = min_err_segment;
+            }
+            uint16_t segments= arc_segment > 0 ? std::max(1.0F, ceilf(angle * r / arc_segment)) : 1;
+
+            // the center is r from a square to u1 towards u2, radial is from the center to a, u1 is the direction of the arc at a
+            float center[3], radial[3];
+            for (int i = X_AXIS; i <= Z_AXIS; i++) {
+                center[i]= a[i] + (u2[i] - c * u1[i]) * r / sqrtf(1 - c * c);
+                radial[i]= a[i] - center[i];
+            }
+            float arc_rate= std::min(held_rate, rate_mm_s);
+            memcpy(b, a, n_motors*sizeof(float));
+            for (int n = 1; n <= segments; n++) {
+                if(THEKERNEL->is_halted()) return false;
+                float phi= angle * n / segments;
+                float sin_phi= sinf(phi), cos_phi= cosf(phi);
+                for (int i = X_AXIS; i <= Z_AXIS; i++) {
+                    b[i]= center[i] + radial[i] * cos_phi + u1[i] * r * sin_phi;
+                }
+                append_blend_segment(a, b, arc_rate);
+                memcpy(a, b, n_motors*sizeof(float));
+            }
+            // the next line starts where the arc ends
+            for (int i = X_AXIS; i <= Z_AXIS; i++) corner[i]= b[i];
+        }
+    }
+
+    memcpy(held_from, corner, sizeof(held_from));
+    held_rate= rate_mm_s;
+    held_time= us_ticker_read();
+    move_held= true;
+    return true;
+}
+
+// append the line held back for blending as it is
+void Robot::flush_held_move()
+{
+    if(!move_held) return;
+    // cleared first, appending it can wait for room in the queue which calls on_idle
+    move_held= false;
+    if(THEKERNEL->is_halted()) return;
+
+    float from[n_motors];
+    memcpy(from, machine_position, n_motors*sizeof(float));
+    for (int i = X_AXIS; i <= Z_AXIS; i++) from[i]= held_from[i];
+    append_blend_segment(from, machine_position, held_rate);
+}
+
+void Robot::on_idle(void *argument)
+{
+    if(!move_held) return;
+    // no next line to blend with came before the moves ahead of it ran low, the held one has to go on its own.
+    // it is appended while the line before it has not started yet so that one does not stop at the corner,
+    // with nothing moving it waits as long as the conveyor does for more lines
+    if(THECONVEYOR->is_running_low() || (THECONVEYOR->is_queue_empty() && (us_ticker_read() - held_time) >= THECONVEYOR->get_queue_delay_time_ms() * 1000)) {
+        flush_held_move();
+        THECONVEYOR->force_queue();
+    }
+}
+
+// The whole turns of a wrapping rotary axis pile up in rotary_turns and in its actuator position, after many turns the
+// float actuator position would lose its precision, so they are taken out of the actuator again while nothing moves.
+// Only whole steps are taken out, what is left of a turn that is not a whole number of steps stays in rotary_turns.
+// Done from the main loop as on_idle is also called from inside append_milestone.
+void Robot::on_main_loop(void *argument)
+{
+    #if MAX_ROBOT_ACTUATORS > 3
+    if(move_held || THEKERNEL->is_halted() || !THECONVEYOR->is_idle()) return;
+
+    for (int i = A_AXIS; i < n_motors; ++i) {
+        if(rotary_turns[i] == 0) continue;
+        StepperMotor *m= actuators[i];
+        int32_t steps= lround(rotary_turns[i] * (double)m->get_steps_per_mm());
+        if(steps == 0) continue;
+        rotary_turns[i]= rotary_turns[i] - (double)steps / m->get_steps_per_mm();
+        m->rebase_position(compensated_machine_position[i] + rotary_turns[i], steps);
+    }
+    #endif
+}
+
+void Robot::on_halt(void *argument)
+{
+    // a halt drops the queue, the held line goes with it
+    if(argument == nullptr) move_held= false;
+}
+
 
 // Append an arc to the queue ( cutting it into segments as needed )
 // TODO does not support any E parameters so cannot be used for 3D printing.
@@ -1801,13 +2344,15 @@ bool Robot::is_homed(uint8_t i) const
     if(i >= 3) return false; // safety
 
     // if we are homing we ignore soft endstops so return false
+    static PublicData::Handle<bool> homing_status(endstops_checksum, get_homing_status_checksum);
     bool homing;
-    bool ok = PublicData::get_value(endstops_checksum, get_homing_status_checksum, 0, &homing);
+    bool ok = homing_status.request(&homing);
     if(!ok || homing) return false;
 
     // check individual axis homing status
+    static PublicData::Handle<bool> homed_status(endstops_checksum, get_homed_status_checksum);
     bool homed[3];
-    ok = PublicData::get_value(endstops_checksum, get_homed_status_checksum, 0, homed);
+    ok = homed_status.request(homed);
     if(!ok) return false;
     return homed[i];
 }
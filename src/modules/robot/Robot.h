@@ -14,6 +14,7 @@ using std::string;
 #include <functional>
 #include <stack>
 #include <vector>
+#include <bitset>
 
 #include "libs/Module.h"
 #include "ActuatorCoordinates.h"
@@ -21,6 +22,7 @@ using std::string;
 
 class Gcode;
 class BaseSolution;
+class StreamOutput;
 class StepperMotor;
 
 // 9 WCS offsets
@@ -32,6 +34,9 @@ class Robot : public Module {
         Robot();
         void on_module_loaded();
         void on_gcode_received(void* argument);
+        void on_idle(void* argument);
+        void on_main_loop(void* argument);
+        void on_halt(void* argument);
 
         void reset_axis_position(float position, int axis);
         void reset_axis_position(float x, float y, float z);
@@ -42,11 +47,15 @@ class Robot : public Module {
         float get_default_acceleration() const { return default_acceleration; }
         void setToolOffset(const float offset[N_PRIMARY_AXIS]);
         float get_feed_rate() const;
+        float get_feed_rate(bool seek) const { return seek ? seek_rate : feed_rate; }
         float get_s_value() const { return s_value; }
         void set_s_value(float s) { s_value= s; }
         void  push_state();
         void  pop_state();
         void check_max_actuator_speeds();
+        void save_settings();
+        void restore_settings();
+        void print_arm_options(StreamOutput *stream) const;
         float to_millimeters( float value ) const { return this->inch_mode ? value * 25.4F : value; }
         float from_millimeters( float value) const { return this->inch_mode ? value/25.4F : value;  }
         float get_axis_position(int axis) const { return(this->machine_position[axis]); }
@@ -59,8 +68,11 @@ class Robot : public Module {
         std::tuple<float, float, float, uint8_t> get_last_probe_position() const { return last_probe_position; }
         void set_last_probe_position(std::tuple<float, float, float, uint8_t> p) { last_probe_position = p; }
         bool delta_move(const float delta[], float rate_mm_s, uint8_t naxis);
+        bool move_to(const float target[], float rate_mm_s);
+        void flush_held_move();
         uint8_t register_motor(StepperMotor*);
         uint8_t get_number_registered_motors() const {return n_motors; }
+        bool is_rotary_wrap(int axis) const { return rotary_wrap[axis]; }
 
         BaseSolution* arm_solution;                           // Selected Arm solution ( millimeters to step calculation )
 
@@ -91,6 +103,10 @@ class Robot : public Module {
             bool is_g123:1;
             bool soft_endstop_enabled:1;
             bool soft_endstop_halt:1;
+            bool move_held:1;                                 // the line to machine_position is held back for G64 blending
+            bool uncoordinated_rapids:1;                      // G0 moves each actuator at its own limits, the path is not a line
+            bool is_uncoordinated:1;                          // set while appending an uncoordinated G0
+            bool cartesian_arm:1;                             // the arm solution is a CartesianSolution
             uint8_t plane_axis_0:2;                           // Current plane ( XY, XZ, YZ )
             uint8_t plane_axis_1:2;
             uint8_t plane_axis_2:2;
@@ -107,11 +123,16 @@ class Robot : public Module {
 
         void load_config();
         bool append_milestone(const float target[], float rate_mm_s);
+        template<class Solution> bool append_milestone_for(const float target[], float rate_mm_s);
         bool append_line( Gcode* gcode, const float target[], float rate_mm_s, float delta_e);
+        bool append_segments(const float from[], const float to[], float rate_mm_s, uint16_t segments);
+        bool append_blend_segment(const float from[], const float to[], float rate_mm_s);
+        bool blend_line(const float target[], float rate_mm_s);
         bool append_arc( Gcode* gcode, const float target[], const float offset[], float radius, bool is_clockwise );
         bool compute_arc(Gcode* gcode, const float offset[], const float target[], enum MOTION_MODE_T motion_mode);
         void process_move(Gcode *gcode, enum MOTION_MODE_T);
         bool is_homed(uint8_t i) const;
+        void wrap_rotary_position(int axis);
 
         float theta(float x, float y);
         void select_plane(uint8_t axis_0, uint8_t axis_1, uint8_t axis_2);
@@ -129,6 +150,8 @@ class Robot : public Module {
 
         float machine_position[k_max_actuators]; // Last requested position, in millimeters, which is what we were requested to move to in the gcode after offsets applied but before compensation transform
         float compensated_machine_position[k_max_actuators]; // Last machine position, which is the position before converting to actuator coordinates (includes compensation transform)
+        float rotary_turns[k_max_actuators]; // whole turns taken by a wrapping rotary axis, the actuator position is machine_position + rotary_turns
+        std::bitset<k_max_actuators> rotary_wrap; // set for rotary ABC axis that wrap at 360° and move the shortest way round
 
         float seek_rate;                                     // Current rate for seeking moves ( mm/min )
         float feed_rate;                                     // Current rate for feeding moves ( mm/min )
@@ -140,6 +163,11 @@ class Robot : public Module {
         float default_acceleration;                          // the defualt accleration if not set for each axis
         float s_value;                                       // modal S value
         float arc_milestone[3];                              // used as start of an arc command
+        float blend_tolerance;                               // G64 P, how far the path may be off a corner, 0 is G61 exact path
+        float path_blend_tolerance;                          // Setting : the tolerance of a G64 without P
+        float held_from[3];                                  // start of the line held back for blending
+        float held_rate;
+        uint32_t held_time;
 
         // Number of arc generation iterations by small angle approximation before exact arc trajectory
         // correction. This parameter may be decreased if there are issues with the accuracy of the arc
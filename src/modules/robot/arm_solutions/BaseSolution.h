@@ -3,6 +3,7 @@
 #define BASESOLUTION_H
 
 #include <map>
+#include <stdint.h>
 #include "ActuatorCoordinates.h"
 
 class Config;
@@ -14,6 +15,10 @@ class BaseSolution {
         virtual ~BaseSolution() {};
         virtual void cartesian_to_actuator(const float[], ActuatorCoordinates &) const = 0;
         virtual void actuator_to_cartesian(const ActuatorCoordinates &, float[]) const = 0;
+        // number of segments a move needs for a non linear solution to be followed closely, Robot uses the larger of this and its own segmentation
+        virtual uint16_t segments_needed(const float from[], const float to[]) const { return 1; };
+        // false if cartesian_to_actuator() would have to change the target to reach it
+        virtual bool is_reachable(const float target[]) const { return true; };
         typedef std::map<char, float> arm_options_t;
         virtual bool set_optional(const arm_options_t& options) { return false; };
         virtual bool get_optional(arm_options_t& options, bool force_all= false) const { return false; };
@@ -0,0 +1,98 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CamZSolution.h"
+#include "ActuatorCoordinates.h"
+#include "checksumm.h"
+#include "ConfigValue.h"
+#include "libs/Config.h"
+#include "libs/nuts_bolts.h"
+#include "libs/utils.h"
+
+#include <math.h>
+
+#define cam_z_radius_checksum       CHECKSUM("cam_z_radius")
+#define cam_z_max_angle_checksum    CHECKSUM("cam_z_max_angle")
+#define cam_z_segment_mm_checksum   CHECKSUM("cam_z_segment_mm")
+
+#define PIOVER180   0.01745329251994329576923690768489F
+
+CamZSolution::CamZSolution(Config* config)
+{
+    // distance from the cam axis to the follower, the nozzle travels cam_radius * sin(angle)
+    cam_radius = config->value(cam_z_radius_checksum)->by_default(24.0f)->as_number();
+    // largest cam angle either way, past this the cam no longer moves the nozzle
+    max_angle = config->value(cam_z_max_angle_checksum)->by_default(60.0f)->as_number();
+    // Z moves are split into segments this long so the nozzle follows the planned profile instead of the cam
+    segment_mm = config->value(cam_z_segment_mm_checksum)->by_default(0.5f)->as_number();
+
+    init();
+}
+
+void CamZSolution::init()
+{
+    max_travel = cam_radius * sinf(max_angle * PIOVER180);
+}
+
+void CamZSolution::cartesian_to_actuator(const float cartesian_mm[], ActuatorCoordinates &actuator_mm ) const
+{
+    actuator_mm[ALPHA_STEPPER] = cartesian_mm[X_AXIS];
+    actuator_mm[BETA_STEPPER ] = cartesian_mm[Y_AXIS];
+
+    // clamp to the travel of the cam, asinf is undefined outside of it. Robot refuses G0-G3 targets outside of it, see
+    // is_reachable(), so this only limits the moves homing makes to find the endstop
+    float z = confine(cartesian_mm[Z_AXIS], -max_travel, max_travel);
+    actuator_mm[GAMMA_STEPPER] = asinf(z / cam_radius) / PIOVER180;
+}
+
+void CamZSolution::actuator_to_cartesian(const ActuatorCoordinates &actuator_mm, float cartesian_mm[] ) const
+{
+    cartesian_mm[X_AXIS] = actuator_mm[ALPHA_STEPPER];
+    cartesian_mm[Y_AXIS] = actuator_mm[BETA_STEPPER];
+    cartesian_mm[Z_AXIS] = cam_radius * sinf(actuator_mm[GAMMA_STEPPER] * PIOVER180);
+}
+
+bool CamZSolution::is_reachable(const float target[]) const
+{
+    return fabsf(target[Z_AXIS]) <= max_travel;
+}
+
+uint16_t CamZSolution::segments_needed(const float from[], const float to[]) const
+{
+    float dz = fabsf(to[Z_AXIS] - from[Z_AXIS]);
+    if(dz == 0 || segment_mm <= 0) return 1;
+    return ceilf(dz / segment_mm);
+}
+
+bool CamZSolution::set_optional(const arm_options_t& options)
+{
+    arm_options_t::const_iterator i;
+
+    i = options.find('R');         // cam radius
+    if(i != options.end()) {
+        cam_radius = i->second;
+    }
+    i = options.find('A');         // max cam angle
+    if(i != options.end()) {
+        max_angle = i->second;
+    }
+    i = options.find('S');         // segment length
+    if(i != options.end()) {
+        segment_mm = i->second;
+    }
+
+    init();
+    return true;
+}
+
+bool CamZSolution::get_optional(arm_options_t& options, bool force_all) const
+{
+    options['R'] = this->cam_radius;
+    options['A'] = this->max_angle;
+    options['S'] = this->segment_mm;
+    return true;
+}
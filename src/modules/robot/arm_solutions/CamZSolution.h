@@ -0,0 +1,36 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "BaseSolution.h"
+
+class Config;
+
+// Cartesian XY with the CHMT cam/rocker Z.
+// The gamma actuator turns a cam shared by two nozzles, positive angles lower nozzle 1 and negative angles lower nozzle 2.
+// Z is the nozzle travel in mm (positive for nozzle 1, negative for nozzle 2) and gamma is the cam angle in degrees,
+// the travel is cam_z_radius * sin(angle) so the planner limits the real nozzle speed and acceleration
+class CamZSolution : public BaseSolution {
+    public:
+        CamZSolution(Config*);
+        void cartesian_to_actuator(const float[], ActuatorCoordinates &) const override;
+        void actuator_to_cartesian(const ActuatorCoordinates &, float[] ) const override;
+        uint16_t segments_needed(const float from[], const float to[]) const override;
+        bool is_reachable(const float target[]) const override;
+
+        bool set_optional(const arm_options_t& options) override;
+        bool get_optional(arm_options_t& options, bool force_all) const override;
+
+    private:
+        void init();
+
+        float cam_radius;
+        float max_angle;
+        float segment_mm;
+        float max_travel;
+};
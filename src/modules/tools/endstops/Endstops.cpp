@@ -15,6 +15,7 @@
 #include "libs/Pin.h"
 #include "libs/StepperMotor.h"
 #include "wait_api.h" // mbed.h lib
+#include "us_ticker_api.h" // mbed
 #include "Robot.h"
 #include "Config.h"
 #include "SlowTicker.h"
@@ -24,11 +25,15 @@
 #include "ConfigValue.h"
 #include "libs/StreamOutput.h"
 #include "PublicDataRequest.h"
+#include "PublicData.h"
 #include "EndstopsPublicAccess.h"
 #include "StreamOutputPool.h"
 #include "StepTicker.h"
 #include "BaseSolution.h"
 #include "SerialMessage.h"
+#include "FlashStore.h"
+#include "FlightRecorder.h"
+#include "MotorChannel.h"
 
 #include <ctype.h>
 #include <algorithm>
@@ -64,6 +69,7 @@ enum DEFNS {MIN_PIN, MAX_PIN, MAX_TRAVEL, FAST_RATE, SLOW_RATE, RETRACT, DIRECTI
 #define home_z_first_checksum            CHECKSUM("home_z_first")
 #define homing_order_checksum            CHECKSUM("homing_order")
 #define move_to_origin_checksum          CHECKSUM("move_to_origin_after_home")
+#define concurrent_homing_checksum       CHECKSUM("concurrent_homing")
 
 #define alpha_trim_checksum              CHECKSUM("alpha_trim_mm")
 #define beta_trim_checksum               CHECKSUM("beta_trim_mm")
@@ -87,6 +93,8 @@ enum DEFNS {MIN_PIN, MAX_PIN, MAX_TRAVEL, FAST_RATE, SLOW_RATE, RETRACT, DIRECTI
 #define retract_checksum                   CHECKSUM("retract")
 #define limit_checksum                     CHECKSUM("limit_enable")
 
+#define store_home_offset_checksum         CHECKSUM("store_home_offset")
+
 #define STEPPER THEROBOT->actuators
 #define STEPS_PER_MM(a) (STEPPER[a]->get_steps_per_mm())
 
@@ -106,6 +114,7 @@ enum STATES {
 Endstops::Endstops()
 {
     this->status = NOT_HOMING;
+    this->watched_axes = 0xFF;
 }
 
 void Endstops::on_module_loaded()
@@ -129,6 +138,19 @@ void Endstops::on_module_loaded()
     register_for_event(ON_GET_PUBLIC_DATA);
     register_for_event(ON_SET_PUBLIC_DATA);
 
+    // asked on every ? and every soft endstop check so these are called directly
+    PublicData::provide<bool>(endstops_checksum, get_homing_status_checksum, [this](bool *homing) {
+        *homing = this->status != NOT_HOMING;
+        return true;
+    });
+    PublicData::provide<bool>(endstops_checksum, get_homed_status_checksum, [this](bool *homed) {
+        for (int i = 0; i < 3; ++i) {
+            homed[i]= homing_axis[i].homed;
+        }
+        return true;
+    });
+
+    restore_settings();
 
     THEKERNEL->slow_ticker->attach(1000, this, &Endstops::read_endstops);
 }
@@ -280,7 +302,7 @@ bool Endstops::load_config()
         // check we are not going above the number of defined actuators/axis
         if(i >= THEROBOT->get_number_registered_motors()) {
             // too many axis we only have configured n_motors
-            THEKERNEL->streams->printf("ERROR: endstop %d is greater than number of defined motors. Endstops disabled\n", i);
+            THEKERNEL->streams->printf("ERROR: endstop %d is greater than number of defined motors. Endstops disabled\n", (int)i);
             delete pin_info;
             return false;
         }
@@ -416,6 +438,10 @@ void Endstops::get_global_configs()
 
     // set to true by default for deltas due to trim, false on cartesians
     this->move_to_origin_after_home = THEKERNEL->config->value(move_to_origin_checksum)->by_default(is_delta)->as_bool();
+
+    // every axis homes on its own at the same time, only for machines where each axis is one actuator
+    this->concurrent_homing = THEKERNEL->config->value(concurrent_homing_checksum)->by_default(false)->as_bool() &&
+                              !(this->is_corexy || this->is_delta || this->is_rdelta || this->is_scara);
 }
 
 bool Endstops::debounced_get(Pin *pin)
@@ -469,6 +495,7 @@ void Endstops::on_idle(void *argument)
                 }
                 this->status = LIMIT_TRIGGERED;
                 i->debounce= 0;
+                THEKERNEL->flight_recorder->record(FlightRecorder::ENDSTOP, i->axis_index, STEPPER[i->axis_index]->get_current_step());
                 // disables heaters and motors, ignores incoming Gcode and flushes block queue
                 THEKERNEL->call_event(ON_HALT, nullptr);
                 return;
@@ -564,6 +591,9 @@ uint32_t Endstops::read_endstops(uint32_t dummy)
         // for corexy homing in X or Y we must only check the associated endstop, works as we only home one axis at a time for corexy
         if(is_corexy && (m == X_AXIS || m == Y_AXIS) && !axis_to_home[m]) continue;
 
+        // an axis homing concurrently is not watched while it moves back off its endstop
+        if((watched_axes & (1 << m)) == 0) continue;
+
         if(STEPPER[m]->is_moving()) {
             // if it is moving then we check the associated endstop, and debounce it
             if(e.pin_info->pin.get()) {
@@ -581,6 +611,7 @@ uint32_t Endstops::read_endstops(uint32_t dummy)
                         STEPPER[m]->stop_moving();
                     }
                     e.pin_info->triggered= true;
+                    THEKERNEL->flight_recorder->record(FlightRecorder::ENDSTOP, m, STEPPER[m]->get_current_step());
                 }
 
             } else {
@@ -746,6 +777,178 @@ void Endstops::home(axis_bitmap_t a)
     this->status = NOT_HOMING;
 }
 
+// Every axis runs its own fast approach, retract and slow approach on a motor channel of its own, so an axis starts
+// its next phase as soon as it is done with the last and the whole cycle takes as long as the slowest axis.
+// The channels step the actuators directly, so the distances and rates are converted through the arm solution (the cam
+// Z is in degrees). Returns false without moving if an axis needs more than its own actuator to move, or there are
+// not enough motor channels, the axes are then homed the usual way.
+bool Endstops::home_concurrent(axis_bitmap_t a)
+{
+    enum { FAST, BACK, SLOW, DONE };
+    struct axis_state_t {
+        MotorChannel *channel;
+        float acceleration;
+        uint8_t phase;
+        bool cartesian_acceleration;    // the default acceleration is in mm/sec² and has to be converted
+    };
+    axis_state_t state[homing_axis.size()];
+
+    ActuatorCoordinates actuator_pos;
+    actuator_pos.fill(0);
+    auto read_actuators= [&actuator_pos]() {
+        for (int i = X_AXIS; i <= Z_AXIS; ++i) actuator_pos[i]= STEPPER[i]->get_current_position();
+    };
+
+    // a cartesian move of distance mm along the axis as a move of its actuator, false if there is nothing to move
+    auto move= [this, &state, &actuator_pos, &read_actuators](int i, float distance, float rate) {
+        float d= distance;
+        if(i <= Z_AXIS) {
+            read_actuators();
+            d= actuator_distance(THEROBOT->arm_solution, actuator_pos, i, distance);
+            if(isnan(d)) return false;
+        }
+        float scale= distance != 0 ? fabsf(d / distance) : 1.0F;
+        return state[i].channel->move(d, rate * scale, state[i].cartesian_acceleration ? state[i].acceleration * scale : state[i].acceleration);
+    };
+
+    // each axis has to be moved by its own actuator alone
+    read_actuators();
+    for (auto& e : homing_axis) {
+        int i= e.axis_index;
+        if(a[i] && i <= Z_AXIS && isnan(actuator_distance(THEROBOT->arm_solution, actuator_pos, i, e.max_travel))) {
+            THEKERNEL->streams->printf("WARNING: concurrent homing needs one actuator per axis, homing the usual way\n");
+            return false;
+        }
+    }
+
+    // the channels are all taken before anything moves
+    bool added= true;
+    for (auto& e : homing_axis) {
+        int i= e.axis_index;
+        state[i].channel= nullptr;
+        state[i].phase= DONE;
+        if(!a[i] || !added) continue;
+
+        state[i].channel= new MotorChannel(STEPPER[i]);
+        if(!THEKERNEL->step_ticker->add_channel(state[i].channel)) {
+            delete state[i].channel;
+            state[i].channel= nullptr;
+            added= false;
+        }
+    }
+    if(!added) {
+        for (auto& e : homing_axis) {
+            int i= e.axis_index;
+            if(state[i].channel == nullptr) continue;
+            THEKERNEL->step_ticker->remove_channel(state[i].channel);
+            delete state[i].channel;
+        }
+        THEKERNEL->streams->printf("WARNING: not enough motor channels for concurrent homing, homing the usual way\n");
+        return false;
+    }
+
+    for(auto& e : endstops) {
+       e->debounce= 0;
+       e->triggered= false;
+    }
+
+    this->axis_to_home= a;
+    this->status = MOVING_TO_ENDSTOP_FAST;
+    this->watched_axes = 0;
+
+    // the channels bypass the conveyor which normally turns the motors on
+    THEKERNEL->call_event(ON_ENABLE, (void*)1);
+
+    // twice as long as the slowest axis would take at its rates, plus time to accelerate
+    float timeout= 0;
+    for (auto& e : homing_axis) {
+        int i= e.axis_index;
+        if(!a[i]) continue;
+
+        StepperMotor *m= STEPPER[i];
+        state[i].cartesian_acceleration= isnan(m->get_acceleration());
+        state[i].acceleration= state[i].cartesian_acceleration ? THEROBOT->get_default_acceleration() : m->get_acceleration();
+        state[i].phase= FAST;
+        watched_axes |= (1 << i);
+        move(i, e.home_direction ? -e.max_travel : e.max_travel, e.fast_rate);
+
+        timeout= std::max(timeout, 2 * (e.max_travel / e.fast_rate + 3 * e.retract / e.slow_rate) + 2);
+    }
+    uint32_t timeout_us= std::min(timeout, 3600.0F) * 1000000;
+    uint32_t start_us= us_ticker_read();
+
+    bool failed= false;
+    while(!THEKERNEL->is_halted()) {
+        bool done= true;
+        for (auto& e : homing_axis) {
+            int i= e.axis_index;
+            if(state[i].phase == DONE) continue;
+            done= false;
+
+            MotorChannel *c= state[i].channel;
+            if(!c->is_idle()) continue;
+
+            // the endstop stopped it short of where it was sent
+            StepperMotor *m= c->get_motor();
+            m->change_last_milestone(m->get_current_position());
+
+            switch(state[i].phase) {
+                case FAST:
+                    if(!e.pin_info->triggered) { failed= true; break; }
+                    watched_axes &= ~(1 << i);
+                    // with no retract (the Z cam on its stop) it is done
+                    state[i].phase= move(i, e.home_direction ? e.retract : -e.retract, e.slow_rate) ? BACK : DONE;
+                    break;
+
+                case BACK:
+                    // move further than we moved off to make sure we hit it cleanly
+                    e.pin_info->debounce= 0;
+                    e.pin_info->triggered= false;
+                    watched_axes |= (1 << i);
+                    move(i, e.home_direction ? -e.retract * 2 : e.retract * 2, e.slow_rate);
+                    state[i].phase= SLOW;
+                    break;
+
+                case SLOW:
+                    if(!e.pin_info->triggered) { failed= true; break; }
+                    watched_axes &= ~(1 << i);
+                    state[i].phase= DONE;
+                    break;
+            }
+            if(failed) break;
+        }
+
+        if(done) break;
+        // an axis that never gets to its endstop, or never gets away from it
+        if(us_ticker_read() - start_us > timeout_us) failed= true;
+
+        if(failed) {
+            // stops the other axes
+            this->status = NOT_HOMING;
+            THEKERNEL->call_event(ON_HALT, nullptr);
+            break;
+        }
+
+        THEKERNEL->call_event(ON_IDLE, this);
+    }
+
+    for (auto& e : homing_axis) {
+        int i= e.axis_index;
+        if(state[i].channel == nullptr) continue;
+        THEKERNEL->step_ticker->remove_channel(state[i].channel);
+        // the planner never saw these moves, the next one has to take up the backlash from where they left it
+        state[i].channel->get_motor()->set_planned_direction_from_last_step();
+        delete state[i].channel;
+    }
+    this->watched_axes = 0xFF;
+
+    // the moves stopped short at the endstops, or wherever a halt caught them
+    THEROBOT->reset_position_from_current_actuator_position();
+
+    this->status = NOT_HOMING;
+    return true;
+}
+
 void Endstops::process_home_command(Gcode* gcode)
 {
     // First wait for the queue to be empty
@@ -805,7 +1008,10 @@ void Endstops::process_home_command(Gcode* gcode)
     }
 
     // do the actual homing
-    if(homing_order != 0 && !is_scara) {
+    if(concurrent_homing && home_concurrent(haxis)) {
+        // every axis at the same time, the order does not matter
+
+    } else if(homing_order != 0 && !is_scara) {
         // if an order has been specified do it in the specified order
         // homing order is 0bfffeeedddcccbbbaaa where aaa is 1,2,3,4,5,6 to specify the first axis (XYZABC), bbb is the second and ccc is the third etc
         // eg 0b0101011001010 would be Y X Z A, 011 010 001 100 101 would be  B A X Y Z
@@ -937,6 +1143,21 @@ void Endstops::process_home_command(Gcode* gcode)
     }
 }
 
+// M500 saves the homing offsets in the flash store, one per homing axis
+void Endstops::save_settings()
+{
+    std::vector<float> buf;
+    for (auto &p : homing_axis) buf.push_back(p.home_offset);
+    THEKERNEL->flash_store->put(store_home_offset_checksum, buf.data(), buf.size() * sizeof(float));
+}
+
+void Endstops::restore_settings()
+{
+    std::vector<float> buf(homing_axis.size());
+    if(!THEKERNEL->flash_store->get(store_home_offset_checksum, buf.data(), buf.size() * sizeof(float))) return;
+    for (size_t i = 0; i < homing_axis.size(); ++i) homing_axis[i].home_offset= buf[i];
+}
+
 void Endstops::set_homing_offset(Gcode *gcode)
 {
     // M306 Similar to M206 but sets Homing offsets based on current MCS position
@@ -1119,8 +1340,13 @@ void Endstops::on_gcode_received(void *argument)
                 break;
 
             case 500: // save settings
+                save_settings();
+                // fall through to print what is not stored, M500 reports it
             case 503: // print settings
-                if(!is_rdelta) {
+                if(gcode->m == 500) {
+                    // the home offsets are stored
+
+                } else if(!is_rdelta) {
                     gcode->stream->printf(";Home offset (mm):\nM206 ");
                     for (auto &p : homing_axis) {
                         if(p.pin_info == nullptr) continue; // ignore if not a homing endstop
@@ -1190,18 +1416,6 @@ void Endstops::on_get_public_data(void* argument)
     } else if(pdr->second_element_is(saved_position_checksum)) {
         pdr->set_data_ptr(&this->saved_position);
         pdr->set_taken();
-
-    } else if(pdr->second_element_is(get_homing_status_checksum)) {
-        bool *homing = static_cast<bool *>(pdr->get_data_ptr());
-        *homing = this->status != NOT_HOMING;
-        pdr->set_taken();
-
-    } else if(pdr->second_element_is(get_homed_status_checksum)) {
-        bool *homed = static_cast<bool *>(pdr->get_data_ptr());
-        for (int i = 0; i < 3; ++i) {
-            homed[i]= homing_axis[i].homed;
-        }
-        pdr->set_taken();
     }
 }
 
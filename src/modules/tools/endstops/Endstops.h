@@ -9,10 +9,14 @@
 
 #include "libs/Module.h"
 #include "Pin.h"
+#include "BaseSolution.h"
+
+#include <math.h>
 
 #include <bitset>
 #include <array>
 #include <map>
+#include <vector>
 
 class StepperMotor;
 class Gcode;
@@ -24,6 +28,21 @@ class Endstops : public Module{
         void on_module_loaded();
         void on_gcode_received(void* argument);
 
+        // how far actuator axis (X Y or Z) moves from the actuator position from for the cartesian axis to move
+        // distance mm, NAN if the arm solution would have to move another actuator as well
+        static float actuator_distance(const BaseSolution *solution, const ActuatorCoordinates &from, int axis, float distance)
+        {
+            float cartesian[3];
+            solution->actuator_to_cartesian(from, cartesian);
+            cartesian[axis] += distance;
+            ActuatorCoordinates to;
+            solution->cartesian_to_actuator(cartesian, to);
+            for (int i = 0; i < 3; ++i) {
+                if(i != axis && fabsf(to[i] - from[i]) > 0.0001F) return NAN;
+            }
+            return to[axis] - from[axis];
+        }
+
     private:
         bool load_old_config();
         bool load_config();
@@ -31,6 +50,7 @@ class Endstops : public Module{
         using axis_bitmap_t = std::bitset<6>;
         void home(axis_bitmap_t a);
         void home_xy();
+        bool home_concurrent(axis_bitmap_t a);
         void back_off_home(axis_bitmap_t axis);
         void move_to_origin(axis_bitmap_t axis);
         void on_get_public_data(void* argument);
@@ -39,6 +59,8 @@ class Endstops : public Module{
         bool debounced_get(Pin *pin);
         void process_home_command(Gcode* gcode);
         void set_homing_offset(Gcode* gcode);
+        void save_settings();
+        void restore_settings();
         uint32_t read_endstops(uint32_t dummy);
         void handle_park(Gcode * gcode);
 
@@ -47,6 +69,7 @@ class Endstops : public Module{
         uint32_t debounce_count;
         uint32_t  debounce_ms;
         axis_bitmap_t axis_to_home;
+        volatile uint8_t watched_axes; // endstops that stop their motor while homing, bit per axis index
 
         float trim_mm[3];
 
@@ -95,5 +118,6 @@ class Endstops : public Module{
             bool is_scara:1;
             bool home_z_first:1;
             bool move_to_origin_after_home:1;
+            bool concurrent_homing:1;
         };
 };
@@ -22,6 +22,7 @@
 #include "Gcode.h"
 #include "libs/StreamOutput.h"
 #include "PublicDataRequest.h"
+#include "PublicData.h"
 #include "StreamOutputPool.h"
 #include "ExtruderPublicAccess.h"
 
@@ -82,6 +83,19 @@ void Extruder::on_module_loaded()
     this->register_for_event(ON_GCODE_RECEIVED);
     this->register_for_event(ON_GET_PUBLIC_DATA);
     this->register_for_event(ON_SET_PUBLIC_DATA);
+
+    // handle extrude rates request from robot, on every G1 with an E so it is called directly
+    PublicData::provide<float>(extruder_checksum, target_checksum, [this](float *d) {
+        // disabled extruders do not reply NOTE only one enabled extruder supported
+        if(!this->selected) return false;
+
+        float delta = d[0]; // the E passed in on Gcode is the delta volume in mm³
+        float isecs = d[1]; // inverted secs
+
+        // check against maximum speeds and return rate modifier
+        d[1] = check_max_speeds(delta, isecs);
+        return true;
+    });
 }
 
 // Get config
@@ -163,21 +177,6 @@ void Extruder::on_set_public_data(void *argument)
 
     if(!pdr->starts_with(extruder_checksum)) return;
 
-    // handle extrude rates request from robot
-    if(pdr->second_element_is(target_checksum)) {
-        // disabled extruders do not reply NOTE only one enabled extruder supported
-        if(!this->selected) return;
-
-        float *d = static_cast<float *>(pdr->get_data_ptr());
-        float delta = d[0]; // the E passed in on Gcode is the delta volume in mm³
-        float isecs = d[1]; // inverted secs
-
-        // check against maximum speeds and return rate modifier
-        d[1] = check_max_speeds(delta, isecs);
-        pdr->set_taken();
-        return;
-    }
-
     // save or restore extruder state
     if(pdr->second_element_is(save_state_checksum)) {
         save_position();
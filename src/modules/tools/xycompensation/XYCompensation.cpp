@@ -0,0 +1,325 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "XYCompensation.h"
+
+#include "Kernel.h"
+#include "Robot.h"
+#include "Gcode.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "StreamOutput.h"
+#include "FlashStore.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+
+#define xy_compensation_checksum           CHECKSUM("xy_compensation")
+#define enable_checksum                    CHECKSUM("enable")
+
+#define store_xy_compensation_checksum     CHECKSUM("store_xy_compensation")
+// row n of the grid is saved as record n of this key
+#define store_xy_grid_checksum             CHECKSUM("store_xy_grid")
+
+// a row of X,Y pairs has to fit in one flash store record
+#define XYCOMP_MAX_NODES 32
+
+XYCompensation::XYCompensation()
+{
+    matrix[0]= matrix[3]= 1.0F;
+    matrix[1]= matrix[2]= 0.0F;
+    memcpy(inverse_matrix, matrix, sizeof(matrix));
+    x_start= y_start= 0.0F;
+    pitch_x= pitch_y= 0.0F;
+    nodes= nullptr;
+    cells= nullptr;
+    nx= ny= 0;
+    enabled= false;
+}
+
+XYCompensation::~XYCompensation()
+{
+    clear_grid();
+}
+
+void XYCompensation::on_module_loaded()
+{
+    if(!THEKERNEL->config->value(xy_compensation_checksum, enable_checksum)->by_default(false)->as_bool()) {
+        // as not needed free up resource
+        delete this;
+        return;
+    }
+
+    register_for_event(ON_GCODE_RECEIVED);
+
+    restore_settings();
+}
+
+void XYCompensation::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+
+    if(!gcode->has_m) return;
+
+    switch(gcode->m) {
+        case 380:
+            if(gcode->has_letter('S')) {
+                set_enable(gcode->get_value('S') != 0);
+            } else {
+                print(gcode->stream);
+            }
+            break;
+
+        case 381: {
+            if(!gcode->has_letter('P') || !gcode->has_letter('Q') || !gcode->has_letter('I') || !gcode->has_letter('J')) {
+                gcode->stream->printf("error: M381 needs P Q I J\n");
+                return;
+            }
+            float x= gcode->has_letter('X') ? gcode->get_value('X') : 0;
+            float y= gcode->has_letter('Y') ? gcode->get_value('Y') : 0;
+            if(!set_grid(x, y, gcode->get_value('I'), gcode->get_value('J'), gcode->get_int('P'), gcode->get_int('Q'))) {
+                gcode->stream->printf("error: grid must be 2 to %d nodes each way with a positive pitch\n", XYCOMP_MAX_NODES);
+            }
+            break;
+        }
+
+        case 382: {
+            if(nodes == nullptr) {
+                gcode->stream->printf("error: no grid defined, use M381 first\n");
+                return;
+            }
+            int i= gcode->has_letter('P') ? gcode->get_int('P') : -1;
+            int j= gcode->has_letter('Q') ? gcode->get_int('Q') : -1;
+            if(i < 0 || i >= nx || j < 0 || j >= ny) {
+                gcode->stream->printf("error: node P%d Q%d is outside the %dx%d grid\n", i, j, nx, ny);
+                return;
+            }
+            float *n= &nodes[(j * nx + i) * 2];
+            if(gcode->has_letter('X')) n[0]= gcode->get_value('X');
+            if(gcode->has_letter('Y')) n[1]= gcode->get_value('Y');
+            // only the four cells around the node change, but this is not called while moving so keep it simple
+            update_cells();
+            break;
+        }
+
+        case 383: {
+            float m[4];
+            memcpy(m, matrix, sizeof(m));
+            if(gcode->has_letter('A')) m[0]= gcode->get_value('A');
+            if(gcode->has_letter('B')) m[1]= gcode->get_value('B');
+            if(gcode->has_letter('C')) m[2]= gcode->get_value('C');
+            if(gcode->has_letter('D')) m[3]= gcode->get_value('D');
+            if(!set_matrix(m)) {
+                gcode->stream->printf("error: matrix is not invertible or is not close to identity\n");
+            }
+            break;
+        }
+
+        case 500:
+            // all of it is stored, M500 prints only what is not
+            save_settings();
+            break;
+
+        case 503:
+            gcode->stream->printf(";XY compensation matrix, %s:\nM383 A%1.6f B%1.6f C%1.6f D%1.6f\n", enabled ? "enabled" : "disabled", matrix[0], matrix[1], matrix[2], matrix[3]);
+            if(nodes != nullptr) {
+                gcode->stream->printf(";XY compensation grid %dx%d, M380 to show:\nM381 X%1.4f Y%1.4f I%1.4f J%1.4f P%d Q%d\n", nx, ny, x_start, y_start, pitch_x, pitch_y, nx, ny);
+            }
+            break;
+    }
+}
+
+void XYCompensation::set_enable(bool on)
+{
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+
+    enabled= on;
+    if(on) {
+        THEROBOT->compensationTransform= std::bind(&XYCompensation::do_compensation, this, _1, _2);
+    } else {
+        THEROBOT->compensationTransform= nullptr;
+    }
+}
+
+bool XYCompensation::set_matrix(const float m[4])
+{
+    // it is a small correction to an identity, anything far from that is a typo
+    float det= m[0] * m[3] - m[1] * m[2];
+    if(fabsf(det) < 0.5F) return false;
+
+    memcpy(matrix, m, sizeof(matrix));
+    inverse_matrix[0]=  m[3] / det;
+    inverse_matrix[1]= -m[1] / det;
+    inverse_matrix[2]= -m[2] / det;
+    inverse_matrix[3]=  m[0] / det;
+    return true;
+}
+
+bool XYCompensation::set_grid(float x, float y, float px, float py, int ni, int nj)
+{
+    if(ni < 2 || nj < 2 || ni > XYCOMP_MAX_NODES || nj > XYCOMP_MAX_NODES || px <= 0 || py <= 0) return false;
+
+    clear_grid();
+    nodes= new float[ni * nj * 2];
+    cells= new cell_t[(ni - 1) * (nj - 1)];
+    for (int i = 0; i < ni * nj * 2; ++i) nodes[i]= 0;
+
+    x_start= x;
+    y_start= y;
+    pitch_x= px;
+    pitch_y= py;
+    nx= ni;
+    ny= nj;
+    update_cells();
+    return true;
+}
+
+void XYCompensation::clear_grid()
+{
+    delete [] nodes;
+    delete [] cells;
+    nodes= nullptr;
+    cells= nullptr;
+    nx= ny= 0;
+}
+
+// precalculate the bilinear coefficients of each cell from its four corner nodes
+void XYCompensation::update_cells()
+{
+    float area= pitch_x * pitch_y;
+    for (int j = 0; j < ny - 1; ++j) {
+        for (int i = 0; i < nx - 1; ++i) {
+            const float *n00= &nodes[(j * nx + i) * 2];
+            const float *n10= n00 + 2;
+            const float *n01= n00 + nx * 2;
+            const float *n11= n01 + 2;
+            cell_t &c= cells[j * (nx - 1) + i];
+            c.ax= n00[0];
+            c.bx= (n10[0] - n00[0]) / pitch_x;
+            c.cx= (n01[0] - n00[0]) / pitch_y;
+            c.dx= (n11[0] - n10[0] - n01[0] + n00[0]) / area;
+            c.ay= n00[1];
+            c.by= (n10[1] - n00[1]) / pitch_x;
+            c.cy= (n01[1] - n00[1]) / pitch_y;
+            c.dy= (n11[1] - n10[1] - n01[1] + n00[1]) / area;
+        }
+    }
+}
+
+// the grid error at x,y, beyond the grid the nearest edge value is used
+void XYCompensation::correction(float x, float y, float& dx, float& dy) const
+{
+    if(cells == nullptr) {
+        dx= dy= 0;
+        return;
+    }
+
+    float u= std::min(std::max(x - x_start, 0.0F), pitch_x * (nx - 1));
+    float v= std::min(std::max(y - y_start, 0.0F), pitch_y * (ny - 1));
+    int i= std::min((int)(u / pitch_x), nx - 2);
+    int j= std::min((int)(v / pitch_y), ny - 2);
+    u -= i * pitch_x;
+    v -= j * pitch_y;
+
+    const cell_t &c= cells[j * (nx - 1) + i];
+    float uv= u * v;
+    dx= c.ax + c.bx * u + c.cx * v + c.dx * uv;
+    dy= c.ay + c.by * u + c.cy * v + c.dy * uv;
+}
+
+// target is in machine coordinates, the grid is indexed by the nominal position
+void XYCompensation::do_compensation(float *target, bool inverse)
+{
+    float x= target[X_AXIS], y= target[Y_AXIS];
+    float dx, dy;
+
+    if(!inverse) {
+        correction(x, y, dx, dy);
+        target[X_AXIS]= matrix[0] * x + matrix[1] * y + dx;
+        target[Y_AXIS]= matrix[2] * x + matrix[3] * y + dy;
+        return;
+    }
+
+    // the grid is not invertible in closed form, but the errors are small and smooth so a few iterations converge
+    float px= inverse_matrix[0] * x + inverse_matrix[1] * y;
+    float py= inverse_matrix[2] * x + inverse_matrix[3] * y;
+    if(cells != nullptr) {
+        for (int n = 0; n < 4; ++n) {
+            correction(px, py, dx, dy);
+            px= inverse_matrix[0] * (x - dx) + inverse_matrix[1] * (y - dy);
+            py= inverse_matrix[2] * (x - dx) + inverse_matrix[3] * (y - dy);
+        }
+    }
+    target[X_AXIS]= px;
+    target[Y_AXIS]= py;
+}
+
+void XYCompensation::print(StreamOutput *stream) const
+{
+    stream->printf("XY compensation is %s\nmatrix: A%1.6f B%1.6f C%1.6f D%1.6f\n", enabled ? "enabled" : "disabled", matrix[0], matrix[1], matrix[2], matrix[3]);
+    if(nodes == nullptr) {
+        stream->printf("no grid\n");
+        return;
+    }
+
+    stream->printf("grid %dx%d from X%1.4f Y%1.4f pitch I%1.4f J%1.4f, X,Y error per node:\n", nx, ny, x_start, y_start, pitch_x, pitch_y);
+    for (int j = ny - 1; j >= 0; --j) {
+        for (int i = 0; i < nx; ++i) {
+            const float *n= &nodes[(j * nx + i) * 2];
+            stream->printf("%8.4f,%-8.4f ", n[0], n[1]);
+        }
+        stream->printf("\n");
+    }
+}
+
+void XYCompensation::save_settings()
+{
+    FlashStore *store= THEKERNEL->flash_store;
+    float buf[XYCOMP_MAX_NODES * 2];
+
+    buf[0]= enabled ? 1 : 0;
+    memcpy(&buf[1], matrix, sizeof(matrix));
+    buf[5]= x_start;
+    buf[6]= y_start;
+    buf[7]= pitch_x;
+    buf[8]= pitch_y;
+    buf[9]= nx;
+    buf[10]= ny;
+    store->put(store_xy_compensation_checksum, buf, 11 * sizeof(float));
+
+    for (int j = 0; j < ny; ++j) {
+        store->put(store_xy_grid_checksum, j, &nodes[j * nx * 2], nx * 2 * sizeof(float));
+    }
+}
+
+void XYCompensation::restore_settings()
+{
+    FlashStore *store= THEKERNEL->flash_store;
+    float buf[XYCOMP_MAX_NODES * 2];
+
+    if(!store->get(store_xy_compensation_checksum, buf, 11 * sizeof(float))) return;
+
+    set_matrix(&buf[1]);
+
+    int ni= buf[9], nj= buf[10];
+    if(ni > 0 && set_grid(buf[5], buf[6], buf[7], buf[8], ni, nj)) {
+        for (int j = 0; j < ny; ++j) {
+            if(!store->get(store_xy_grid_checksum, j, &nodes[j * nx * 2], nx * 2 * sizeof(float))) {
+                // a partial grid would be worse than none
+                clear_grid();
+                break;
+            }
+        }
+        if(nodes != nullptr) update_cells();
+    }
+
+    set_enable(buf[0] != 0);
+}
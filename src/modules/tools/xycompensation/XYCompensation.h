@@ -0,0 +1,63 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Module.h"
+
+#include <stdint.h>
+
+class Gcode;
+class StreamOutput;
+
+// XY compensation for the placement head, the host measures the errors with its camera and loads them with M-codes,
+// after that it just sends nominal coordinates.
+// The correction is a 2x2 matrix for skew (non squareness) and scale, plus a grid of XY errors (eg belt pitch errors)
+// which is bilinearly interpolated, the coefficients of each grid cell are calculated when the grid changes so the per
+// move cost is a cell lookup and two bilinear evaluations.
+// It is installed as Robot::compensationTransform so it replaces any Z leveling strategy, only one can be active.
+//
+// M380         report the matrix and grid, M380 S1 enables, M380 S0 disables
+// M381 Xn Yn In Jn Pn Qn  define a P by Q node grid starting at X,Y with a pitch of I,J, all errors are cleared
+// M382 Pn Qn Xn Yn        set the X and Y error at node P,Q
+// M383 An Bn Cn Dn        set the matrix, X'= A*X + B*Y, Y'= C*X + D*Y
+// M500 saves all of it to the flash store
+class XYCompensation : public Module {
+    public:
+        XYCompensation();
+        ~XYCompensation();
+
+        void on_module_loaded();
+        void on_gcode_received(void *argument);
+
+    private:
+        void set_enable(bool on);
+        bool set_matrix(const float m[4]);
+        bool set_grid(float x, float y, float pitch_x, float pitch_y, int nx, int ny);
+        void clear_grid();
+        void update_cells();
+        void correction(float x, float y, float& dx, float& dy) const;
+        void do_compensation(float *target, bool inverse);
+        void print(StreamOutput *stream) const;
+        void save_settings();
+        void restore_settings();
+
+        // a + b*u + c*v + d*u*v, u and v are mm from the lower left node of the cell
+        struct cell_t {
+            float ax, bx, cx, dx;
+            float ay, by, cy, dy;
+        };
+
+        float matrix[4];          // row major
+        float inverse_matrix[4];
+        float x_start, y_start;
+        float pitch_x, pitch_y;
+        float *nodes;             // X,Y error pairs, row by row
+        cell_t *cells;
+        uint8_t nx, ny;
+        bool enabled;
+};
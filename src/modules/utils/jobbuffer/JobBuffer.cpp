@@ -0,0 +1,198 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "JobBuffer.h"
+
+#include "Kernel.h"
+#include "Robot.h"
+#include "Gcode.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "StreamOutput.h"
+#include "StreamOutputPool.h"
+
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+
+#define job_buffer_checksum                CHECKSUM("job_buffer")
+#define enable_checksum                    CHECKSUM("enable")
+#define size_checksum                      CHECKSUM("size")
+
+// goes in Flash, reports that would only repeat themselves on a replay
+static const int skipped_mcodes[]= {105, 114, 115, 119, 500, 503};
+
+JobBuffer::JobBuffer()
+{
+    recording= false;
+    origin[0]= origin[1]= origin[2]= 0;
+}
+
+void JobBuffer::on_module_loaded()
+{
+    if(!THEKERNEL->config->value(job_buffer_checksum, enable_checksum)->by_default(false)->as_bool()) {
+        // as not needed free up resource
+        delete this;
+        return;
+    }
+
+    max_steps= THEKERNEL->config->value(job_buffer_checksum, size_checksum)->by_default(1000)->as_int();
+
+    register_for_event(ON_GCODE_RECEIVED);
+    register_for_event(ON_HALT);
+}
+
+void JobBuffer::on_halt(void *argument)
+{
+    // what was recorded up to the halt is kept, but it is not the whole panel
+    if(argument == nullptr && recording) {
+        recording= false;
+        THEKERNEL->streams->printf("job buffer recording stopped by halt\n");
+    }
+}
+
+// Robot has already handled the gcode when this sees it, so the machine position is the target of a move
+void JobBuffer::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+
+    if(gcode->has_m) {
+        switch(gcode->m) {
+            case 820: {
+                steps.clear();
+                commands.clear();
+                Robot::wcs_t o= THEROBOT->wcs2mcs(Robot::wcs_t(0, 0, 0));
+                origin[X_AXIS]= std::get<X_AXIS>(o);
+                origin[Y_AXIS]= std::get<Y_AXIS>(o);
+                origin[Z_AXIS]= std::get<Z_AXIS>(o);
+                recording= true;
+                return;
+            }
+
+            case 821:
+                recording= false;
+                gcode->stream->printf("job buffer has %u moves and commands\n", (unsigned)steps.size());
+                return;
+
+            case 822:
+                if(recording) {
+                    gcode->stream->printf("error: can not replay while recording\n");
+                    return;
+                }
+                replay(gcode);
+                return;
+        }
+
+        if(recording) {
+            for (size_t i = 0; i < sizeof(skipped_mcodes) / sizeof(int); ++i) {
+                if(skipped_mcodes[i] == (int)gcode->m) return;
+            }
+            record_command(gcode);
+        }
+
+    } else if(gcode->has_g && recording) {
+        switch(gcode->g) {
+            case 0:
+            case 1:
+                record_move(gcode);
+                break;
+
+            case 2:
+            case 3:
+                recording= false;
+                gcode->stream->printf("error: arcs can not be recorded, job buffer recording stopped\n");
+                break;
+
+            case 4:
+                record_command(gcode);
+                break;
+        }
+    }
+}
+
+bool JobBuffer::add(const step_t& step)
+{
+    if(steps.size() >= max_steps) {
+        recording= false;
+        THEKERNEL->streams->printf("error: job buffer is full after %u moves and commands, recording stopped\n", (unsigned)steps.size());
+        return false;
+    }
+    steps.push_back(step);
+    return true;
+}
+
+void JobBuffer::record_move(Gcode *gcode)
+{
+    step_t s;
+    s.pos.fill(0);
+    size_t n= THEROBOT->get_number_registered_motors();
+    THEROBOT->get_axis_position(s.pos.data(), n);
+    for (int i = X_AXIS; i <= Z_AXIS; ++i) {
+        s.pos[i] -= origin[i];
+    }
+
+    // a move that did not go anywhere does not need repeating
+    if(!steps.empty() && !isnan(steps.back().rate) && steps.back().pos == s.pos) return;
+
+    s.rate= THEROBOT->get_feed_rate(gcode->g == 0);
+    s.command= 0;
+    add(s);
+}
+
+void JobBuffer::record_command(Gcode *gcode)
+{
+    char code[16];
+    if(gcode->subcode != 0) {
+        snprintf(code, sizeof(code), "%c%u.%u", gcode->has_m ? 'M' : 'G', gcode->has_m ? gcode->m : gcode->g, gcode->subcode);
+    } else {
+        snprintf(code, sizeof(code), "%c%u", gcode->has_m ? 'M' : 'G', gcode->has_m ? gcode->m : gcode->g);
+    }
+
+    step_t s;
+    s.rate= NAN;
+    s.command= commands.size();
+    if(add(s)) commands.push_back(std::string(code) + gcode->get_command());
+}
+
+void JobBuffer::replay(Gcode *gcode)
+{
+    float x= gcode->has_letter('X') ? THEROBOT->to_millimeters(gcode->get_value('X')) : 0;
+    float y= gcode->has_letter('Y') ? THEROBOT->to_millimeters(gcode->get_value('Y')) : 0;
+    float z= gcode->has_letter('Z') ? THEROBOT->to_millimeters(gcode->get_value('Z')) : 0;
+    float r_degrees= gcode->has_letter('R') ? gcode->get_value('R') : 0;
+    float r= r_degrees * (float)M_PI / 180.0F;
+    float c= cosf(r), s= sinf(r);
+
+    Robot::wcs_t o= THEROBOT->wcs2mcs(Robot::wcs_t(x, y, z));
+    size_t n= THEROBOT->get_number_registered_motors();
+    float target[k_max_actuators];
+
+    for(const step_t& step : steps) {
+        if(THEKERNEL->is_halted()) return;
+
+        if(isnan(step.rate)) {
+            Gcode gc(commands[step.command], gcode->stream);
+            THEKERNEL->call_event(ON_GCODE_RECEIVED, &gc);
+            continue;
+        }
+
+        memcpy(target, step.pos.data(), n * sizeof(float));
+        target[X_AXIS]= std::get<X_AXIS>(o) + c * step.pos[X_AXIS] - s * step.pos[Y_AXIS];
+        target[Y_AXIS]= std::get<Y_AXIS>(o) + s * step.pos[X_AXIS] + c * step.pos[Y_AXIS];
+        target[Z_AXIS]= std::get<Z_AXIS>(o) + step.pos[Z_AXIS];
+        #if MAX_ROBOT_ACTUATORS > 3
+        // a nozzle angle turns with the panel
+        for (size_t i = A_AXIS; i < n; ++i) {
+            if(THEROBOT->is_rotary_wrap(i)) target[i] += r_degrees;
+        }
+        #endif
+
+        // the rate is scaled by M220 now, not when it was recorded
+        THEROBOT->move_to(target, step.rate / THEROBOT->get_seconds_per_minute());
+    }
+}
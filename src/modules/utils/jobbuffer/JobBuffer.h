@@ -0,0 +1,56 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Module.h"
+#include "ActuatorCoordinates.h"
+
+#include <string>
+#include <vector>
+#include <array>
+
+class Gcode;
+
+// Records the moves and commands of one panel of a panelised job while it runs, then replays them for the other
+// panels under a different origin and rotation.
+// The moves are kept as binary machine positions relative to the WCS origin at the start of the recording, so a
+// replay does no parsing, each move goes straight to Robot::move_to().
+// Arcs can not be recorded, Gnn that only change state (G90, G92, G54...) are not needed as the positions are absolute.
+//
+// M820        start recording, clears what was recorded before
+// M821        stop recording, reports what was recorded
+// M822 Xn Yn Zn Rn   replay with the recorded origin moved to X,Y,Z in the current WCS and rotated R degrees CCW about it,
+//                    R is also added to the wrapping rotary axes (<axis>_rotary_wrap) so the parts placed by the
+//                    nozzles are turned with the panel, other ABC axes are replayed as recorded
+class JobBuffer : public Module {
+    public:
+        JobBuffer();
+
+        void on_module_loaded();
+        void on_gcode_received(void *argument);
+        void on_halt(void *argument);
+
+    private:
+        // a move when rate is set, otherwise a command
+        struct step_t {
+            std::array<float, k_max_actuators> pos; // XYZ from the origin, the rest as they are
+            float rate;                             // mm/min
+            uint16_t command;                       // index into commands
+        };
+
+        bool add(const step_t& step);
+        void record_move(Gcode *gcode);
+        void record_command(Gcode *gcode);
+        void replay(Gcode *gcode);
+
+        std::vector<step_t> steps;
+        std::vector<std::string> commands;
+        float origin[3];                            // MCS of the WCS origin when recording started
+        size_t max_steps;
+        bool recording;
+};
@@ -0,0 +1,332 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Macros.h"
+#include "MacrosPublicAccess.h"
+
+#include "Kernel.h"
+#include "Gcode.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "StreamOutput.h"
+#include "FlashStore.h"
+#include "PublicDataRequest.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define enable_checksum                    CHECKSUM("enable")
+
+#define store_macros_checksum              CHECKSUM("store_macros")
+// macro n is saved as record n of this key
+#define store_macro_checksum               CHECKSUM("store_macro")
+
+#define MACROS_MAX 16
+
+// the value of letter in the call as it was sent, found the way Gcode::get_value() finds it
+static std::string call_value(const Gcode *call, char letter)
+{
+    for (const char *cs= call->get_command(); *cs; cs++) {
+        if(*cs != letter) continue;
+        char *cn;
+        strtof(cs + 1, &cn);
+        if(cn > cs + 1) {
+            const char *s= cs + 1;
+            while(*s == ' ') ++s;
+            return std::string(s, cn - s);
+        }
+    }
+    // as get_value() reads it
+    return "0";
+}
+
+Macros::Macros()
+{
+}
+
+void Macros::on_module_loaded()
+{
+    if(!THEKERNEL->config->value(macros_checksum, enable_checksum)->by_default(false)->as_bool()) {
+        // as not needed free up resource
+        delete this;
+        return;
+    }
+
+    register_for_event(ON_GCODE_RECEIVED);
+    register_for_event(ON_SET_PUBLIC_DATA);
+
+    restore_settings();
+}
+
+void Macros::on_set_public_data(void *argument)
+{
+    PublicDataRequest *pdr = static_cast<PublicDataRequest *>(argument);
+
+    if(!pdr->starts_with(macros_checksum)) return;
+
+    if(pdr->second_element_is(define_macro_checksum)) {
+        macro_definition *d= static_cast<macro_definition *>(pdr->get_data_ptr());
+        d->ok= define(d->text, d->append, d->stream);
+        pdr->set_taken();
+    }
+}
+
+void Macros::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+
+    if(!gcode->has_m) return;
+
+    switch(gcode->m) {
+        case 841: {
+            // the name follows the M code
+            const char *p= gcode->get_command();
+            if(*p == '.') {
+                // skip the subcode
+                ++p;
+                while(*p >= '0' && *p <= '9') ++p;
+            }
+            while(*p == ' ') ++p;
+            const char *e= p;
+            while((*e >= 'a' && *e <= 'z') || (*e >= '0' && *e <= '9') || *e == '_') ++e;
+
+            macro_t *m= find(std::string(p, e - p));
+            if(m == nullptr) {
+                // a mistyped name is no reason to halt, is_error is left for a command of the macro that fails
+                gcode->stream->printf("%sunknown macro %s\n", THEKERNEL->is_grbl_mode() ? "error:" : "Error: ", std::string(p, e - p).c_str());
+                return;
+            }
+            run(*m, gcode);
+            break;
+        }
+
+        case 500:
+            // all of it is stored, M500 prints only what is not
+            save_settings();
+            break;
+
+        case 503:
+            if(!macros.empty()) {
+                gcode->stream->printf(";Macros:\n");
+                list(gcode->stream);
+            }
+            break;
+    }
+}
+
+Macros::macro_t *Macros::find(const std::string& name)
+{
+    for(auto& m : macros) {
+        if(m.name == name) return &m;
+    }
+    return nullptr;
+}
+
+bool Macros::define(const std::string& text, bool append, StreamOutput *stream)
+{
+    const char *p= text.c_str();
+    while(*p == ' ') ++p;
+    const char *e= p;
+    while((*e >= 'a' && *e <= 'z') || (*e >= '0' && *e <= '9') || *e == '_') ++e;
+    std::string name(p, e - p);
+    if(*e != ' ' && *e != '\0') {
+        stream->printf("error: macro names are lower case letters, digits and _\n");
+        return false;
+    }
+
+    if(name.empty()) {
+        list(stream);
+        return true;
+    }
+
+    while(*e == ' ') ++e;
+    macro_t *m= find(name);
+    if(*e == '\0' && !append) {
+        // no body so delete it
+        if(m != nullptr) macros.erase(macros.begin() + (m - &macros[0]));
+        return true;
+    }
+
+    std::vector<word_t> words;
+    if(!parse(e, words, stream)) return false;
+
+    macro_t n;
+    n.name= name;
+    if(append && m != nullptr) n.words= m->words;
+    n.words.insert(n.words.end(), words.begin(), words.end());
+
+    // it has to fit in one flash store record
+    if(to_text(n).size() > FLASHSTORE_MAX_SIZE) {
+        stream->printf("error: macro %s is longer than %d characters\n", name.c_str(), FLASHSTORE_MAX_SIZE);
+        return false;
+    }
+
+    if(m != nullptr) {
+        *m= n;
+    } else if(macros.size() < MACROS_MAX) {
+        macros.push_back(n);
+    } else {
+        stream->printf("error: only %d macros can be defined\n", MACROS_MAX);
+        return false;
+    }
+    return true;
+}
+
+// parses cmd|cmd|... into words, each command has to start with a G, M or T
+bool Macros::parse(const char *p, std::vector<word_t>& words, StreamOutput *stream) const
+{
+    bool first= true;
+    for (;;) {
+        while(*p == ' ' || *p == '\t') ++p;
+
+        if(*p == '|' || *p == '\0') {
+            if(!first) words.push_back({0, 0, std::string()});
+            if(*p == '\0') break;
+            first= true;
+            ++p;
+            continue;
+        }
+
+        char letter= *p++;
+        if(letter < 'A' || letter > 'Z') {
+            stream->printf("error: unexpected '%c' in macro\n", letter);
+            return false;
+        }
+
+        word_t w{letter, 0, std::string()};
+        if(*p == '#') {
+            w.param= p[1];
+            if(w.param < 'A' || w.param > 'Z' || w.param == 'G' || w.param == 'M') {
+                stream->printf("error: #%c is not a parameter letter\n", w.param);
+                return false;
+            }
+            p += 2;
+        } else {
+            // strtof() would take 0X.. as hex
+            size_t n= strspn(p, "+-.0123456789");
+            w.value.assign(p, n);
+            p += n;
+        }
+
+        if(first) {
+            if((letter != 'G' && letter != 'M' && letter != 'T') || w.param != 0 || w.value.empty()) {
+                stream->printf("error: macro commands start with G, M or T and a number\n");
+                return false;
+            }
+            int code= strtol(w.value.c_str(), nullptr, 10);
+            if((letter == 'G' && code == 53) || (letter == 'M' && (code == 28 || code == 112 || code == 117 || code == 840 || code == 841))) {
+                stream->printf("error: %c%d can not be used in a macro\n", letter, code);
+                return false;
+            }
+            first= false;
+        }
+        words.push_back(w);
+    }
+
+    if(words.empty()) {
+        stream->printf("error: empty macro\n");
+        return false;
+    }
+    return true;
+}
+
+bool Macros::run(const macro_t& macro, Gcode *call)
+{
+    std::string cmd;
+    for(const word_t& w : macro.words) {
+        if(w.letter != 0) {
+            if(w.param != 0 && !call->has_letter(w.param)) continue;
+            if(!cmd.empty()) cmd += ' ';
+            cmd += w.letter;
+            cmd += (w.param != 0) ? call_value(call, w.param) : w.value;
+            continue;
+        }
+
+        // a halt or an error stops it, the rest may depend on what did not happen
+        if(THEKERNEL->is_halted()) return false;
+
+        Gcode gc(cmd, call->stream);
+        THEKERNEL->call_event(ON_GCODE_RECEIVED, &gc);
+        cmd.clear();
+
+        if(gc.is_error) {
+            call->is_error= true;
+            call->txt_after_ok= "macro " + macro.name + ": " + (gc.txt_after_ok.empty() ? "unknown" : gc.txt_after_ok);
+            return false;
+        }
+        if(!gc.txt_after_ok.empty()) {
+            call->stream->printf("%s\n", gc.txt_after_ok.c_str());
+        }
+    }
+    return true;
+}
+
+// the definition as it would be given to M840
+std::string Macros::to_text(const macro_t& macro) const
+{
+    std::string str= macro.name;
+    bool first= true;
+    for(const word_t& w : macro.words) {
+        if(w.letter == 0) {
+            str += '|';
+            first= true;
+            continue;
+        }
+        if(!first || str.back() != '|') str += ' ';
+        str += w.letter;
+        if(w.param != 0) {
+            str += '#';
+            str += w.param;
+        } else {
+            str += w.value;
+        }
+        first= false;
+    }
+    if(!str.empty() && str.back() == '|') str.pop_back();
+    return str;
+}
+
+void Macros::list(StreamOutput *stream) const
+{
+    for(const auto& m : macros) {
+        stream->printf("M840 %s\n", to_text(m).c_str());
+    }
+}
+
+void Macros::save_settings()
+{
+    FlashStore *store= THEKERNEL->flash_store;
+    uint16_t lengths[MACROS_MAX];
+
+    for (size_t i = 0; i < MACROS_MAX; ++i) {
+        if(i < macros.size()) {
+            std::string str= to_text(macros[i]);
+            lengths[i]= str.size();
+            store->put(store_macro_checksum, i, str.data(), str.size());
+        } else {
+            lengths[i]= 0;
+        }
+    }
+    store->put(store_macros_checksum, lengths, sizeof(lengths));
+}
+
+void Macros::restore_settings()
+{
+    FlashStore *store= THEKERNEL->flash_store;
+    uint16_t lengths[MACROS_MAX];
+
+    if(!store->get(store_macros_checksum, lengths, sizeof(lengths))) return;
+
+    char buf[FLASHSTORE_MAX_SIZE + 1];
+    for (size_t i = 0; i < MACROS_MAX; ++i) {
+        if(lengths[i] == 0 || lengths[i] > FLASHSTORE_MAX_SIZE) continue;
+        if(!store->get(store_macro_checksum, i, buf, lengths[i])) continue;
+        buf[lengths[i]]= '\0';
+        define(buf, false, &StreamOutput::NullStream);
+    }
+}
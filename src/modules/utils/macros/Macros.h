@@ -0,0 +1,63 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Module.h"
+
+#include <string>
+#include <vector>
+
+class Gcode;
+class StreamOutput;
+
+// Named gcode sequences kept in the controller, like the drag feed, peel and nozzle change sequences, so the host
+// sends one short command instead of streaming every line each time.
+// The body is parsed into words once when it is defined, running it builds each command from the words and
+// dispatches it straight to the modules without going through the serial line handling again. Numbers are kept as
+// they were sent, in the body and in the call, so a macro sends exactly what the host would have.
+//
+// M840 name cmd|cmd|...   define or replace a macro, #L as a value is replaced by the value of L in the call, eg
+//                         M840 drag M816|G91|G0 X#X F#F|G90|M817
+// M840.1 name cmd|cmd|... append more commands, for bodies that do not fit on one line
+// M840 name               delete the macro, M840 on its own lists them all
+// M841 name Xn...         run the macro, a word whose parameter is not in the call is left out
+// M500 saves them to the flash store
+// Names are lower case, the commands the serial dispatcher handles itself (M28, M112, M117, G53) can not be used.
+class Macros : public Module {
+    public:
+        Macros();
+
+        void on_module_loaded();
+        void on_gcode_received(void *argument);
+        void on_set_public_data(void *argument);
+
+    private:
+        // param is the letter of the call whose value is used, value is the number as it was written and empty for
+        // a letter without one, a word with letter 0 ends each command
+        struct word_t {
+            char letter;
+            char param;
+            std::string value;
+        };
+
+        struct macro_t {
+            std::string name;
+            std::vector<word_t> words;
+        };
+
+        bool define(const std::string& text, bool append, StreamOutput *stream);
+        bool parse(const char *body, std::vector<word_t>& words, StreamOutput *stream) const;
+        bool run(const macro_t& macro, Gcode *call);
+        std::string to_text(const macro_t& macro) const;
+        macro_t *find(const std::string& name);
+        void list(StreamOutput *stream) const;
+        void save_settings();
+        void restore_settings();
+
+        std::vector<macro_t> macros;
+};
@@ -0,0 +1,18 @@
+#ifndef MACROSPUBLICACCESS_H
+#define MACROSPUBLICACCESS_H
+
+#include <string>
+
+class StreamOutput;
+
+#define macros_checksum           CHECKSUM("macros")
+#define define_macro_checksum     CHECKSUM("define_macro")
+
+// the dispatcher passes the raw rest of the M840 line as it can not be split into commands
+struct macro_definition {
+    std::string text;
+    StreamOutput *stream;
+    bool append;
+    bool ok;    // set by the macros module, false if it reported an error
+};
+#endif
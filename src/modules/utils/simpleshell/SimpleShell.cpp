@@ -29,6 +29,7 @@
 #include "StepperMotor.h"
 #include "Configurator.h"
 #include "Block.h"
+#include "FlightRecorder.h"
 
 #include "TemperatureControlPublicAccess.h"
 #include "EndstopsPublicAccess.h"
@@ -48,16 +49,21 @@
 #include "mbed.h" // for wait_ms()
 
 extern unsigned int g_maximumHeapAddress;
+extern unsigned int g_stackLimitAddress;
+extern "C" uint32_t __StackTop;
 
 #include <malloc.h>
 #include <mri.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/stat.h>
 #include <functional>
 
+#ifndef HOST_BUILD
 extern "C" uint32_t  __end__;
 extern "C" uint32_t  __malloc_free_list;
 extern "C" uint32_t  _sbrk(int size);
+#endif
 
 
 // command lookup table
@@ -88,6 +94,7 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
     {"thermistors", SimpleShell::print_thermistors_command},
     {"md5sum",   SimpleShell::md5sum_command},
     {"test",     SimpleShell::test_command},
+    {"recorder", SimpleShell::recorder_command},
 
     // unknown command
     {NULL, NULL}
@@ -95,6 +102,7 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
 
 int SimpleShell::reset_delay_secs = 0;
 
+#ifndef HOST_BUILD
 // Adam Greens heap walk from http://mbed.org/forum/mbed/topic/2701/?page=4#comment-22556
 static uint32_t heapWalk(StreamOutput *stream, bool verbose)
 {
@@ -149,6 +157,7 @@ static uint32_t heapWalk(StreamOutput *stream, bool verbose)
     stream->printf("Allocated: %lu, Free: %lu\r\n", usedSize, freeSize);
     return freeSize;
 }
+#endif
 
 
 void SimpleShell::on_module_loaded()
@@ -582,6 +591,7 @@ void SimpleShell::save_command( string parameters, StreamOutput *stream )
 void SimpleShell::mem_command( string parameters, StreamOutput *stream)
 {
     bool verbose = shift_parameter( parameters ).find_first_of("Vv") != string::npos;
+#ifndef HOST_BUILD
     unsigned long heap = (unsigned long)_sbrk(0);
     unsigned long m = g_maximumHeapAddress - heap;
     stream->printf("Unused Heap: %lu bytes\r\n", m);
@@ -589,13 +599,20 @@ void SimpleShell::mem_command( string parameters, StreamOutput *stream)
     uint32_t f = heapWalk(stream, verbose);
     stream->printf("Total Free RAM: %lu bytes\r\n", m + f);
 
-    stream->printf("Free AHB0: %lu, AHB1: %lu\r\n", AHB0.free(), AHB1.free());
+    // the stack is filled with 0xdeadbeef at startup, so the lowest word that changed is the high water mark
+    uint32_t *sp = (uint32_t *)(g_stackLimitAddress + 32);
+    while (sp < &__StackTop && *sp == 0xdeadbeef) ++sp;
+    stream->printf("CCM stack: used %lu of %lu bytes\r\n", (unsigned long)&__StackTop - (unsigned long)sp, (unsigned long)&__StackTop - (g_stackLimitAddress + 32));
+#endif
+
+    stream->printf("Free CCM: %lu, AHB0 (SRAM1): %lu, AHB1 (SRAM2): %lu\r\n", (unsigned long)CCM.free(), (unsigned long)AHB0.free(), (unsigned long)AHB1.free());
     if (verbose) {
+        CCM.debug(stream);
         AHB0.debug(stream);
         AHB1.debug(stream);
     }
 
-    stream->printf("Block size: %u bytes, Tickinfo size: %u bytes\n", sizeof(Block), sizeof(Block::tickinfo_t) * Block::n_actuators);
+    stream->printf("Block size: %u bytes, Tickinfo size: %u bytes, both are in CCM for each planner_queue_size entry\n", (unsigned)sizeof(Block), (unsigned)(sizeof(Block::tickinfo_t) * Block::n_actuators));
 }
 
 // get network config
@@ -618,10 +635,14 @@ void SimpleShell::version_command( string parameters, StreamOutput *stream)
 {
     Version vers;
 
+#ifdef HOST_BUILD
+    const char *mcu = "Linux host";
+#else
     const uint32_t *mcu_idcode = (const uint32_t *)DBGMCU_BASE;
     const char *mcu = ((*mcu_idcode & 0x0FFF) == 0x413) ? "STM32F4" : "Unknown";
+#endif
 
-    stream->printf("Build version: %s, Build date: %s, MCU: %s, System Clock: %ldMHz\r\n", vers.get_build(), vers.get_build_date(), mcu, SystemCoreClock / 1000000);
+    stream->printf("Build version: %s, Build date: %s, MCU: %s, System Clock: %luMHz\r\n", vers.get_build(), vers.get_build_date(), mcu, (unsigned long)(SystemCoreClock / 1000000));
     #ifdef CNC
     stream->printf("  CNC Build ");
     #endif
@@ -956,6 +977,13 @@ void SimpleShell::md5sum_command( string parameters, StreamOutput *stream )
     fclose(lp);
 }
 
+// dumps the flight recorder, optionally only the last n records
+void SimpleShell::recorder_command( string parameters, StreamOutput *stream )
+{
+    string n = shift_parameter( parameters );
+    THEKERNEL->flight_recorder->dump(stream, n.empty() ? 0 : strtol(n.c_str(), nullptr, 10));
+}
+
 // runs several types of test on the mechanisms
 void SimpleShell::test_command( string parameters, StreamOutput *stream)
 {
@@ -1098,7 +1126,7 @@ void SimpleShell::test_command( string parameters, StreamOutput *stream)
         }
 
         uint32_t sps= strtol(stepspersec.c_str(), NULL, 10);
-        sps= std::max(sps, 1UL);
+        sps= std::max(sps, (uint32_t)1);
 
         uint32_t delayus= 1000000.0F / sps;
         for(int s= 0;s<steps;s++) {
@@ -1202,5 +1230,6 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("calc_thermistor [-s0] T1,R1,T2,R2,T3,R3 - calculate the Steinhart Hart coefficients for a thermistor\r\n");
     stream->printf("thermistors - print out the predefined thermistors\r\n");
     stream->printf("md5sum file - prints md5 sum of the given file\r\n");
+    stream->printf("recorder [n] - dumps the last n motion events of the flight recorder, M831 freezes it\r\n");
 }
 
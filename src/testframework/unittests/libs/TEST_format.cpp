@@ -0,0 +1,91 @@
+#include "Format.h"
+
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "easyunit/test.h"
+
+static void flush_to_string(void *ctx, const char *s)
+{
+    static_cast<std::string *>(ctx)->append(s);
+}
+
+static std::string fmt(const char *format, ...)
+{
+    std::string str;
+    char chunk[16]; // small so most tests flush more than once
+    va_list args;
+    va_start(args, format);
+    vformat(chunk, sizeof(chunk), flush_to_string, &str, format, args);
+    va_end(args);
+    return str;
+}
+
+static bool same_as_snprintf(float v, uint8_t decimals)
+{
+    char a[FORMAT_FIXED_MAX], b[64];
+    format_fixed(a, v, decimals);
+    snprintf(b, sizeof(b), "%1.*f", decimals, v);
+    return strcmp(a, b) == 0;
+}
+
+TEST(FormatTest,format_fixed)
+{
+    char buf[FORMAT_FIXED_MAX];
+
+    ASSERT_TRUE(format_fixed(buf, 1.0F, 4) == 6);
+    ASSERT_TRUE(strcmp(buf, "1.0000") == 0);
+    format_fixed(buf, -0.5F, 1);
+    ASSERT_TRUE(strcmp(buf, "-0.5") == 0);
+    format_fixed(buf, 123.45678F, 0);
+    ASSERT_TRUE(strcmp(buf, "123") == 0);
+    format_fixed(buf, -0.00001F, 4);
+    ASSERT_TRUE(strcmp(buf, "-0.0000") == 0);
+}
+
+TEST(FormatTest,format_fixed_matches_snprintf)
+{
+    // positions, feedrates and the rounding ties
+    const float values[]= {0, 0.00005F, 0.125F, 0.375F, 2.5F, 1.23455F, -42.00015F, 299.9999F, 1234.56789F, -0.99999F, 65535.5F, 1e12F};
+    for(float v : values) {
+        for (uint8_t d = 0; d <= 6; ++d) {
+            ASSERT_TRUE(same_as_snprintf(v, d));
+        }
+    }
+
+    for (int i = -200000; i <= 200000; i += 7) {
+        ASSERT_TRUE(same_as_snprintf(i * 0.0123F, 4));
+    }
+}
+
+TEST(FormatTest,vformat)
+{
+    ASSERT_TRUE(fmt("ok") == "ok");
+    ASSERT_TRUE(fmt("%d %u %x %X %o %c %s %%", -12, 34U, 0xbeef, 0xbeef, 8, 'q', "str") == "-12 34 beef BEEF 10 q str %");
+    ASSERT_TRUE(fmt("[%5d|%-5d|%05d|%+d|%.3d]", 42, 42, -42, 42, 7) == "[   42|42   |-0042|+42|007]");
+    ASSERT_TRUE(fmt("%lu %lld %zu", 4000000000UL, -5000000000LL, (size_t)9) == "4000000000 -5000000000 9");
+    ASSERT_TRUE(fmt("%*s|%-*s|%.2s", 4, "ab", 4, "ab", "abcd") == "  ab|ab  |ab");
+    ASSERT_TRUE(fmt("X:%1.4f Y:%8.3f Z:%-8.1f|", 10.5F, -3.25F, 7.0F) == "X:10.5000 Y:  -3.250 Z:7.0     |");
+    ASSERT_TRUE(fmt("%e %g", 12345.678, 0.0001) == "1.234568e+04 0.0001");
+
+    // much longer than the chunk
+    std::string s= fmt("%s-%s-%s", "0123456789abcdef", "0123456789abcdef", "0123456789abcdef");
+    ASSERT_TRUE(s == "0123456789abcdef-0123456789abcdef-0123456789abcdef");
+}
+
+TEST(FormatTest,append_fixed)
+{
+    // an M114 style report built both ways
+    const float pos[]= {123.4567F, -45.6789F, 12.3456F, 359.9999F};
+    char buf[64];
+    snprintf(buf, sizeof(buf), "C: X:%1.4f Y:%1.4f Z:%1.4f A:%1.4f", pos[0], pos[1], pos[2], pos[3]);
+
+    std::string b("C: X:");
+    append_fixed(b, pos[0], 4);
+    b.append(" Y:"); append_fixed(b, pos[1], 4);
+    b.append(" Z:"); append_fixed(b, pos[2], 4);
+    b.append(" A:"); append_fixed(b, pos[3], 4);
+    ASSERT_TRUE(b == buf);
+}
@@ -0,0 +1,75 @@
+#include "LatencyStats.h"
+#include "Kernel.h"
+#include "Block.h"
+#include "Gcode.h"
+#include "StringStream.h"
+#include "Test_kernel.h"
+#include "us_ticker_api.h"
+
+#include <string>
+#include <stdio.h>
+
+#include "easyunit/test.h"
+
+DECLARE(LatencyStats)
+  LatencyStats *ls;
+END_DECLARE
+
+SETUP(LatencyStats)
+{
+    ls = new LatencyStats();
+}
+
+TEARDOWN(LatencyStats)
+{
+    delete ls;
+    test_kernel_teardown();
+}
+
+const static char latency_config[]= "\
+latency_stats.enable true \n\
+";
+
+// M832 reports the sample count of a stage as "stage: n count avg ..." when it has any
+static bool has_count(LatencyStats *ls, const char *stage, int n)
+{
+    StringStream ss;
+    Gcode gc("M832", &ss);
+    ls->on_gcode_received(&gc);
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s: n %d ", stage, n);
+    return ss.getOutput().find(buf) != std::string::npos;
+}
+
+TESTF(LatencyStats,one_sample_per_line)
+{
+    test_kernel_setup_config(latency_config, &latency_config[sizeof(latency_config)]);
+    ls->on_module_loaded();
+    ASSERT_TRUE(ls->is_enabled());
+
+    // a G1 sends its ok before it is planned, then queues three segments
+    Block block;
+    ls->set_line_received(us_ticker_read());
+    ls->line_ok();
+    for (int i = 0; i < 3; ++i) ls->block_queued(&block);
+
+    ASSERT_TRUE(has_count(ls, "rx>ok", 1));
+    ASSERT_TRUE(has_count(ls, "rx>queued", 1));
+
+    // a G0 queues its block before its ok
+    ls->set_line_received(us_ticker_read());
+    ls->block_queued(&block);
+    ls->line_ok();
+    ls->line_ok();
+
+    ASSERT_TRUE(has_count(ls, "rx>ok", 2));
+    ASSERT_TRUE(has_count(ls, "rx>queued", 2));
+
+    // blocks and oks from a line that did not come from a serial console count for no line
+    ls->set_line_received(0);
+    ls->block_queued(&block);
+    ls->line_ok();
+
+    ASSERT_TRUE(has_count(ls, "rx>ok", 2));
+    ASSERT_TRUE(has_count(ls, "rx>queued", 2));
+}
@@ -0,0 +1,32 @@
+#include "Planner.h"
+
+#include <math.h>
+
+#include "easyunit/test.h"
+
+TEST(PlannerTest,backlash_rate_scale)
+{
+    // X moves 100 steps at 4000 steps/s, Y moves 10 steps plus 40 steps of slack so steps at 2000 steps/s
+    ASSERT_TRUE(Planner::backlash_rate_scale(4000.0F, 100, 50, 2000.0F) == 1.0F);
+    // at 5000 steps/s Y would step at 2500 steps/s which is over its max rate
+    float s= Planner::backlash_rate_scale(5000.0F, 100, 50, 2000.0F);
+    ASSERT_TRUE(fabsf(s - 0.8F) < 1e-6F);
+    ASSERT_TRUE(fabsf(5000.0F * s * 50 / 100 - 2000.0F) < 0.01F);
+}
+
+TEST(PlannerTest,backlash_accel_scale)
+{
+    ASSERT_TRUE(Planner::backlash_accel_scale(100, 0) == 1.0F);
+    // 10 steps of move plus 40 of slack accelerate 5 times harder unless scaled
+    ASSERT_TRUE(fabsf(Planner::backlash_accel_scale(50, 40) - 0.2F) < 1e-6F);
+    ASSERT_TRUE(Planner::backlash_accel_scale(40, 40) == 1.0F);
+}
+
+TEST(PlannerTest,override_speed_factor)
+{
+    // a block that can run twice as fast is planned at its nominal speed at any override
+    ASSERT_TRUE(Planner::override_speed_factor(2.0F, 2.0F) == 1.0F);
+    ASSERT_TRUE(Planner::override_speed_factor(2.0F, 0.5F) == 1.0F);
+    // one that can only take 150% runs at 150% of its nominal speed at 200%
+    ASSERT_TRUE(fabsf(Planner::override_speed_factor(1.5F, 2.0F) * 2.0F - 1.5F) < 1e-6F);
+}
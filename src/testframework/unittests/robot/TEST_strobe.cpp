@@ -0,0 +1,35 @@
+#include "PositionStrobe.h"
+
+#include "easyunit/test.h"
+
+TEST(PositionStrobeTest,crossed_in_direction_of_travel)
+{
+    // stepping onto the target from either side crosses it
+    ASSERT_TRUE(PositionStrobe::crossed(99, 100, 100));
+    ASSERT_TRUE(PositionStrobe::crossed(101, 100, 100));
+    // jumping over it does too
+    ASSERT_TRUE(PositionStrobe::crossed(98, 102, 100));
+    ASSERT_TRUE(PositionStrobe::crossed(102, 98, 100));
+    // stepping off it, or moving short of it, does not
+    ASSERT_TRUE(!PositionStrobe::crossed(100, 101, 100));
+    ASSERT_TRUE(!PositionStrobe::crossed(100, 99, 100));
+    ASSERT_TRUE(!PositionStrobe::crossed(98, 99, 100));
+    ASSERT_TRUE(!PositionStrobe::crossed(102, 101, 100));
+}
+
+TEST(PositionStrobeTest,standing_still_does_not_cross)
+{
+    ASSERT_TRUE(!PositionStrobe::crossed(100, 100, 100));
+    ASSERT_TRUE(!PositionStrobe::crossed(99, 99, 100));
+}
+
+TEST(PositionStrobeTest,crosses_again_on_a_later_pass)
+{
+    // out past the target and back crosses it twice, and on the next pass out once more
+    int32_t path[]= { 98, 99, 100, 101, 102, 101, 100, 99, 98, 99, 100, 101 };
+    int n= 0;
+    for (unsigned i = 1; i < sizeof(path) / sizeof(path[0]); ++i) {
+        if(PositionStrobe::crossed(path[i - 1], path[i], 100)) ++n;
+    }
+    ASSERT_TRUE(n == 3);
+}
@@ -0,0 +1,63 @@
+#include "Endstops.h"
+#include "BaseSolution.h"
+#include "ActuatorCoordinates.h"
+
+#include <math.h>
+
+#include "easyunit/test.h"
+
+// X and Y as they are, Z on a 24mm cam in degrees like the CHMT
+class TestCamSolution : public BaseSolution {
+    public:
+        void cartesian_to_actuator(const float c[], ActuatorCoordinates &a) const override
+        {
+            a[0]= c[0]; a[1]= c[1]; a[2]= asinf(c[2] / 24.0F) * 180.0F / (float)M_PI;
+        }
+        void actuator_to_cartesian(const ActuatorCoordinates &a, float c[]) const override
+        {
+            c[0]= a[0]; c[1]= a[1]; c[2]= 24.0F * sinf(a[2] * (float)M_PI / 180.0F);
+        }
+};
+
+// corexy, each axis moves both motors
+class TestCoreXYSolution : public BaseSolution {
+    public:
+        void cartesian_to_actuator(const float c[], ActuatorCoordinates &a) const override
+        {
+            a[0]= c[0] + c[1]; a[1]= c[0] - c[1]; a[2]= c[2];
+        }
+        void actuator_to_cartesian(const ActuatorCoordinates &a, float c[]) const override
+        {
+            c[0]= (a[0] + a[1]) / 2; c[1]= (a[0] - a[1]) / 2; c[2]= a[2];
+        }
+};
+
+TEST(EndstopsTest,concurrent_homing_actuator_units)
+{
+    TestCamSolution cam;
+    ActuatorCoordinates from;
+    from.fill(0);
+
+    // X and Y move as far as asked
+    ASSERT_TRUE(fabsf(Endstops::actuator_distance(&cam, from, 0, -100.0F) + 100.0F) < 0.0001F);
+    ASSERT_TRUE(fabsf(Endstops::actuator_distance(&cam, from, 1, 5.0F) - 5.0F) < 0.0001F);
+
+    // 12mm of Z from the middle is 30 degrees of cam
+    ASSERT_TRUE(fabsf(Endstops::actuator_distance(&cam, from, 2, 12.0F) - 30.0F) < 0.001F);
+
+    // and back off 2mm from 30 degrees depends on where the cam is
+    from[2]= 30.0F;
+    float d= Endstops::actuator_distance(&cam, from, 2, -2.0F);
+    ASSERT_TRUE(fabsf(d - (asinf(10.0F / 24.0F) * 180.0F / (float)M_PI - 30.0F)) < 0.001F);
+}
+
+TEST(EndstopsTest,concurrent_homing_coupled_axes)
+{
+    // an axis that needs another actuator as well can not home on its own
+    TestCoreXYSolution corexy;
+    ActuatorCoordinates from;
+    from.fill(0);
+    ASSERT_TRUE(isnan(Endstops::actuator_distance(&corexy, from, 0, 10.0F)));
+    ASSERT_TRUE(isnan(Endstops::actuator_distance(&corexy, from, 1, 10.0F)));
+    ASSERT_TRUE(fabsf(Endstops::actuator_distance(&corexy, from, 2, 10.0F) - 10.0F) < 0.0001F);
+}